@@ -0,0 +1 @@
+#include "../src/tfragmentcache.h"
@@ -0,0 +1 @@
+#include "../src/tmemcached.h"
@@ -0,0 +1 @@
+#include "../src/tredis.h"
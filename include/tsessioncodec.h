@@ -0,0 +1 @@
+#include "../src/tsessioncodec.h"
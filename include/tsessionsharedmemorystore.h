@@ -0,0 +1 @@
+#include "../src/tsessionsharedmemorystore.h"
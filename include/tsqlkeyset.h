@@ -0,0 +1 @@
+#include "../src/tsqlkeyset.h"
@@ -0,0 +1 @@
+#include "../src/tsqlstatementcache.h"
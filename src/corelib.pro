@@ -87,12 +87,22 @@ HEADERS += tactionview.h
 SOURCES += tactionview.cpp
 HEADERS += tactionmailer.h
 SOURCES += tactionmailer.cpp
+HEADERS += tfragmentcache.h
+SOURCES += tfragmentcache.cpp
 HEADERS += tsqldatabasepool.h
 SOURCES += tsqldatabasepool.cpp
 HEADERS += tsqlobject.h
 SOURCES += tsqlobject.cpp
+HEADERS += tsqlschemacache.h
+SOURCES += tsqlschemacache.cpp
+HEADERS += tsqlstatementcache.h
+SOURCES += tsqlstatementcache.cpp
 HEADERS += tsqlormapperiterator.h
 SOURCES += tsqlormapperiterator.cpp
+HEADERS += tsqlormappercursor.h
+SOURCES += tsqlormappercursor.cpp
+HEADERS += tsqlkeyset.h
+SOURCES += tsqlkeyset.cpp
 HEADERS += tsqlquery.h
 SOURCES += tsqlquery.cpp
 HEADERS += tsqlqueryormapper.h
@@ -147,6 +157,21 @@ HEADERS += tsessioncookiestore.h
 SOURCES += tsessioncookiestore.cpp
 HEADERS += tsessionfilestore.h
 SOURCES += tsessionfilestore.cpp
+HEADERS += tsessionmemorystore.h
+SOURCES += tsessionmemorystore.cpp
+HEADERS += tsessionsharedmemorystore.h
+SOURCES += tsessionsharedmemorystore.cpp
+HEADERS += tsessioncodec.h
+SOURCES += tsessioncodec.cpp
+HEADERS += tsessionmemcachedstore.h
+SOURCES += tsessionmemcachedstore.cpp
+HEADERS += tmemcached.h
+SOURCES += tmemcached.cpp
+HEADERS += tclientpool.h
+HEADERS += tsessionredisstore.h
+SOURCES += tsessionredisstore.cpp
+HEADERS += tredis.h
+SOURCES += tredis.cpp
 HEADERS += thtmlparser.h
 SOURCES += thtmlparser.cpp
 HEADERS += tabstractmodel.h
@@ -191,6 +216,14 @@ HEADERS += thttpheader.h
 SOURCES += thttpheader.cpp
 HEADERS += turlroute.h
 SOURCES += turlroute.cpp
+HEADERS += trequestcoalescer.h
+SOURCES += trequestcoalescer.cpp
+HEADERS += tworkerpool.h
+SOURCES += tworkerpool.cpp
+HEADERS += tratelimiter.h
+SOURCES += tratelimiter.cpp
+HEADERS += tprocessspinlock.h
+SOURCES += tprocessspinlock.cpp
 HEADERS += tabstractuser.h
 SOURCES += tabstractuser.cpp
 HEADERS += tformvalidator.h
@@ -215,6 +248,10 @@ HEADERS += \
 
 HEADERS += TSessionStore \
            TSessionStorePlugin \
+           TSessionSharedMemoryStore \
+           TSessionCodec \
+           TMemcached \
+           TRedis \
            TJavaScriptObject \
            TWebApplication \
            TApplicationServer \
@@ -226,8 +263,11 @@ HEADERS += TSessionStore \
            TActionController \
            TActionView \
            TActionMailer \
+           TFragmentCache \
            TSqlDatabasePool \
            TSqlObject \
+           TSqlSchemaCache \
+           TSqlStatementCache \
            TCriteria \
            TCriteriaConverter \
            TDispatcher \
@@ -242,6 +282,8 @@ HEADERS += TSessionStore \
            TViewHelper \
            TPrototypeAjaxHelper \
            TSqlORMapper \
+           TSqlORMapperCursor \
+           TSqlKeyset \
            TLog \
            TLogger \
            TLoggerPlugin \
@@ -22,6 +22,9 @@
 #include "thttpsocket.h"
 #include "tsessionmanager.h"
 #include "turlroute.h"
+#include "trequestcoalescer.h"
+#include "tworkerpool.h"
+#include "tratelimiter.h"
 #include "taccesslog.h"
 #ifdef Q_OS_UNIX
 # include "tfcore_unix.h"
@@ -41,7 +44,8 @@
 
 
 TActionContext::TActionContext(int socket)
-    : sqlDatabases(Tf::app()->databaseSettingsCount() + 1), stopped(false), socketDesc(socket), httpSocket(0), currController(0)
+    : sqlDatabases(Tf::app()->databaseSettingsCount() + 1), replicaDatabases(Tf::app()->databaseSettingsCount()),
+      writtenDatabases(Tf::app()->databaseSettingsCount(), false), stopped(false), socketDesc(socket), httpSocket(0), currController(0)
 { }
 
 
@@ -66,7 +70,24 @@ TActionContext::~TActionContext()
 }
 
 
+/*!
+  Returns the database connection of the ID \a id. The transaction
+  begins at the first call in the action, if transactions are enabled;
+  the same as getWritableDatabase().
+  \sa getPrimaryDatabase()
+*/
 QSqlDatabase &TActionContext::getDatabase(int id)
+{
+    return getWritableDatabase(id);
+}
+
+/*!
+  Returns the database connection of the ID \a id without beginning a
+  transaction, so that the statements run in autocommit mode unless a
+  transaction has already begun.
+  \sa getWritableDatabase()
+*/
+QSqlDatabase &TActionContext::getPrimaryDatabase(int id)
 {
     T_TRACEFUNC("id:%d", id);
 
@@ -76,11 +97,64 @@ QSqlDatabase &TActionContext::getDatabase(int id)
     QSqlDatabase &db = sqlDatabases[id];
     if (!db.isValid()) {
         db = TSqlDatabasePool::instance()->pop(id);
-        beginTransaction(db);
     }
     return db;
 }
 
+/*!
+  Returns the database connection of the ID \a id for writing. The
+  transaction begins at the first call in the action, if transactions
+  are enabled.
+  \sa getPrimaryDatabase()
+*/
+QSqlDatabase &TActionContext::getWritableDatabase(int id)
+{
+    T_TRACEFUNC("id:%d", id);
+
+    QSqlDatabase &db = getPrimaryDatabase(id);
+    if (db.isValid()) {
+        writtenDatabases[id] = true;
+        if (!transactions.isActive(id)) {
+            beginTransaction(db);
+        }
+    }
+    return db;
+}
+
+/*!
+  Returns the database connection of the ID \a id for SELECT statements.
+  If the database has read replicas, returns a connection to one of
+  them; once the action has written the database, returns the primary
+  for the rest of the request to read its own writes.
+  \sa TSqlDatabasePool::popReplica()
+*/
+QSqlDatabase &TActionContext::getReadDatabase(int id)
+{
+    T_TRACEFUNC("id:%d", id);
+
+    if (id < 0 || id >= replicaDatabases.count() || writtenDatabases[id]
+        || !TSqlDatabasePool::instance()->hasReplicas(id))
+        return getPrimaryDatabase(id);
+
+    QSqlDatabase &db = replicaDatabases[id];
+    if (!db.isValid()) {
+        db = TSqlDatabasePool::instance()->popReplica(id);
+        if (!db.isValid())
+            return getPrimaryDatabase(id);  // no replica available
+    }
+    return db;
+}
+
+
+/*!
+  Returns true if the transaction of the action is in progress on the
+  primary connection of the ID \a id; otherwise returns false.
+*/
+bool TActionContext::isTransactionActive(int id) const
+{
+    return transactions.isActive(id);
+}
+
 
 void TActionContext::releaseDatabases()
 {
@@ -89,6 +163,11 @@ void TActionContext::releaseDatabases()
     for (int i = 0; i < sqlDatabases.count(); ++i) {
         TSqlDatabasePool::instance()->push(sqlDatabases[i]);
     }
+
+    for (int i = 0; i < replicaDatabases.count(); ++i) {
+        TSqlDatabasePool::instance()->push(replicaDatabases[i]);
+        writtenDatabases[i] = false;
+    }
 }
 
 
@@ -97,6 +176,8 @@ void TActionContext::execute()
     T_TRACEFUNC();
     TAccessLog accessLog;
     THttpResponseHeader responseHeader;
+    TRequestCoalescer::Flight *flight = 0;
+    TWorkerPool *workerPool = 0;
 
     try {
         httpSocket = new THttpSocket;
@@ -181,14 +262,58 @@ void TActionContext::execute()
         // Call controller method
         TDispatcher<TActionController> ctlrDispatcher(rt.controller);
         currController = ctlrDispatcher.object();
+        bool responded = false;
+
         if (currController) {
             currController->setActionName(rt.action);
             currController->setHttpRequest(httpRequest);
-            
+
+            // Rate limiting
+            TRateLimiter *rateLimiter = TRateLimiter::instance();
+            int retryAfter = 1;
+            if (rateLimiter && !rateLimiter->allow(rateLimiter->key(httpRequest, httpSocket->peerAddress()), &retryAfter)) {
+                QByteArray body = rateLimiter->rejectionBody();
+                QBuffer buf(&body);
+                responseHeader.setRawHeader("Retry-After", QByteArray::number(retryAfter));
+                accessLog.responseBytes = writeResponse(Tf::TooManyRequests, responseHeader, "text/html", &buf, body.length());
+                accessLog.statusCode = Tf::TooManyRequests;
+                responded = true;
+            }
+
+            // Request coalescing
+            if (!responded && (method == Tf::Get || method == Tf::Head) && currController->requestCoalescingEnabled()) {
+                TRequestCoalescer &coalescer = TRequestCoalescer::instance();
+                bool leader;
+                flight = coalescer.join(coalescer.key(httpRequest), leader);
+
+                if (!leader) {
+                    QByteArray body;
+                    responded = coalescer.wait(flight, responseHeader, body);
+                    flight = 0;
+
+                    if (responded) {
+                        tSystemDebug("Coalesced request: %s", firstLine.data());
+                        QBuffer buf(&body);
+                        accessLog.statusCode = responseHeader.statusCode();
+                        accessLog.responseBytes = writeResponse(responseHeader, &buf, body.length());
+                    }
+                }
+            }
+        }
+
+        if (currController && !responded) {
+            // Worker pool
+            workerPool = TWorkerPool::pool(currController->workerPoolName());
+            if (workerPool && !workerPool->acquire()) {
+                workerPool = 0;
+                throw ClientErrorException(Tf::ServiceUnavailable);
+            }
+
             // Session
+            QByteArray sessionId;
             if (currController->sessionEnabled()) {
                 TSession session;
-                QByteArray sessionId = httpRequest.cookie(TSession::sessionName());
+                sessionId = httpRequest.cookie(TSession::sessionName());
                 if (!sessionId.isEmpty()) {
                     // Finds a session
                     session = TSessionManager::instance().findSession(sessionId);
@@ -223,6 +348,7 @@ void TActionContext::execute()
 
             // Database Transaction
             transactions.setEnabled(currController->transactionEnabled());
+            transactions.setReadOnly(currController->readOnlyActions().contains(rt.action));
             
             // Do filters
             if (currController->preFilter()) {
@@ -234,6 +360,11 @@ void TActionContext::execute()
                     
                     // Post fileter
                     currController->postFilter();
+
+                    // Entity tag
+                    if (currController->eTagEnabled()) {
+                        currController->setETagAutomatically();
+                    }
                     
                     if (currController->rollbackRequested()) {
                         rollbackTransactions();
@@ -241,11 +372,16 @@ void TActionContext::execute()
                         // Commits a transaction to the database
                         commitTransactions();
                     }
+                    // Writes after this run in autocommit mode
+                    transactions.setEnabled(false);
                     
                     // Session store
-                    if (currController->sessionEnabled()) {
-                        bool stored = TSessionManager::instance().store(currController->session());
-                        if (stored) {
+                    TSession &session = currController->session();
+                    if (currController->sessionEnabled()
+                        && (session.id() != sessionId || session.isModified() || TSessionManager::instance().isTouchRequired(session))) {
+                        bool stored = TSessionManager::instance().store(session);
+                        // Re-sends the cookie only if its value or expiration changes
+                        if (stored && (session.id() != sessionId || TSessionManager::sessionLifeTime() > 0)) {
                             QDateTime expire;
                             if (TSessionManager::sessionLifeTime() > 0) {
                                 expire = QDateTime::currentDateTime().addSecs(TSessionManager::sessionLifeTime());
@@ -253,26 +389,39 @@ void TActionContext::execute()
                             
                             // Sets the path in the session cookie
                             QString cookiePath = Tf::app()->appSettings().value(SESSION_COOKIE_PATH).toString();
-                            currController->addCookie(TSession::sessionName(), currController->session().id(), expire, cookiePath);
+                            currController->addCookie(TSession::sessionName(), session.id(), expire, cookiePath);
                         }
                     }
                 }
             }
             
+            if (workerPool) {
+                workerPool->release();
+                workerPool = 0;
+            }
+
             // Sets the default status code of HTTP response
             accessLog.statusCode = (!currController->response.isBodyNull()) ? currController->statusCode() : Tf::InternalServerError;
             currController->response.header().setStatusLine(accessLog.statusCode, THttpUtility::getResponseReasonPhrase(accessLog.statusCode));
 
+            // Shares the response with the coalesced requests
+            if (flight) {
+                QBuffer *buffer = qobject_cast<QBuffer *>(currController->response.bodyIODevice());
+                if (buffer && accessLog.statusCode < Tf::InternalServerError) {
+                    TRequestCoalescer::instance().finish(flight, currController->response.header(), buffer->data());
+                } else {
+                    TRequestCoalescer::instance().abandon(flight);
+                }
+                flight = 0;
+            }
+
             // Writes a response and access log
             accessLog.responseBytes = writeResponse(currController->response.header(), currController->response.bodyIODevice(),
                                                     currController->response.bodyLength());
             
             httpSocket->disconnectFromHost();
-
-            // Session GC
-            TSessionManager::instance().collectGarbage();
         
-        } else {
+        } else if (!currController) {
             accessLog.statusCode = Tf::BadRequest;
 
             if (method == Tf::Get) {  // GET Method
@@ -325,6 +474,15 @@ void TActionContext::execute()
         tError("Caught Exception");
     }
 
+    if (workerPool) {
+        workerPool->release();
+    }
+
+    // Lets the waiting requests process by themselves
+    if (flight) {
+        TRequestCoalescer::instance().abandon(flight);
+    }
+
     accessLog.timestamp = QDateTime::currentDateTime();
     writeAccessLog(accessLog);  // Writes access log
 
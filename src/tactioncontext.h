@@ -23,6 +23,10 @@ public:
     virtual ~TActionContext();
 
     QSqlDatabase &getDatabase(int id);
+    QSqlDatabase &getPrimaryDatabase(int id);
+    QSqlDatabase &getWritableDatabase(int id);
+    QSqlDatabase &getReadDatabase(int id);
+    bool isTransactionActive(int id) const;
     void releaseDatabases();
     TTemporaryFile &createTemporaryFile();
     void stop() { stopped = true; }
@@ -43,6 +47,8 @@ protected:
     qint64 writeResponse(THttpResponseHeader &header, QIODevice *body, qint64 length);
 
     QVector<QSqlDatabase> sqlDatabases;
+    QVector<QSqlDatabase> replicaDatabases;
+    QVector<bool> writtenDatabases;
     TSqlTransaction transactions;
     volatile bool stopped;
 
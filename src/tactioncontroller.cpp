@@ -11,6 +11,7 @@
 #include <QMetaMethod>
 #include <QTextCodec>
 #include <QCryptographicHash>
+#include <QBuffer>
 #include <TActionController>
 #include <TWebApplication>
 #include <TDispatcher>
@@ -19,6 +20,7 @@
 #include <TAbstractUser>
 #include <TActionContext>
 #include <TFormValidator>
+#include <THttpUtility>
 #include "tsessionmanager.h"
 #include "ttextview.h"
 
@@ -239,7 +241,10 @@ void TActionController::setCsrfProtectionInto(TSession &session)
 {
     if (Tf::app()->appSettings().value(STORE_TYPE).toString().toLower() == QLatin1String("cookie")) {
         QString key = Tf::app()->appSettings().value(CSRF_PROTECTION_KEY).toString();
-        session.insert(key, TSessionManager::instance().generateId());  // it's just a random value
+        if (!session.contains(key)) {
+            // Kept while the session lives, not to modify it each time
+            session.insert(key, TSessionManager::instance().generateId());  // it's just a random value
+        }
     }
 }
 
@@ -463,6 +468,113 @@ bool TActionController::renderErrorResponse(int statusCode)
     return ret;
 }
 
+/*!
+  \~english
+  Sets the entity tag \a eTag to the response, and renders the
+  "304 Not Modified" response with no body if the tag matches the
+  If-None-Match header of the request. Returns true if it rendered
+  the response; otherwise returns false and the action must render
+  the content as usual. For a method other than GET and HEAD, the
+  matching tag renders "412 Precondition Failed" instead. The tag is
+  quoted unless given as "xyz" or W/"xyz".
+
+  Calling this function before fetching data allows skipping the
+  rendering entirely, e.g. for a tag derived from the latest
+  updated_at of the records.
+
+  \~japanese
+  エンティティタグ \a eTag をレスポンスに設定し、リクエストの
+  If-None-Match ヘッダと一致する場合はボディのない
+  "304 Not Modified" (GET と HEAD 以外では "412 Precondition Failed")
+  を描画する。描画した場合は true を返し、
+  そうでない場合は false を返す
+  \~
+  \sa eTagEnabled()
+*/
+bool TActionController::renderIfNotModified(const QByteArray &eTag)
+{
+    if (rendered) {
+        tWarn("Has rendered already: %s", qPrintable(className() + '#' + activeAction()));
+        return false;
+    }
+
+    if (eTag.isEmpty())
+        return false;
+
+    QByteArray tag = THttpUtility::toEntityTag(eTag);
+    response.header().setRawHeader("ETag", tag);
+
+    if (!eTagMatches(tag))
+        return false;
+
+    // The other methods fail the precondition, not to be skipped
+    Tf::HttpMethod method = request.method();
+    rendered = true;
+    setStatusCode((method == Tf::Get || method == Tf::Head) ? Tf::NotModified : Tf::PreconditionFailed);
+    response.setBody("");
+    return true;
+}
+
+/*!
+  \~english
+  Generates a weak entity tag from the rendered body, and replaces the
+  response with "304 Not Modified" if the tag matches the If-None-Match
+  header. Internal use.
+
+  \~japanese
+  描画されたボディから弱いエンティティタグを生成する。内部使用
+*/
+void TActionController::setETagAutomatically()
+{
+    Tf::HttpMethod method = request.method();
+    if ((method != Tf::Get && method != Tf::Head) || statCode != Tf::OK)
+        return;
+
+    if (!response.header().rawHeader("ETag").isEmpty()) {
+        if (eTagMatches(response.header().rawHeader("ETag"))) {
+            setStatusCode(Tf::NotModified);
+            response.setBody("");
+        }
+        return;
+    }
+
+    // Files are not hashed
+    QBuffer *buffer = qobject_cast<QBuffer *>(response.bodyIODevice());
+    if (!buffer)
+        return;
+
+    // 64-bit FNV-1a hash
+    const QByteArray &body = buffer->data();
+    quint64 hash = Q_UINT64_C(14695981039346656037);
+    for (const char *p = body.constData(), *end = p + body.size(); p < end; ++p) {
+        hash ^= (uchar)*p;
+        hash *= Q_UINT64_C(1099511628211);
+    }
+
+    QByteArray tag = "W/\"" + QByteArray::number(hash, 16) + '"';
+    response.header().setRawHeader("ETag", tag);
+
+    if (eTagMatches(tag)) {
+        setStatusCode(Tf::NotModified);
+        response.setBody("");
+    }
+}
+
+/*!
+  \~english
+  Returns true if the entity tag \a eTag matches the If-None-Match
+  header of the request, using the weak comparison; otherwise returns
+  false. Internal use.
+
+  \~japanese
+  エンティティタグ \a eTag がリクエストの If-None-Match ヘッダと一致
+  する場合は true を返す。内部使用
+*/
+bool TActionController::eTagMatches(const QByteArray &eTag) const
+{
+    return THttpUtility::entityTagMatches(eTag, request.header().rawHeader("If-None-Match"));
+}
+
 /*!
   \~english
   Returns the layout class name. Internal use.
@@ -764,6 +876,59 @@ void TActionController::setFlashValidationErrors(const TFormValidator &v, const
   Must be overridden by subclasses to disable transaction mechanism.
   The function must return \a false to disable the mechanism. This function
   returns \a true.
+
+  A transaction begins at the first write to the database in the action,
+  so that actions only reading run in autocommit mode. The connection
+  returned by TActionContext::getDatabase() begins the transaction too.
+  \sa readOnlyActions()
+*/
+
+/*!
+  \fn virtual QStringList TActionController::readOnlyActions() const;
+
+  Must be overridden by subclasses to return a string list of actions
+  declared read-only. The transactions of the actions are begun as
+  READ ONLY on PostgreSQL and MySQL, so that the database rejects
+  writes.
+  \sa transactionEnabled()
+*/
+
+/*!
+  \fn virtual bool TActionController::eTagEnabled() const;
+
+  Must be overridden by subclasses to enable automatic generation of
+  entity tags. If the function returns \a true, a weak ETag header is
+  generated by hashing the body of a successful response to GET or HEAD,
+  and "304 Not Modified" is returned when the If-None-Match header of
+  the request matches it. The function can check activeAction() to
+  enable it for particular actions. This function returns \a false.
+  \sa renderIfNotModified()
+*/
+
+/*!
+  \fn virtual bool TActionController::requestCoalescingEnabled() const;
+
+  Must be overridden by subclasses to enable request coalescing. If the
+  function returns \a true, identical GET or HEAD requests processed
+  concurrently run the action only once, and the other requests receive
+  a copy of its response except Set-Cookie headers. Requests are
+  identical if the paths, the queries and the headers specified by the
+  RequestCoalescing.KeyHeaders setting are the same, so enable it only
+  for actions whose responses don't depend on the session. The function
+  can check activeAction() to enable it for particular actions. This
+  function returns \a false.
+*/
+
+/*!
+  \fn virtual QString TActionController::workerPoolName() const;
+
+  Must be overridden by subclasses to run actions in a worker pool
+  configured by the WorkerPool.<name>.* settings. The number of actions
+  running concurrently in the pool is limited, so slow actions, such as
+  reports, can't occupy all the server threads. If the queue of the pool
+  is full, "503 Service Unavailable" is returned. The function can check
+  activeAction() to assign particular actions. This function returns an
+  empty string, which means no pool.
 */
 
 /*!
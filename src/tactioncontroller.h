@@ -35,6 +35,10 @@ public:
     virtual bool csrfProtectionEnabled() const { return true; }
     virtual QStringList exceptionActionsOfCsrfProtection() const { return QStringList(); }
     virtual bool transactionEnabled() const { return true; }
+    virtual QStringList readOnlyActions() const { return QStringList(); }
+    virtual bool eTagEnabled() const { return false; }
+    virtual bool requestCoalescingEnabled() const { return false; }
+    virtual QString workerPoolName() const { return QString(); }
     QByteArray authenticityToken() const;
     QString flash(const QString &name) const;
     QHostAddress clientAddress() const;
@@ -64,6 +68,7 @@ protected:
     bool renderTemplate(const QString &templateName, const QString &layout = QString());
     bool renderText(const QString &text, bool layoutEnable = false, const QString &layout = QString());
     bool renderErrorResponse(int statusCode);
+    bool renderIfNotModified(const QByteArray &eTag);
     void redirect(const QUrl &url, int statusCode = Tf::Found);
     bool sendFile(const QString &filePath, const QByteArray &contentType, const QString &name = QString(), bool autoRemove = false);
     bool sendData(const QByteArray &data, const QByteArray &contentType, const QString &name = QString());
@@ -83,6 +88,8 @@ private:
     bool verifyRequest(const THttpRequest &request) const;
     QByteArray renderView(TActionView *view);
     void exportAllFlashVariants();
+    void setETagAutomatically();
+    bool eTagMatches(const QByteArray &eTag) const;
     const TActionController *controller() const { return this; }
     bool rollbackRequested() const { return rollback; }
     static QString layoutClassName(const QString &layout);
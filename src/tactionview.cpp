@@ -8,6 +8,7 @@
 #include <TActionView>
 #include <THttpUtility>
 #include <THtmlAttribute>
+#include <TFragmentCache>
 
 /*!
   \class TActionView
@@ -43,6 +44,27 @@ QString TActionView::renderPartial(const QString &templateName, const QVariantHa
     return (actionController) ? actionController->getRenderingData(temp, vars) : QString(); 
 }
 
+/*!
+  Render the partial template given by \a templateName like renderPartial(),
+  caching the result with the key \a cacheKey for \a lifeTime seconds.
+  The cached fragment is returned as long as it is valid, skipping the
+  rendering. The key should identify everything the fragment depends on,
+  such as a record ID and its revision. If \a lifeTime is negative, the
+  default lifetime of the fragment cache is used.
+  \sa TFragmentCache
+*/
+QString TActionView::renderPartialCache(const QString &templateName, const QString &cacheKey, const QVariantHash &vars, int lifeTime) const
+{
+    TFragmentCache &cache = TFragmentCache::instance();
+    QString fragment;
+
+    if (!cache.find(templateName, cacheKey, fragment)) {
+        fragment = renderPartial(templateName, vars);
+        cache.insert(templateName, cacheKey, fragment, lifeTime);
+    }
+    return fragment;
+}
+
 /*!
   Returns a authenticity token for CSRF protection.
 */
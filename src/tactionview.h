@@ -22,6 +22,7 @@ public:
     virtual QString toString() = 0;
     QString yield() const;
     QString renderPartial(const QString &templateName, const QVariantHash &vars = QVariantHash()) const;
+    QString renderPartialCache(const QString &templateName, const QString &cacheKey, const QVariantHash &vars = QVariantHash(), int lifeTime = -1) const;
     QString authenticityToken() const;
     QVariant variant(const QString &name) const;
     bool hasVariant(const QString &name) const;
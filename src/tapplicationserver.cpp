@@ -7,14 +7,25 @@
 
 #include <QLibrary>
 #include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QTimerEvent>
 #include <TApplicationServer>
 #include <TWebApplication>
 #include <TActionThread>
 #include <TActionForkProcess>
 #include <TSqlDatabasePool>
+#include <TSqlSchemaCache>
 #include <TDispatcher>
 #include <TActionController>
 #include "turlroute.h"
+#include "tworkerpool.h"
+#include "tratelimiter.h"
+#include <TSessionSharedMemoryStore>
+#include "tsessionmemorystore.h"
+#include "tsessionstorefactory.h"
+#include "tsessionmanager.h"
 #include "tsystemglobal.h"
 
 
@@ -54,6 +65,32 @@ protected:
     }
 };
 
+class TSessionGcProcess : public TActionForkProcess
+{
+public:
+    TSessionGcProcess() : TActionForkProcess(0) { transactions.setEnabled(false); }
+
+    void start()
+    {
+        currentActionContext = this;
+        TSessionManager::instance().collectGarbage();
+        currentActionContext = 0;
+    }
+};
+
+
+class TSessionGcThread : public TActionThread
+{
+public:
+    TSessionGcThread() : TActionThread(0) { transactions.setEnabled(false); }
+protected:
+    void run()
+    {
+        TSessionManager::instance().collectGarbage();
+        releaseDatabases();  // not to keep the connection until deleted
+    }
+};
+
 /*!
   \class TApplicationServer
   \brief The TApplicationServer class provides functionality common to
@@ -62,9 +99,12 @@ protected:
 
 static bool libLoaded = false;
 
+#define GC_STAMP_FILE              "sessiongc"
+#define PREFORK_GC_CHECK_INTERVAL  1000  // msecs
+
 
 TApplicationServer::TApplicationServer(QObject *parent)
-    : QTcpServer(parent)
+    : QTcpServer(parent), gcThread(0)
 {
     nativeSocketInit();
     
@@ -75,6 +115,10 @@ TApplicationServer::TApplicationServer(QObject *parent)
 
 TApplicationServer::~TApplicationServer()
 {
+    if (gcThread) {
+        gcThread->wait();
+        delete gcThread;
+    }
     nativeSocketCleanup();
 }
 
@@ -136,6 +180,22 @@ bool TApplicationServer::open()
 
     TUrlRoute::instantiate();
     TSqlDatabasePool::instantiate();
+    TSqlSchemaCache::instantiate();
+    TWorkerPool::instantiate();
+    TRateLimiter::instantiate();
+    TSessionStoreFactory::instantiate();
+    TSessionMemoryStore::instantiate();
+    TSessionSharedMemoryStore::instantiate();
+
+    // Session GC in the background
+    int gcInterval = TSessionManager::gcInterval();
+    if (gcInterval > 0 && !gcTimer.isActive()) {
+        if (Tf::app()->multiProcessingModule() == TWebApplication::Prefork) {
+            gcTimer.start(PREFORK_GC_CHECK_INTERVAL, this);
+        } else {
+            gcTimer.start(gcInterval * 1000, this);
+        }
+    }
     
     switch (Tf::app()->multiProcessingModule()) {
     case TWebApplication::Thread: {
@@ -175,6 +235,10 @@ void TApplicationServer::close()
 void TApplicationServer::terminate()
 {
     close();
+    gcTimer.stop();
+    if (gcThread) {
+        gcThread->wait();
+    }
   
     if (actionContextCount() > 0) {
         setMutex.lock();
@@ -248,3 +312,57 @@ int TApplicationServer::actionContextCount() const
     QMutexLocker locker(&setMutex);
     return actionContexts.count();
 }
+
+
+void TApplicationServer::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() == gcTimer.timerId()) {
+        collectSessionGarbage();
+    } else {
+        QTcpServer::timerEvent(event);
+    }
+}
+
+/*!
+  Starts the session garbage collection off the request path. In the
+  thread MPM it runs in a thread of its own. In the prefork MPM, one of
+  the idle server processes runs it once per Session.GcInterval seconds,
+  arranged by the modification time of a stamp file.
+*/
+void TApplicationServer::collectSessionGarbage()
+{
+    switch (Tf::app()->multiProcessingModule()) {
+    case TWebApplication::Thread:
+        if (gcThread) {
+            if (gcThread->isRunning())
+                break;
+            delete gcThread;
+        }
+        gcThread = new TSessionGcThread();
+        gcThread->start(QThread::LowPriority);
+        break;
+
+    case TWebApplication::Prefork: {
+        if (!isListening())
+            break;  // processing a request
+
+        QString stamp = Tf::app()->tmpPath() + QLatin1String(GC_STAMP_FILE);
+        QFileInfo fi(stamp);
+        if (fi.exists() && fi.lastModified().secsTo(QDateTime::currentDateTime()) < TSessionManager::gcInterval())
+            break;
+
+        // Two processes running it at the same time do no harm
+        QFile file(stamp);
+        if (file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            file.write(QByteArray::number(QCoreApplication::applicationPid()));
+            file.close();
+
+            TSessionGcProcess process;
+            process.start();
+        }
+        break; }
+
+    default:
+        break;
+    }
+}
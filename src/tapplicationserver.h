@@ -4,9 +4,11 @@
 #include <QTcpServer>
 #include <QSet>
 #include <QMutex>
+#include <QBasicTimer>
 #include <TGlobal>
 
 class TActionContext;
+class TActionThread;
 
 
 class T_CORE_EXPORT TApplicationServer : public QTcpServer
@@ -38,6 +40,8 @@ protected:
     virtual void incomingConnection(int socketDescriptor);
     void insertPointer(TActionContext *p);
     int actionContextCount() const;
+    void timerEvent(QTimerEvent *event);
+    void collectSessionGarbage();
 
 protected slots:
     void deleteActionContext();
@@ -46,6 +50,8 @@ private:
     int maxServers;
     QSet<TActionContext *> actionContexts;
     mutable QMutex setMutex;
+    QBasicTimer gcTimer;
+    TActionThread *gcThread;
 
     Q_DISABLE_COPY(TApplicationServer)
 };
@@ -0,0 +1,90 @@
+#ifndef TCLIENTPOOL_H
+#define TCLIENTPOOL_H
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QStack>
+#include <QThread>
+#include <QThreadStorage>
+#include <TGlobal>
+
+/*!
+  \class TClientPool
+  \brief The TClientPool class keeps the clients of a server, such as
+  TMemcached and TRedis, with their connections open across threads.
+
+  local() checks out a client for the current thread, which is given
+  back to the pool when the thread exits, so the next thread reuses its
+  connections; in the thread MPM a thread serves one connection, in the
+  prefork MPM the client stays with the process. The class T must have
+  moveToThread() that moves its sockets. Internal use.
+*/
+
+template <class T>
+class TClientPool
+{
+public:
+    TClientPool() { }
+    T &local();
+
+private:
+    class Holder
+    {
+    public:
+        Holder(TClientPool<T> *p, T *c) : pool(p), client(c) { }
+        ~Holder() { pool->release(client); }  // at the thread exit
+
+        TClientPool<T> *pool;
+        T *client;
+    };
+
+    T *acquire();
+    void release(T *client);
+
+    QMutex mutex;
+    QStack<T *> idle;
+    QThreadStorage<Holder *> holders;
+
+    Q_DISABLE_COPY(TClientPool)
+};
+
+
+template <class T>
+inline T &TClientPool<T>::local()
+{
+    if (!holders.hasLocalData()) {
+        holders.setLocalData(new Holder(this, acquire()));
+    }
+    return *holders.localData()->client;
+}
+
+
+template <class T>
+inline T *TClientPool<T>::acquire()
+{
+    T *client = 0;
+    {
+        QMutexLocker locker(&mutex);
+        if (!idle.isEmpty()) {
+            client = idle.pop();  // most recently used
+        }
+    }
+
+    if (client) {
+        client->moveToThread(QThread::currentThread());  // from no thread
+    } else {
+        client = new T();
+    }
+    return client;
+}
+
+
+template <class T>
+inline void TClientPool<T>::release(T *client)
+{
+    client->moveToThread(0);  // can be pulled by any thread
+    QMutexLocker locker(&mutex);
+    idle.push(client);
+}
+
+#endif // TCLIENTPOOL_H
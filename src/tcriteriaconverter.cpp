@@ -7,17 +7,23 @@
 
 #include <TCriteriaConverter>
 #include <QMutexLocker>
+#include <QReadWriteLock>
+
+#define MAX_FRAGMENT_COUNT  4096
 
 /*!
  * \class TCriteriaConverter<>
  * \brief The TCriteriaConverter class is a template class that converts
- * TCriteria objects to SQL strings.
+ * TCriteria objects to SQL strings, with the values formatted as literals
+ * or bound to placeholders.
  * This class is for internal use only.
  * \sa TCriteria
  */
 
 static QHash<int, QString> formatVector;
 static QMutex mutex;
+static QHash<QString, QString> fragmentCache;
+static QReadWriteLock fragmentLock;
 
 
 const QHash<int, QString> &TCriteriaData::formats()
@@ -50,3 +56,249 @@ const QHash<int, QString> &TCriteriaData::formats()
     }
     return formatVector;
 } 
+
+
+static QString placeholders(int count)
+{
+    QString str;
+    str.reserve(count * 2);
+    for (int i = 0; i < count; ++i) {
+        str.append(QLatin1String("?,"));
+    }
+    str.chop(1);
+    return str;
+}
+
+/*!
+  Returns the SQL string of this criteria with placeholders for the
+  property \a name, and appends the values to be bound to \a values and
+  the shape of this criteria to \a shape. If \a name is null, the
+  string isn't built. If \a arrayBinding is true, the list of IN or ANY
+  is bound as one array of PostgreSQL. Returns an empty string without
+  appending anything if this criteria is invalid.
+*/
+QString TCriteriaData::toBoundString(const QString &name, bool arrayBinding, QList<QVariant> &values, QString &shape) const
+{
+    enum Form {
+        Single,
+        Pair,
+        List,
+        Array,
+        AnyAll,
+        NoValue,
+    };
+
+    Form form;
+    QList<QVariant> vals;
+
+    if (op1 != TSql::Invalid && op2 != TSql::Invalid && !val1.isNull()) {
+        if (op2 != TSql::Any && op2 != TSql::All) {
+            tWarn("Invalid parameters  [%s:%d]", __FILE__, __LINE__);
+            return QString();
+        }
+
+        vals = val1.toList();
+        if (vals.isEmpty()) {
+            tWarn("error parameter");
+            return QString();
+        }
+        if (arrayBinding) {
+            vals = QList<QVariant>() << arrayLiteral(vals);
+        }
+        form = AnyAll;
+
+    } else if (op1 != TSql::Invalid && !val1.isNull() && !val2.isNull()) {
+        switch (op1) {
+        case TSql::LikeEscape:
+        case TSql::NotLikeEscape:
+        case TSql::ILikeEscape:
+        case TSql::NotILikeEscape:
+        case TSql::Between:
+        case TSql::NotBetween:
+            vals << val1 << val2;
+            form = Pair;
+            break;
+
+        default:
+            tWarn("Invalid parameters  [%s:%d]", __FILE__, __LINE__);
+            return QString();
+        }
+
+    } else if (op1 != TSql::Invalid) {
+        switch (op1) {
+        case TSql::Equal:
+        case TSql::NotEqual:
+        case TSql::LessThan:
+        case TSql::GreaterThan:
+        case TSql::LessEqual:
+        case TSql::GreaterEqual:
+        case TSql::Like:
+        case TSql::NotLike:
+        case TSql::ILike:
+        case TSql::NotILike:
+            vals << val1;
+            form = Single;
+            break;
+
+        case TSql::In:
+        case TSql::NotIn:
+            vals = val1.toList();
+            if (vals.isEmpty()) {
+                tWarn("error parameter");
+                return QString();
+            }
+            if (arrayBinding) {
+                vals = QList<QVariant>() << arrayLiteral(vals);
+                form = Array;
+            } else {
+                form = List;
+            }
+            break;
+
+        case TSql::LikeEscape:
+        case TSql::NotLikeEscape:
+        case TSql::ILikeEscape:
+        case TSql::NotILikeEscape:
+        case TSql::Between:
+        case TSql::NotBetween:
+            vals = val1.toList();
+            if (vals.count() != 2)
+                return QString();
+            form = Pair;
+            break;
+
+        case TSql::IsNull:
+        case TSql::IsNotNull:
+            form = NoValue;
+            break;
+
+        default:
+            tWarn("error parameter");
+            return QString();
+        }
+
+    } else {
+        tSystemError("Logic error: [%s:%d]", __FILE__, __LINE__);
+        return QString();
+    }
+
+    shape += QString::number(property) + QLatin1Char('.') + QString::number(op1) + QLatin1Char('.')
+        + QString::number(op2) + QLatin1Char('.') + QString::number(vals.count()) + QLatin1Char(';');
+    values << vals;
+
+    if (name.isNull())
+        return QString();
+
+    const QHash<int, QString> &fmt = formats();
+    switch (form) {
+    case Single:
+        return name + fmt.value(op1).arg(QLatin1String("?"));
+
+    case Pair:
+        return QLatin1Char('(') + name + fmt.value(op1).arg(QLatin1String("?"), QLatin1String("?")) + QLatin1Char(')');
+
+    case List:
+        return name + fmt.value(op1).arg(placeholders(vals.count()));
+
+    case Array:
+        return name + ((op1 == TSql::In) ? QLatin1String("=ANY (?)") : QLatin1String("<>ALL (?)"));
+
+    case AnyAll:
+        return name + fmt.value(op1).arg(fmt.value(op2).arg(placeholders(vals.count())));
+
+    default:
+        return name + fmt.value(op1);
+    }
+}
+
+/*!
+  Returns the array literal of PostgreSQL for the values \a list. The
+  dates and times are written in ISO 8601, and the byte arrays in the
+  hex format of bytea.
+*/
+QString TCriteriaData::arrayLiteral(const QList<QVariant> &list)
+{
+    QString str(QLatin1Char('{'));
+    for (QListIterator<QVariant> it(list); it.hasNext(); ) {
+        const QVariant &v = it.next();
+        if (v.isNull()) {
+            str.append(QLatin1String("NULL"));
+        } else {
+            QString s;
+            switch (v.type()) {
+            case QVariant::DateTime:
+                s = v.toDateTime().toString(QLatin1String("yyyy-MM-dd'T'hh:mm:ss.zzz"));
+                if (v.toDateTime().timeSpec() == Qt::UTC) {
+                    s += QLatin1Char('Z');
+                }
+                break;
+            case QVariant::Date:
+                s = v.toDate().toString(Qt::ISODate);
+                break;
+            case QVariant::Time:
+                s = v.toTime().toString(QLatin1String("hh:mm:ss.zzz"));
+                break;
+            case QVariant::ByteArray:
+                s = QLatin1String("\\x") + QString::fromLatin1(v.toByteArray().toHex());  // bytea
+                break;
+            default:
+                s = v.toString();
+                break;
+            }
+            s.replace(QLatin1Char('\\'), QLatin1String("\\\\"));
+            s.replace(QLatin1Char('"'), QLatin1String("\\\""));
+            str.append(QLatin1Char('"')).append(s).append(QLatin1Char('"'));
+        }
+        str.append(QLatin1Char(','));
+    }
+    if (str.length() > 1) {
+        str.chop(1);
+    }
+    str.append(QLatin1Char('}'));
+    return str;
+}
+
+/*!
+  Returns the maximum number of the values bound to a WHERE clause for
+  the driver \a driverName, with room for the other values of the
+  statement; SQLite accepts 999 variables in a statement.
+*/
+int TCriteriaData::maxBoundValues(const QString &driverName)
+{
+    QString driver = driverName.toUpper();
+    if (driver.startsWith(QLatin1String("QSQLITE"))) {
+        return 500;
+    } else if (driver.startsWith(QLatin1String("QMYSQL"))) {
+        return 10000;
+    }
+    return 1000;
+}
+
+/*!
+  \class TCriteriaFragmentCache
+  \brief The TCriteriaFragmentCache class caches the WHERE clauses
+  compiled from criteria, keyed by the class, the driver and the shape
+  of the criteria.
+  This class is for internal use only.
+*/
+
+/*!
+  Returns the clause of the key \a key, or a null string if not cached.
+*/
+QString TCriteriaFragmentCache::value(const QString &key)
+{
+    QReadLocker locker(&fragmentLock);
+    return fragmentCache.value(key);
+}
+
+/*!
+  Caches the clause \a fragment with the key \a key.
+*/
+void TCriteriaFragmentCache::insert(const QString &key, const QString &fragment)
+{
+    QWriteLocker locker(&fragmentLock);
+    if (fragmentCache.count() >= MAX_FRAGMENT_COUNT) {
+        fragmentCache.clear();  // e.g. lists of various lengths
+    }
+    fragmentCache.insert(key, (fragment.isNull()) ? QString(QLatin1String("")) : fragment);
+}
@@ -24,7 +24,10 @@ public:
     TCriteriaData(int property, TSql::ComparisonOperator op, const QVariant &val1, const QVariant &val2);
     TCriteriaData(int property, TSql::ComparisonOperator op1, TSql::ComparisonOperator op2, const QVariant &val);
     bool isEmpty() const;
+    QString toBoundString(const QString &name, bool arrayBinding, QList<QVariant> &values, QString &shape) const;
     static const QHash<int, QString> &formats();
+    static QString arrayLiteral(const QList<QVariant> &list);
+    static int maxBoundValues(const QString &driverName);
 
     int property;
     int op1;
@@ -72,23 +75,33 @@ inline bool TCriteriaData::isEmpty() const
 Q_DECLARE_METATYPE(TCriteriaData)
 
 
+class T_CORE_EXPORT TCriteriaFragmentCache
+{
+public:
+    static QString value(const QString &key);
+    static void insert(const QString &key, const QString &fragment);
+};
+
+
 template <class T>
 class TCriteriaConverter
 {
 public:
     TCriteriaConverter(const TCriteria &cri, const QSqlDatabase &db) : criteria(cri), database(db) { }
     QString toString() const;
+    QString toString(QList<QVariant> &values) const;
     static QString propertyName(int property);
 
 protected:
     static QString criteriaToString(const QVariant &cri, const QSqlDatabase &database);
+    static QString criteriaToBoundString(const QVariant &cri, const QSqlDatabase &database, bool arrayBinding, bool build, QList<QVariant> &values, QString &shape);
     static QString criteriaToString(const QString &propertyName, TSql::ComparisonOperator op, const QVariant &val1, const QVariant &val2, const QSqlDatabase &database);
     static QString criteriaToString(const QString &propertyName, TSql::ComparisonOperator op1, TSql::ComparisonOperator op2, const QVariant &val, const QSqlDatabase &database);
     static QString join(const QString &s1, TCriteria::LogicalOperator op, const QString &s2);
 
 private:
     TCriteria criteria;
-    const QSqlDatabase &database;
+    QSqlDatabase database;
 };
 
 
@@ -151,7 +164,7 @@ inline QString TCriteriaConverter<T>::criteriaToString(const QVariant &var, cons
             case TSql::In:
             case TSql::NotIn: {
                 QString str;
-                QList<QVariant> list;
+                QList<QVariant> list = cri.val1.toList();
                 QListIterator<QVariant> i(list);
                 while (i.hasNext()) {
                     QString s = TSqlQuery::formatValue(i.next(), database);
@@ -200,6 +213,86 @@ inline QString TCriteriaConverter<T>::criteriaToString(const QVariant &var, cons
 }
 
 
+/*!
+  Returns the WHERE clause with placeholders, appending the values to be
+  bound to \a values. The clause is cached for the shape of the
+  criteria, i.e. the properties, the operators and the number of the
+  values, so that the names of the properties are looked up only once.
+  On PostgreSQL, the list of IN or ANY is bound as one array. If the
+  values are more than the driver accepts, returns the clause with the
+  values written as literals instead, without appending them.
+*/
+template <class T>
+inline QString TCriteriaConverter<T>::toString(QList<QVariant> &values) const
+{
+    bool arrayBinding = database.driverName().toUpper().startsWith(QLatin1String("QPSQL"));
+    QList<QVariant> params;
+    QString shape;
+    criteriaToBoundString(QVariant::fromValue(criteria), database, arrayBinding, false, params, shape);
+    if (shape.isEmpty())
+        return QString();
+
+    if (params.count() > TCriteriaData::maxBoundValues(database.driverName())) {
+        return toString();  // e.g. a long list of IN
+    }
+
+    QString key = QLatin1String(T::staticMetaObject.className()) + QLatin1Char(':') + database.driverName()
+        + QLatin1Char(':') + shape;
+    QString where = TCriteriaFragmentCache::value(key);
+    if (where.isNull()) {
+        QList<QVariant> dummy;
+        QString dummyShape;
+        where = criteriaToBoundString(QVariant::fromValue(criteria), database, arrayBinding, true, dummy, dummyShape);
+        TCriteriaFragmentCache::insert(key, where);
+    }
+    values << params;
+    return where;
+}
+
+/*!
+  Walks the criteria \a var, appending the values to be bound to
+  \a values and the shape to \a shape. Returns the clause with
+  placeholders if \a build is true; otherwise returns an empty string.
+*/
+template <class T>
+inline QString TCriteriaConverter<T>::criteriaToBoundString(const QVariant &var, const QSqlDatabase &database, bool arrayBinding, bool build, QList<QVariant> &values, QString &shape)
+{
+    if (var.isNull()) {
+        return QString();
+    }
+
+    if (var.canConvert<TCriteria>()) {
+        TCriteria cri = var.value<TCriteria>();
+        if (cri.isEmpty()) {
+            return QString();
+        }
+
+        shape += QLatin1Char('(');
+        QString s1 = criteriaToBoundString(cri.first(), database, arrayBinding, build, values, shape);
+        shape += QString::number(cri.logicalOperator());
+        QString s2 = criteriaToBoundString(cri.second(), database, arrayBinding, build, values, shape);
+        shape += QLatin1Char(')');
+        return (build) ? join(s1, cri.logicalOperator(), s2) : QString();
+
+    } else if (var.canConvert<TCriteriaData>()) {
+        TCriteriaData cri = var.value<TCriteriaData>();
+        const QMetaObject &metaObject = T::staticMetaObject;
+        if (cri.isEmpty() || metaObject.propertyOffset() + cri.property >= metaObject.propertyCount()) {
+            return QString();
+        }
+
+        QString name;
+        if (build) {
+            name = TSqlQuery::escapeIdentifier(propertyName(cri.property), QSqlDriver::FieldName, database);
+        }
+        return cri.toBoundString(name, arrayBinding, values, shape);
+    }
+
+    tSystemError("Logic error [%s:%d]", __FILE__, __LINE__);
+    return QString();
+}
+
+
 template <class T>
 inline QString TCriteriaConverter<T>::propertyName(int property)
 {
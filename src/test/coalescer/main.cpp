@@ -0,0 +1,152 @@
+#include <QTest>
+#include <QThread>
+#include <QTime>
+#include "trequestcoalescer.h"
+
+
+class Follower : public QThread
+{
+public:
+    Follower(TRequestCoalescer &c, TRequestCoalescer::Flight *f) : coalescer(c), flight(f), result(false) { }
+
+    void run()
+    {
+        result = coalescer.wait(flight, header, body);
+    }
+
+    TRequestCoalescer &coalescer;
+    TRequestCoalescer::Flight *flight;
+    bool result;
+    THttpResponseHeader header;
+    QByteArray body;
+};
+
+
+class TestCoalescer : public QObject
+{
+    Q_OBJECT
+private slots:
+    void join();
+    void finish();
+    void abandon();
+    void timeout();
+    void waitInThread();
+};
+
+
+void TestCoalescer::join()
+{
+    TRequestCoalescer coalescer;
+    bool leader;
+    TRequestCoalescer::Flight *f1 = coalescer.join("GET /foo", leader);
+    QVERIFY(leader);
+    TRequestCoalescer::Flight *f2 = coalescer.join("GET /foo", leader);
+    QVERIFY(!leader);
+    QCOMPARE(f2, f1);
+    TRequestCoalescer::Flight *f3 = coalescer.join("GET /bar", leader);
+    QVERIFY(leader);
+    QVERIFY(f3 != f1);
+
+    coalescer.abandon(f3);
+    coalescer.abandon(f1);
+    THttpResponseHeader header;
+    QByteArray body;
+    QVERIFY(!coalescer.wait(f2, header, body));
+
+    // A new flight after the end
+    f1 = coalescer.join("GET /foo", leader);
+    QVERIFY(leader);
+    coalescer.abandon(f1);
+}
+
+
+void TestCoalescer::finish()
+{
+    TRequestCoalescer coalescer;
+    bool leader;
+    TRequestCoalescer::Flight *flight = coalescer.join("GET /foo", leader);
+    coalescer.join("GET /foo", leader);
+    coalescer.join("GET /foo", leader);
+
+    THttpResponseHeader header;
+    header.setRawHeader("Content-Type", "text/plain");
+    header.setRawHeader("Set-Cookie", "id=secret");
+    coalescer.finish(flight, header, "hello");
+
+    for (int i = 0; i < 2; ++i) {
+        THttpResponseHeader h;
+        QByteArray body;
+        QVERIFY(coalescer.wait(flight, h, body));
+        QCOMPARE(body, QByteArray("hello"));
+        QCOMPARE(h.rawHeader("Content-Type"), QByteArray("text/plain"));
+        QVERIFY(!h.hasRawHeader("Set-Cookie"));  // never shared
+    }
+}
+
+
+void TestCoalescer::abandon()
+{
+    TRequestCoalescer coalescer;
+    bool leader;
+    TRequestCoalescer::Flight *flight = coalescer.join("GET /foo", leader);
+    coalescer.join("GET /foo", leader);
+    coalescer.abandon(flight);
+
+    THttpResponseHeader header;
+    QByteArray body;
+    QVERIFY(!coalescer.wait(flight, header, body));
+    QVERIFY(body.isEmpty());
+
+    // Leader alone
+    flight = coalescer.join("GET /foo", leader);
+    QVERIFY(leader);
+    coalescer.finish(flight, header, "hello");
+}
+
+
+void TestCoalescer::timeout()
+{
+    TRequestCoalescer coalescer(100);
+    bool leader;
+    TRequestCoalescer::Flight *flight = coalescer.join("GET /foo", leader);
+    coalescer.join("GET /foo", leader);
+
+    THttpResponseHeader header;
+    QByteArray body;
+    QTime time;
+    time.start();
+    QVERIFY(!coalescer.wait(flight, header, body));
+    QVERIFY(time.elapsed() >= 90);
+
+    // Still in flight for the leader
+    coalescer.join("GET /foo", leader);
+    QVERIFY(!leader);
+    coalescer.finish(flight, header, "hello");
+    QVERIFY(coalescer.wait(flight, header, body));
+    QCOMPARE(body, QByteArray("hello"));
+}
+
+
+void TestCoalescer::waitInThread()
+{
+    TRequestCoalescer coalescer;
+    bool leader;
+    TRequestCoalescer::Flight *flight = coalescer.join("GET /foo", leader);
+    coalescer.join("GET /foo", leader);
+
+    Follower follower(coalescer, flight);
+    follower.start();
+    QVERIFY(!follower.wait(100));  // waiting for the leader
+
+    THttpResponseHeader header;
+    header.setRawHeader("Content-Type", "text/plain");
+    coalescer.finish(flight, header, "hello");
+    QVERIFY(follower.wait(5000));
+    QVERIFY(follower.result);
+    QCOMPARE(follower.body, QByteArray("hello"));
+    QCOMPARE(follower.header.rawHeader("Content-Type"), QByteArray("text/plain"));
+}
+
+
+QTEST_APPLESS_MAIN(TestCoalescer)
+#include "main.moc"
@@ -0,0 +1,125 @@
+#include <QTest>
+#include <TCriteriaConverter>
+
+
+class TestCriteria : public QObject
+{
+    Q_OBJECT
+private slots:
+    void boundString_data();
+    void boundString();
+    void shape();
+    void arrayLiteral_data();
+    void arrayLiteral();
+    void maxBoundValues();
+};
+
+
+void TestCriteria::boundString_data()
+{
+    QTest::addColumn<int>("op");
+    QTest::addColumn<QVariant>("value");
+    QTest::addColumn<bool>("arrayBinding");
+    QTest::addColumn<QString>("string");
+    QTest::addColumn<int>("count");
+
+    QVariantList list;
+    list << 1 << 2 << 3;
+
+    QTest::newRow("equal") << (int)TSql::Equal << QVariant(10) << false << QString("id=?") << 1;
+    QTest::newRow("like") << (int)TSql::Like << QVariant("a%") << false << QString("id LIKE ?") << 1;
+    QTest::newRow("between") << (int)TSql::Between << QVariant(QVariantList() << 1 << 9) << false << QString("(id BETWEEN ? AND ?)") << 2;
+    QTest::newRow("in") << (int)TSql::In << QVariant(list) << false << QString("id IN (?,?,?)") << 3;
+    QTest::newRow("not in") << (int)TSql::NotIn << QVariant(list) << false << QString("id NOT IN (?,?,?)") << 3;
+    QTest::newRow("in array") << (int)TSql::In << QVariant(list) << true << QString("id=ANY (?)") << 1;
+    QTest::newRow("not in array") << (int)TSql::NotIn << QVariant(list) << true << QString("id<>ALL (?)") << 1;
+    QTest::newRow("is null") << (int)TSql::IsNull << QVariant() << false << QString("id IS NULL") << 0;
+}
+
+
+void TestCriteria::boundString()
+{
+    QFETCH(int, op);
+    QFETCH(QVariant, value);
+    QFETCH(bool, arrayBinding);
+    QFETCH(QString, string);
+    QFETCH(int, count);
+
+    TCriteriaData cri(0, (TSql::ComparisonOperator)op, value);
+    QList<QVariant> values;
+    QString shape;
+    QCOMPARE(cri.toBoundString("id", arrayBinding, values, shape), string);
+    QCOMPARE(values.count(), count);
+    QVERIFY(!shape.isEmpty());
+
+    // Not built without the name
+    QList<QVariant> values2;
+    QString shape2;
+    QVERIFY(cri.toBoundString(QString(), arrayBinding, values2, shape2).isEmpty());
+    QCOMPARE(values2, values);
+    QCOMPARE(shape2, shape);
+}
+
+
+void TestCriteria::shape()
+{
+    QList<QVariant> values;
+    QString s1, s2, s3, s4;
+    TCriteriaData(1, TSql::In, QVariantList() << 1 << 2).toBoundString(QString(), false, values, s1);
+    TCriteriaData(1, TSql::In, QVariantList() << 3 << 4).toBoundString(QString(), false, values, s2);
+    TCriteriaData(1, TSql::In, QVariantList() << 1 << 2 << 3).toBoundString(QString(), false, values, s3);
+    TCriteriaData(2, TSql::In, QVariantList() << 1 << 2).toBoundString(QString(), false, values, s4);
+
+    QCOMPARE(s1, QString("1.%1.%2.2;").arg((int)TSql::In).arg((int)TSql::Invalid));
+    QCOMPARE(s1, s2);  // values aren't part of the shape
+    QVERIFY(s1 != s3);
+    QVERIFY(s1 != s4);
+    QCOMPARE(values.count(), 9);
+
+    // Invalid criteria
+    QString s5;
+    QVERIFY(TCriteriaData(1, TSql::In, QVariantList()).toBoundString("id", false, values, s5).isEmpty());
+    QVERIFY(s5.isEmpty());
+    QCOMPARE(values.count(), 9);
+}
+
+
+void TestCriteria::arrayLiteral_data()
+{
+    QTest::addColumn<QVariantList>("list");
+    QTest::addColumn<QString>("literal");
+
+    QTest::newRow("empty") << QVariantList() << QString("{}");
+    QTest::newRow("int") << (QVariantList() << 1 << -2) << QString("{\"1\",\"-2\"}");
+    QTest::newRow("null") << (QVariantList() << 1 << QVariant(QVariant::Int)) << QString("{\"1\",NULL}");
+    QTest::newRow("escape") << (QVariantList() << QString("a\"b\\c,{}")) << QString("{\"a\\\"b\\\\c,{}\"}");
+    QTest::newRow("date") << (QVariantList() << QDate(2012, 4, 1)) << QString("{\"2012-04-01\"}");
+    QTest::newRow("datetime") << (QVariantList() << QDateTime(QDate(2012, 4, 1), QTime(12, 34, 56, 789)))
+                              << QString("{\"2012-04-01T12:34:56.789\"}");
+    QTest::newRow("datetime utc") << (QVariantList() << QDateTime(QDate(2012, 4, 1), QTime(12, 34, 56), Qt::UTC))
+                                  << QString("{\"2012-04-01T12:34:56.000Z\"}");
+    QTest::newRow("time") << (QVariantList() << QTime(1, 2, 3)) << QString("{\"01:02:03.000\"}");
+    QTest::newRow("bytearray") << (QVariantList() << QByteArray("\x00\x7f\xff", 3)) << QString("{\"\\\\x007fff\"}");
+}
+
+
+void TestCriteria::arrayLiteral()
+{
+    QFETCH(QVariantList, list);
+    QFETCH(QString, literal);
+
+    QCOMPARE(TCriteriaData::arrayLiteral(list), literal);
+}
+
+
+void TestCriteria::maxBoundValues()
+{
+    QVERIFY(TCriteriaData::maxBoundValues("QSQLITE") < 999);
+    QVERIFY(TCriteriaData::maxBoundValues("qsqlite") < 999);
+    QVERIFY(TCriteriaData::maxBoundValues("QMYSQL") < 65535);
+    QVERIFY(TCriteriaData::maxBoundValues("QODBC") > 0);
+}
+
+
+QTEST_APPLESS_MAIN(TestCriteria)
+#include "main.moc"
@@ -0,0 +1,74 @@
+#include <QTest>
+#include <THttpUtility>
+
+
+class TestETag : public QObject
+{
+    Q_OBJECT
+private slots:
+    void toEntityTag_data();
+    void toEntityTag();
+    void matches_data();
+    void matches();
+};
+
+
+void TestETag::toEntityTag_data()
+{
+    QTest::addColumn<QByteArray>("tag");
+    QTest::addColumn<QByteArray>("eTag");
+
+    QTest::newRow("plain") << QByteArray("abc") << QByteArray("\"abc\"");
+    QTest::newRow("quoted") << QByteArray("\"abc\"") << QByteArray("\"abc\"");
+    QTest::newRow("weak") << QByteArray("W/\"abc\"") << QByteArray("W/\"abc\"");
+    QTest::newRow("empty quoted") << QByteArray("\"\"") << QByteArray("\"\"");
+    QTest::newRow("trailing quote") << QByteArray("abc\"") << QByteArray("\"abc\"");
+    QTest::newRow("leading quote") << QByteArray("\"abc") << QByteArray("\"abc\"");
+    QTest::newRow("inner quote") << QByteArray("\"a\"bc\"") << QByteArray("\"abc\"");
+    QTest::newRow("weak unquoted") << QByteArray("W/abc") << QByteArray("\"W/abc\"");
+    QTest::newRow("quote only") << QByteArray("\"") << QByteArray("\"\"");
+}
+
+
+void TestETag::toEntityTag()
+{
+    QFETCH(QByteArray, tag);
+    QFETCH(QByteArray, eTag);
+
+    QCOMPARE(THttpUtility::toEntityTag(tag), eTag);
+}
+
+
+void TestETag::matches_data()
+{
+    QTest::addColumn<QByteArray>("eTag");
+    QTest::addColumn<QByteArray>("ifNoneMatch");
+    QTest::addColumn<bool>("result");
+
+    QTest::newRow("same") << QByteArray("\"abc\"") << QByteArray("\"abc\"") << true;
+    QTest::newRow("different") << QByteArray("\"abc\"") << QByteArray("\"abd\"") << false;
+    QTest::newRow("no header") << QByteArray("\"abc\"") << QByteArray() << false;
+    QTest::newRow("no tag") << QByteArray() << QByteArray("*") << false;
+    QTest::newRow("star") << QByteArray("\"abc\"") << QByteArray("*") << true;
+    QTest::newRow("list") << QByteArray("\"abc\"") << QByteArray("\"xyz\", \"abc\"") << true;
+    QTest::newRow("list no space") << QByteArray("\"abc\"") << QByteArray("\"xyz\",\"abc\"") << true;
+    QTest::newRow("list not found") << QByteArray("\"abc\"") << QByteArray("\"xyz\", \"uvw\"") << false;
+    QTest::newRow("weak tag") << QByteArray("W/\"abc\"") << QByteArray("\"abc\"") << true;
+    QTest::newRow("weak header") << QByteArray("\"abc\"") << QByteArray("W/\"abc\"") << true;
+    QTest::newRow("weak both") << QByteArray("W/\"abc\"") << QByteArray("\"xyz\", W/\"abc\"") << true;
+    QTest::newRow("unquoted") << QByteArray("\"abc\"") << QByteArray("abc") << false;
+}
+
+
+void TestETag::matches()
+{
+    QFETCH(QByteArray, eTag);
+    QFETCH(QByteArray, ifNoneMatch);
+    QFETCH(bool, result);
+
+    QCOMPARE(THttpUtility::entityTagMatches(eTag, ifNoneMatch), result);
+}
+
+
+QTEST_APPLESS_MAIN(TestETag)
+#include "main.moc"
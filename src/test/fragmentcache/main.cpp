@@ -0,0 +1,100 @@
+#include <QTest>
+#include <TFragmentCache>
+
+
+class TestFragmentCache : public QObject
+{
+    Q_OBJECT
+private slots:
+    void findAndInsert();
+    void expiration();
+    void removeTemplate();
+    void sizeLimit();
+    void disabled();
+};
+
+
+void TestFragmentCache::findAndInsert()
+{
+    TFragmentCache cache(1024 * 1024, 60);
+    QString frag;
+    QVERIFY(!cache.find("item", "1:0", frag));
+
+    cache.insert("item", "1:0", "<li>foo</li>");
+    QVERIFY(cache.find("item", "1:0", frag));
+    QCOMPARE(frag, QString("<li>foo</li>"));
+    QVERIFY(cache.find("partial/item", "1:0", frag));  // same template
+    QVERIFY(!cache.find("item", "1:1", frag));
+    QVERIFY(!cache.find("entry", "1:0", frag));
+}
+
+
+void TestFragmentCache::expiration()
+{
+    TFragmentCache cache(1024 * 1024, 60);
+    QString frag;
+
+    cache.insert("item", "1", "foo", 0);  // not cached
+    QVERIFY(!cache.find("item", "1", frag));
+
+    cache.insert("item", "2", "bar", 1);
+    QVERIFY(cache.find("item", "2", frag));
+    QTest::qSleep(2100);
+    QVERIFY(!cache.find("item", "2", frag));
+    QCOMPARE(cache.count(), 0);
+}
+
+
+void TestFragmentCache::removeTemplate()
+{
+    TFragmentCache cache(1024 * 1024, 60);
+    QString frag;
+
+    cache.insert("item", "1", "a");
+    cache.insert("item", "2", "b");
+    cache.insert("entry", "1", "c");
+    QCOMPARE(cache.count(), 3);
+
+    cache.remove("item", "1");
+    QVERIFY(!cache.find("item", "1", frag));
+    QVERIFY(cache.find("item", "2", frag));
+
+    cache.remove("partial/item");
+    QVERIFY(!cache.find("item", "2", frag));
+    QVERIFY(cache.find("entry", "1", frag));
+    QCOMPARE(cache.count(), 1);
+}
+
+
+void TestFragmentCache::sizeLimit()
+{
+    TFragmentCache cache(100, 60);  // bytes
+    QString frag;
+
+    cache.insert("item", "big", QString(51, 'x'));
+    QVERIFY(!cache.find("item", "big", frag));
+
+    cache.insert("item", "1", QString(20, 'a'));
+    cache.insert("item", "2", QString(20, 'b'));
+    QVERIFY(cache.find("item", "1", frag));  // makes it recently used
+    cache.insert("item", "3", QString(20, 'c'));
+    QVERIFY(cache.totalSize() <= 100);
+    QVERIFY(cache.find("item", "1", frag));
+    QVERIFY(!cache.find("item", "2", frag));  // least recently used
+    QVERIFY(cache.find("item", "3", frag));
+}
+
+
+void TestFragmentCache::disabled()
+{
+    TFragmentCache cache(0, 60);
+    QString frag;
+
+    QVERIFY(!cache.isEnabled());
+    cache.insert("item", "1", "foo");
+    QVERIFY(!cache.find("item", "1", frag));
+}
+
+
+QTEST_APPLESS_MAIN(TestFragmentCache)
+#include "main.moc"
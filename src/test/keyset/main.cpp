@@ -0,0 +1,184 @@
+#include <QTest>
+#include <QDataStream>
+#include <TSqlKeyset>
+#include <TCryptMac>
+#include <THttpUtility>
+
+typedef QList<QPair<QString, TSql::SortOrder> > Columns;
+Q_DECLARE_METATYPE(Columns)
+
+
+class TestKeyset : public QObject
+{
+    Q_OBJECT
+private slots:
+    void phrase_data();
+    void phrase();
+    void invalidKeys();
+    void cursor_data();
+    void cursor();
+    void tamperedCursor();
+    void hugeCount();
+    void tooLongCursor();
+};
+
+
+static const QByteArray secret("0123456789abcdef");
+
+
+void TestKeyset::phrase_data()
+{
+    QTest::addColumn<Columns>("columns");
+    QTest::addColumn<bool>("rowValue");
+    QTest::addColumn<QString>("phrase");
+    QTest::addColumn<int>("count");
+
+    Columns one;
+    one << qMakePair(QString("id"), TSql::AscendingOrder);
+    Columns asc;
+    asc << qMakePair(QString("a"), TSql::AscendingOrder) << qMakePair(QString("id"), TSql::AscendingOrder);
+    Columns desc;
+    desc << qMakePair(QString("a"), TSql::DescendingOrder) << qMakePair(QString("id"), TSql::DescendingOrder);
+    Columns mixed;
+    mixed << qMakePair(QString("a"), TSql::DescendingOrder) << qMakePair(QString("id"), TSql::AscendingOrder);
+
+    QTest::newRow("one") << one << false << QString("((id>?))") << 1;
+    QTest::newRow("one row") << one << true << QString("(id) > (?)") << 1;
+    QTest::newRow("asc") << asc << false << QString("((a>?) OR (a=? AND id>?))") << 3;
+    QTest::newRow("asc row") << asc << true << QString("(a, id) > (?, ?)") << 2;
+    QTest::newRow("desc row") << desc << true << QString("(a, id) < (?, ?)") << 2;
+    QTest::newRow("mixed") << mixed << false << QString("((a<?) OR (a=? AND id>?))") << 3;
+    QTest::newRow("mixed row") << mixed << true << QString("((a<?) OR (a=? AND id>?))") << 3;
+}
+
+
+void TestKeyset::phrase()
+{
+    QFETCH(Columns, columns);
+    QFETCH(bool, rowValue);
+    QFETCH(QString, phrase);
+    QFETCH(int, count);
+
+    QList<QVariant> keys;
+    for (int i = 0; i < columns.count(); ++i) {
+        keys << QVariant(i + 10);
+    }
+
+    QList<QVariant> values;
+    values << QVariant("filter");
+    QCOMPARE(TSqlKeyset::phrase(columns, rowValue, keys, values), phrase);
+    QCOMPARE(values.count(), count + 1);
+    QCOMPARE(values.first(), QVariant("filter"));
+    QCOMPARE(values.last(), keys.last());
+}
+
+
+void TestKeyset::invalidKeys()
+{
+    Columns columns;
+    columns << qMakePair(QString("a"), TSql::AscendingOrder) << qMakePair(QString("id"), TSql::AscendingOrder);
+    QList<QVariant> values;
+    QVERIFY(TSqlKeyset::phrase(columns, false, QList<QVariant>() << 1, values).isEmpty());
+    QVERIFY(TSqlKeyset::phrase(Columns(), false, QList<QVariant>(), values).isEmpty());
+    QVERIFY(values.isEmpty());
+}
+
+
+void TestKeyset::cursor_data()
+{
+    QTest::addColumn<QVariant>("key");
+
+    QTest::newRow("null") << QVariant();
+    QTest::newRow("bool") << QVariant(true);
+    QTest::newRow("int") << QVariant(-12345);
+    QTest::newRow("uint") << QVariant(4000000000U);
+    QTest::newRow("longlong") << QVariant(Q_INT64_C(-9223372036854775807));
+    QTest::newRow("ulonglong") << QVariant(Q_UINT64_C(18446744073709551615));
+    QTest::newRow("double") << QVariant(-3.14159);
+    QTest::newRow("string") << QVariant(QString::fromUtf8("\xe3\x81\x82\xe3\x81\x84 abc"));
+    QTest::newRow("bytearray") << QVariant(QByteArray("\x00\x01\xff", 3));
+    QTest::newRow("date") << QVariant(QDate(2012, 4, 1));
+    QTest::newRow("time") << QVariant(QTime(12, 34, 56, 789));
+    QTest::newRow("datetime") << QVariant(QDateTime(QDate(2012, 4, 1), QTime(12, 34, 56, 789)));
+    QTest::newRow("datetime utc") << QVariant(QDateTime(QDate(2012, 4, 1), QTime(12, 34, 56), Qt::UTC));
+}
+
+
+void TestKeyset::cursor()
+{
+    QFETCH(QVariant, key);
+
+    QList<QVariant> keys;
+    keys << key << QVariant(100);
+    QString cursor = TSqlKeyset::toCursor(keys, secret);
+    QVERIFY(!cursor.isEmpty());
+
+    QList<QVariant> result;
+    QVERIFY(TSqlKeyset::fromCursor(cursor, 2, secret, result));
+    QCOMPARE(result, keys);
+    QCOMPARE(result[0].type(), key.type());
+
+    // Another count of the keys
+    QVERIFY(!TSqlKeyset::fromCursor(cursor, 1, secret, result));
+    QVERIFY(result.isEmpty());
+}
+
+
+void TestKeyset::tamperedCursor()
+{
+    QList<QVariant> keys;
+    keys << QVariant(QString("foo")) << QVariant(10);
+    QString cursor = TSqlKeyset::toCursor(keys, secret);
+
+    QList<QVariant> result;
+    QVERIFY(!TSqlKeyset::fromCursor(cursor, 2, "other secret", result));
+    QVERIFY(!TSqlKeyset::fromCursor(QString(), 2, secret, result));
+    QVERIFY(!TSqlKeyset::fromCursor(cursor.left(cursor.indexOf('.')), 2, secret, result));
+    QVERIFY(!TSqlKeyset::fromCursor(cursor.left(cursor.length() - 1), 2, secret, result));
+
+    QString changed = cursor;
+    changed[1] = (changed[1] == QLatin1Char('A')) ? QLatin1Char('B') : QLatin1Char('A');
+    QVERIFY(!TSqlKeyset::fromCursor(changed, 2, secret, result));
+    QVERIFY(result.isEmpty());
+
+    // Not a scalar value
+    QVERIFY(TSqlKeyset::toCursor(QList<QVariant>() << QVariant(QStringList() << "a"), secret).isEmpty());
+}
+
+
+void TestKeyset::hugeCount()
+{
+    // Count of 0xFFFFFFFF in the former format, even if signed
+    QByteArray data;
+    QDataStream ds(&data, QIODevice::WriteOnly);
+    ds << (quint32)0xFFFFFFFF;
+    QByteArray digest = TCryptMac::mac(data, secret, TCryptMac::Hmac_Sha1);
+    QString cursor = QString::fromLatin1(THttpUtility::toBase64Url(data) + '.' + THttpUtility::toBase64Url(digest));
+
+    QList<QVariant> result;
+    QVERIFY(!TSqlKeyset::fromCursor(cursor, 2, secret, result));
+
+    // String longer than the data
+    data.clear();
+    QDataStream ds2(&data, QIODevice::WriteOnly);
+    ds2 << (quint8)1 << (quint8)7 << (quint16)0xFFFF;
+    digest = TCryptMac::mac(data, secret, TCryptMac::Hmac_Sha1);
+    cursor = QString::fromLatin1(THttpUtility::toBase64Url(data) + '.' + THttpUtility::toBase64Url(digest));
+    QVERIFY(!TSqlKeyset::fromCursor(cursor, 1, secret, result));
+}
+
+
+void TestKeyset::tooLongCursor()
+{
+    QList<QVariant> keys;
+    keys << QVariant(QString(1000, 'a'));
+    QString cursor = TSqlKeyset::toCursor(keys, secret);
+    QVERIFY(!cursor.isEmpty());
+
+    QList<QVariant> result;
+    QVERIFY(!TSqlKeyset::fromCursor(cursor, 1, secret, result));
+}
+
+
+QTEST_APPLESS_MAIN(TestKeyset)
+#include "main.moc"
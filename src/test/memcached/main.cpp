@@ -0,0 +1,322 @@
+#include <QTest>
+#include <QThread>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QSet>
+#include <TMemcached>
+
+
+/*
+  Stand-in memcached server supporting a subset of the text protocol
+*/
+class MemcachedServer : public QThread
+{
+    Q_OBJECT
+public:
+    MemcachedServer() : QThread(), listenPort(0) { }
+    ~MemcachedServer() { quit(); wait(); }
+
+    quint16 port() const { return listenPort; }
+    QString name() const { return QString("127.0.0.1:%1").arg(listenPort); }
+
+    void startServer()
+    {
+        QMutexLocker locker(&mutex);
+        start();
+        started.wait(&mutex);
+    }
+
+protected:
+    void run()
+    {
+        QTcpServer server;
+        server.listen(QHostAddress::LocalHost);
+        connect(&server, SIGNAL(newConnection()), this, SLOT(acceptConnection()), Qt::DirectConnection);
+        {
+            QMutexLocker locker(&mutex);
+            listenPort = server.serverPort();
+            started.wakeAll();
+        }
+        exec();
+    }
+
+private slots:
+    void acceptConnection()
+    {
+        QTcpServer *server = qobject_cast<QTcpServer *>(sender());
+        QTcpSocket *socket = server->nextPendingConnection();
+        connect(socket, SIGNAL(readyRead()), this, SLOT(readRequest()), Qt::DirectConnection);
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    }
+
+    void readRequest()
+    {
+        QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+        QByteArray &buf = buffers[socket];
+        buf += socket->readAll();
+
+        for (;;) {
+            int idx = buf.indexOf("\r\n");
+            if (idx < 0)
+                return;
+
+            QList<QByteArray> tokens = buf.left(idx).split(' ');
+            const QByteArray cmd = tokens.value(0);
+            QMutexLocker locker(&mutex);
+
+            if (cmd == "get" || cmd == "gat") {
+                QByteArray reply;
+                for (int i = (cmd == "get") ? 1 : 2; i < tokens.count(); ++i) {
+                    if (items.contains(tokens[i])) {
+                        const QByteArray &val = items[tokens[i]];
+                        reply += "VALUE " + tokens[i] + " 0 " + QByteArray::number(val.length()) + "\r\n" + val + "\r\n";
+                    }
+                }
+                socket->write(reply + "END\r\n");
+                buf.remove(0, idx + 2);
+
+            } else if (cmd == "set" || cmd == "add") {
+                int len = tokens.value(4).toInt();
+                if (buf.length() < idx + 2 + len + 2)
+                    return;  // waits for the data block
+
+                QByteArray val = buf.mid(idx + 2, len);
+                buf.remove(0, idx + 2 + len + 2);
+                if (cmd == "add" && items.contains(tokens[1])) {
+                    socket->write("NOT_STORED\r\n");
+                } else {
+                    items.insert(tokens[1], val);
+                    socket->write("STORED\r\n");
+                }
+
+            } else if (cmd == "delete") {
+                socket->write(items.remove(tokens.value(1)) ? "DELETED\r\n" : "NOT_FOUND\r\n");
+                buf.remove(0, idx + 2);
+
+            } else if (cmd == "touch") {
+                socket->write(items.contains(tokens.value(1)) ? "TOUCHED\r\n" : "NOT_FOUND\r\n");
+                buf.remove(0, idx + 2);
+
+            } else {
+                socket->write("ERROR\r\n");
+                buf.remove(0, idx + 2);
+            }
+        }
+    }
+
+private:
+    mutable QMutex mutex;
+    QWaitCondition started;
+    quint16 listenPort;
+    QHash<QByteArray, QByteArray> items;
+    QHash<QTcpSocket *, QByteArray> buffers;
+};
+
+
+class TestMemcached : public QObject
+{
+    Q_OBJECT
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void setGet();
+    void add();
+    void remove();
+    void touch();
+    void invalidKey();
+    void multiGet();
+    void multiSet();
+    void serverDown();
+    void singleServerDown();
+    void consistentHashing();
+
+private:
+    MemcachedServer *server1;
+    MemcachedServer *server2;
+};
+
+
+void TestMemcached::initTestCase()
+{
+    server1 = new MemcachedServer;
+    server1->startServer();
+    server2 = new MemcachedServer;
+    server2->startServer();
+}
+
+
+void TestMemcached::cleanupTestCase()
+{
+    delete server1;
+    delete server2;
+}
+
+
+void TestMemcached::setGet()
+{
+    TMemcached mc(QStringList() << server1->name());
+    bool found;
+
+    QVERIFY(mc.set("foo", "bar"));
+    QCOMPARE(mc.get("foo", &found), QByteArray("bar"));
+    QVERIFY(found);
+
+    QByteArray binary("a\r\nb\0c", 6);
+    QVERIFY(mc.set("bin", binary));
+    QCOMPARE(mc.get("bin"), binary);
+    QCOMPARE(mc.getAndTouch("bin", 60, &found), binary);
+    QVERIFY(found);
+
+    QVERIFY(mc.set("empty", QByteArray()));
+    QCOMPARE(mc.get("empty", &found), QByteArray());
+    QVERIFY(found);
+
+    QCOMPARE(mc.get("nothing", &found), QByteArray());
+    QVERIFY(!found);
+}
+
+
+void TestMemcached::add()
+{
+    TMemcached mc(QStringList() << server1->name());
+
+    QVERIFY(mc.add("addkey", "1"));
+    QVERIFY(!mc.add("addkey", "2"));
+    QCOMPARE(mc.get("addkey"), QByteArray("1"));
+}
+
+
+void TestMemcached::remove()
+{
+    TMemcached mc(QStringList() << server1->name());
+
+    QVERIFY(mc.set("removekey", "1"));
+    QVERIFY(mc.remove("removekey"));
+    QVERIFY(!mc.remove("removekey"));
+    bool found;
+    mc.get("removekey", &found);
+    QVERIFY(!found);
+}
+
+
+void TestMemcached::touch()
+{
+    TMemcached mc(QStringList() << server1->name());
+
+    QVERIFY(mc.set("touchkey", "1"));
+    QVERIFY(mc.touch("touchkey", 60));
+    QVERIFY(!mc.touch("nothing", 60));
+}
+
+
+void TestMemcached::invalidKey()
+{
+    TMemcached mc(QStringList() << server1->name());
+
+    QVERIFY(!mc.set("foo bar", "1"));
+    QVERIFY(!mc.set("foo\r\n", "1"));
+    QVERIFY(!mc.set(QByteArray(251, 'a'), "1"));
+    QVERIFY(mc.set(QByteArray(250, 'a'), "1"));
+}
+
+
+void TestMemcached::multiGet()
+{
+    TMemcached mc(QStringList() << server1->name() << server2->name());
+    QList<QByteArray> keys;
+    QSet<QString> names;
+
+    for (int i = 0; i < 50; ++i) {
+        QByteArray key = "multi" + QByteArray::number(i);
+        QVERIFY(mc.set(key, QByteArray::number(i * 10)));
+        keys << key;
+        names << mc.serverName(key);
+    }
+    QCOMPARE(names.count(), 2);  // distributed
+
+    keys << "nothing";
+    QHash<QByteArray, QByteArray> values = mc.get(keys);
+    QCOMPARE(values.count(), 50);
+    for (int i = 0; i < 50; ++i) {
+        QCOMPARE(values.value("multi" + QByteArray::number(i)), QByteArray::number(i * 10));
+    }
+}
+
+
+void TestMemcached::multiSet()
+{
+    TMemcached mc(QStringList() << server1->name() << server2->name());
+    QHash<QByteArray, QByteArray> items;
+
+    for (int i = 0; i < 100; ++i) {
+        items.insert("pipe" + QByteArray::number(i), QByteArray(i * 100, 'x'));
+    }
+    QCOMPARE(mc.set(items), 100);
+    QCOMPARE(mc.get(items.keys()), items);
+}
+
+
+static QString downServerName()
+{
+    // A port nobody listens on
+    QTcpServer tmp;
+    tmp.listen(QHostAddress::LocalHost);
+    QString down = QString("127.0.0.1:%1").arg(tmp.serverPort());
+    tmp.close();
+    return down;
+}
+
+
+void TestMemcached::serverDown()
+{
+    QString down = downServerName();
+    TMemcached mc(QStringList() << server1->name() << down, 500);
+    for (int i = 0; i < 20; ++i) {
+        QByteArray key = "down" + QByteArray::number(i);
+        QVERIFY(mc.set(key, "1"));  // skips the server down
+        QCOMPARE(mc.serverName(key), server1->name());
+    }
+}
+
+
+void TestMemcached::singleServerDown()
+{
+    QString down = downServerName();
+    TMemcached mc(QStringList() << down, 500);
+    bool found;
+
+    QCOMPARE(mc.serverName("single"), down);
+    QVERIFY(!mc.set("single", "1"));  // returns, not retrying forever
+    QVERIFY(mc.serverName("single").isEmpty());  // skipped until the retry time
+    QVERIFY(!mc.set("single", "1"));
+    QCOMPARE(mc.get("single", &found), QByteArray());
+    QVERIFY(!found);
+    QVERIFY(!mc.remove("single"));
+}
+
+
+void TestMemcached::consistentHashing()
+{
+    QStringList servers;
+    servers << "10.0.0.1:11211" << "10.0.0.2:11211" << "10.0.0.3:11211";
+    TMemcached mc3(servers);
+    TMemcached mc4(QStringList(servers) << "10.0.0.4:11211");
+
+    int moved = 0;
+    for (int i = 0; i < 1000; ++i) {
+        QByteArray key = "key" + QByteArray::number(i);
+        QString name = mc4.serverName(key);
+        if (name != mc3.serverName(key)) {
+            QCOMPARE(name, QString("10.0.0.4:11211"));  // moves only to the added server
+            ++moved;
+        }
+    }
+    QVERIFY(moved > 100 && moved < 400);
+}
+
+
+QTEST_MAIN(TestMemcached)
+#include "main.moc"
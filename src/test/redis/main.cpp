@@ -0,0 +1,151 @@
+#include <QTest>
+#include <QProcess>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <TRedis>
+
+
+class TestRedis : public QObject
+{
+    Q_OBJECT
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void setGet();
+    void expire();
+    void remove();
+    void pipeline();
+    void serverDown();
+
+private:
+    QProcess server;
+    QString serverName;
+};
+
+
+void TestRedis::initTestCase()
+{
+    // Runs redis-server on a free port
+    QTcpServer tmp;
+    tmp.listen(QHostAddress::LocalHost);
+    quint16 port = tmp.serverPort();
+    tmp.close();
+
+    server.start("redis-server", QStringList() << "--port" << QString::number(port) << "--bind" << "127.0.0.1" << "--save" << "");
+    if (!server.waitForStarted()) {
+        QSKIP("redis-server not found", SkipAll);
+    }
+    serverName = QString("127.0.0.1:%1").arg(port);
+
+    for (int i = 0; i < 50; ++i) {
+        QTcpSocket sock;
+        sock.connectToHost(QHostAddress::LocalHost, port);
+        if (sock.waitForConnected(100))
+            return;
+        QTest::qWait(100);
+    }
+    QFAIL("redis-server not listening");
+}
+
+
+void TestRedis::cleanupTestCase()
+{
+    if (server.state() != QProcess::NotRunning) {
+        server.terminate();
+        server.waitForFinished();
+    }
+}
+
+
+void TestRedis::setGet()
+{
+    TRedis redis(serverName);
+    bool found;
+
+    QVERIFY(redis.setEx("foo", "bar", 60));
+    QCOMPARE(redis.get("foo", &found), QByteArray("bar"));
+    QVERIFY(found);
+
+    QByteArray binary("a\r\nb\0c", 6);
+    QVERIFY(redis.setEx("bin", binary, 60));
+    QCOMPARE(redis.getAndExpire("bin", 120, &found), binary);
+    QVERIFY(found);
+
+    QVERIFY(redis.setEx("empty", QByteArray(), 60));
+    QCOMPARE(redis.get("empty", &found), QByteArray());
+    QVERIFY(found);
+
+    QCOMPARE(redis.get("nothing", &found), QByteArray());
+    QVERIFY(!found);
+    redis.getAndExpire("nothing", 60, &found);
+    QVERIFY(!found);
+}
+
+
+void TestRedis::expire()
+{
+    TRedis redis(serverName);
+
+    QVERIFY(redis.setEx("expirekey", "1", 60));
+    QVERIFY(redis.expire("expirekey", 1));
+    QVERIFY(!redis.expire("nothing", 1));
+    QTest::qWait(2100);
+
+    bool found;
+    redis.get("expirekey", &found);
+    QVERIFY(!found);
+}
+
+
+void TestRedis::remove()
+{
+    TRedis redis(serverName);
+
+    QVERIFY(redis.setEx("removekey", "1", 60));
+    QVERIFY(redis.remove("removekey"));
+    QVERIFY(!redis.remove("removekey"));
+}
+
+
+void TestRedis::pipeline()
+{
+    TRedis redis(serverName);
+    QList<QList<QByteArray> > cmds;
+    cmds << (QList<QByteArray>() << "SET" << "pipe" << "10")
+         << (QList<QByteArray>() << "INCR" << "pipe")
+         << (QList<QByteArray>() << "GET" << "pipe")
+         << (QList<QByteArray>() << "MGET" << "pipe" << "nothing")
+         << (QList<QByteArray>() << "NOSUCHCOMMAND");
+
+    QList<QVariant> replies = redis.pipeline(cmds);
+    QCOMPARE(replies.count(), 5);
+    QCOMPARE(replies[0].toByteArray(), QByteArray("OK"));
+    QCOMPARE(replies[1].toLongLong(), Q_INT64_C(11));
+    QCOMPARE(replies[2].toByteArray(), QByteArray("11"));
+    QCOMPARE(replies[3].toList().count(), 2);
+    QCOMPARE(replies[3].toList()[0].toByteArray(), QByteArray("11"));
+    QVERIFY(!replies[3].toList()[1].isValid());
+    QVERIFY(!replies[4].isValid());  // error
+
+    // Connection still usable
+    QCOMPARE(redis.get("pipe"), QByteArray("11"));
+}
+
+
+void TestRedis::serverDown()
+{
+    QTcpServer tmp;
+    tmp.listen(QHostAddress::LocalHost);
+    QString down = QString("127.0.0.1:%1").arg(tmp.serverPort());
+    tmp.close();
+
+    TRedis redis(down, 500);
+    bool found = true;
+    QVERIFY(!redis.setEx("foo", "bar", 60));
+    redis.get("foo", &found);
+    QVERIFY(!found);
+}
+
+
+QTEST_MAIN(TestRedis)
+#include "main.moc"
@@ -0,0 +1,139 @@
+#include <QTest>
+#include <QDataStream>
+#include <QStringList>
+#include <TSessionCodec>
+#include <THttpUtility>
+
+
+class TestSessionCodec : public QObject
+{
+    Q_OBJECT
+private slots:
+    void encodeDecode_data();
+    void encodeDecode();
+    void compression();
+    void formerFormat();
+    void brokenData();
+    void base64Url_data();
+    void base64Url();
+};
+
+
+void TestSessionCodec::encodeDecode_data()
+{
+    QTest::addColumn<QVariant>("value");
+
+    QTest::newRow("invalid") << QVariant();
+    QTest::newRow("bool") << QVariant(true);
+    QTest::newRow("int") << QVariant(-12345);
+    QTest::newRow("uint") << QVariant(4000000000U);
+    QTest::newRow("longlong") << QVariant(Q_INT64_C(-9223372036854775807));
+    QTest::newRow("ulonglong") << QVariant(Q_UINT64_C(18446744073709551615));
+    QTest::newRow("double") << QVariant(-3.14159);
+    QTest::newRow("string") << QVariant(QString::fromUtf8("\xe3\x81\x82\xe3\x81\x84 abc"));
+    QTest::newRow("bytearray") << QVariant(QByteArray("\x00\x01\xff", 3));
+    QTest::newRow("stringlist") << QVariant(QStringList() << "foo" << "" << "bar");
+    QTest::newRow("datetime") << QVariant(QDateTime(QDate(2012, 4, 1), QTime(12, 34, 56, 789)));
+    QTest::newRow("datetime utc") << QVariant(QDateTime(QDate(2012, 4, 1), QTime(12, 34, 56), Qt::UTC));
+    QTest::newRow("date") << QVariant(QDate(2012, 4, 1));
+}
+
+
+void TestSessionCodec::encodeDecode()
+{
+    QFETCH(QVariant, value);
+
+    QVariantHash hash;
+    hash.insert("key", value);
+    hash.insert(QString::fromUtf8("\xe3\x82\xad\xe3\x83\xbc"), 1);
+
+    TSessionCodec codec;
+    QVariantHash result;
+    QVERIFY(codec.decode(codec.encode(hash), result));
+    QCOMPARE(result, hash);
+    QCOMPARE(result.value("key").type(), value.type());
+}
+
+
+void TestSessionCodec::compression()
+{
+    QVariantHash hash;
+    hash.insert("text", QString(1000, 'a'));
+
+    TSessionCodec plain;
+    TSessionCodec compressing(100);
+    QByteArray p = plain.encode(hash);
+    QByteArray c = compressing.encode(hash);
+    QVERIFY(c.length() < p.length());
+
+    QVariantHash result;
+    QVERIFY(plain.decode(c, result));  // any codec decodes
+    QCOMPARE(result, hash);
+
+    // Under the threshold
+    hash.insert("text", QString("a"));
+    QCOMPARE(compressing.encode(hash), plain.encode(hash));
+}
+
+
+void TestSessionCodec::formerFormat()
+{
+    QVariantHash hash;
+    hash.insert("id", 10);
+    hash.insert("name", QString("foo"));
+
+    QByteArray data;
+    QDataStream ds(&data, QIODevice::WriteOnly);
+    ds << hash;
+
+    QVariantHash result;
+    QVERIFY(TSessionCodec().decode(data, result));
+    QCOMPARE(result, hash);
+
+    // More compact than QDataStream
+    QVERIFY(TSessionCodec().encode(hash).length() < data.length());
+}
+
+
+void TestSessionCodec::brokenData()
+{
+    QVariantHash hash;
+    hash.insert("name", QString("foobar"));
+
+    TSessionCodec codec;
+    QByteArray data = codec.encode(hash);
+    QVariantHash result;
+
+    QVERIFY(!codec.decode(QByteArray(), result));
+    QVERIFY(!codec.decode(data.left(data.length() - 1), result));
+    QVERIFY(result.isEmpty());
+    QVERIFY(!codec.decode(data + 'x', result));
+    QVERIFY(result.isEmpty());
+}
+
+
+void TestSessionCodec::base64Url_data()
+{
+    QTest::addColumn<QByteArray>("data");
+    QTest::addColumn<QByteArray>("encoded");
+
+    QTest::newRow("1") << QByteArray("") << QByteArray("");
+    QTest::newRow("2") << QByteArray("f") << QByteArray("Zg");
+    QTest::newRow("3") << QByteArray("fo") << QByteArray("Zm8");
+    QTest::newRow("4") << QByteArray("foo") << QByteArray("Zm9v");
+    QTest::newRow("5") << QByteArray("\xfb\xff\xbf", 3) << QByteArray("-_-_");
+}
+
+
+void TestSessionCodec::base64Url()
+{
+    QFETCH(QByteArray, data);
+    QFETCH(QByteArray, encoded);
+
+    QCOMPARE(THttpUtility::toBase64Url(data), encoded);
+    QCOMPARE(THttpUtility::fromBase64Url(encoded), data);
+}
+
+
+QTEST_APPLESS_MAIN(TestSessionCodec)
+#include "main.moc"
@@ -0,0 +1,116 @@
+#include <QTest>
+#include <QThread>
+#include <QTime>
+#include "tworkerpool.h"
+
+
+class Worker : public QThread
+{
+public:
+    Worker(TWorkerPool &p) : pool(p), result(false) { }
+
+    void run()
+    {
+        result = pool.acquire();
+    }
+
+    TWorkerPool &pool;
+    bool result;
+};
+
+
+class TestWorkerPool : public QObject
+{
+    Q_OBJECT
+private slots:
+    void acquire();
+    void queueFull();
+    void queueTimeout();
+    void waitForRelease();
+    void queueFullWhileWaiting();
+};
+
+
+void TestWorkerPool::acquire()
+{
+    TWorkerPool pool("test", 2, 0, 100);
+    QVERIFY(pool.acquire());
+    QVERIFY(pool.acquire());
+    QVERIFY(!pool.acquire());
+    pool.release();
+    QVERIFY(pool.acquire());
+    pool.release();
+    pool.release();
+}
+
+
+void TestWorkerPool::queueFull()
+{
+    // No queue: rejected at once, answered with 503
+    TWorkerPool pool("test", 1, 0, 10000);
+    QVERIFY(pool.acquire());
+
+    QTime time;
+    time.start();
+    QVERIFY(!pool.acquire());
+    QVERIFY(time.elapsed() < 5000);
+    pool.release();
+}
+
+
+void TestWorkerPool::queueTimeout()
+{
+    TWorkerPool pool("test", 1, 1, 100);
+    QVERIFY(pool.acquire());
+
+    QTime time;
+    time.start();
+    QVERIFY(!pool.acquire());
+    QVERIFY(time.elapsed() >= 90);
+
+    // The slot of the timed-out one isn't taken
+    pool.release();
+    QVERIFY(pool.acquire());
+    pool.release();
+}
+
+
+void TestWorkerPool::waitForRelease()
+{
+    TWorkerPool pool("test", 1, 1, 10000);
+    QVERIFY(pool.acquire());
+
+    Worker worker(pool);
+    worker.start();
+    QVERIFY(!worker.wait(100));  // queued
+
+    pool.release();
+    QVERIFY(worker.wait(5000));
+    QVERIFY(worker.result);
+    pool.release();
+}
+
+
+void TestWorkerPool::queueFullWhileWaiting()
+{
+    TWorkerPool pool("test", 1, 1, 10000);
+    QVERIFY(pool.acquire());
+
+    Worker worker(pool);
+    worker.start();
+    QVERIFY(!worker.wait(100));  // takes the only place in the queue
+
+    QTime time;
+    time.start();
+    QVERIFY(!pool.acquire());
+    QVERIFY(time.elapsed() < 5000);
+
+    pool.release();
+    QVERIFY(worker.wait(5000));
+    QVERIFY(worker.result);
+    pool.release();
+}
+
+
+QTEST_APPLESS_MAIN(TestWorkerPool)
+#include "main.moc"
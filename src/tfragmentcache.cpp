@@ -0,0 +1,177 @@
+/* Copyright (c) 2010-2012, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <QMutexLocker>
+#include <QDateTime>
+#include <QStringList>
+#include <TFragmentCache>
+#include <TWebApplication>
+#include "tsystemglobal.h"
+
+#define MAX_MEMORY_SIZE    "FragmentCache.MaxMemorySize"
+#define DEFAULT_LIFE_TIME  "FragmentCache.DefaultLifeTime"
+
+/*!
+  \class TFragmentCache
+  \brief The TFragmentCache class provides a process-wide cache of
+  rendered partial templates.
+
+  Fragments are keyed by a template name plus a key supplied by the
+  caller, such as a record ID and its revision. Each fragment expires
+  after its lifetime; the least recently used fragments are discarded
+  when the total size exceeds the memory limit.
+  \sa TActionView::renderPartialCache()
+*/
+
+/*!
+  Constructor with the maximum memory size \a maxSize in bytes and the
+  lifetime \a defaultLifeTime in seconds of fragments inserted without
+  a lifetime.
+*/
+TFragmentCache::TFragmentCache(int maxSize, int defaultLifeTime)
+    : mutex(), cache(qMax(maxSize, 0)), lifeTimeSecs(defaultLifeTime)
+{ }
+
+
+TFragmentCache::~TFragmentCache()
+{ }
+
+/*!
+  Finds the fragment of the template \a templateName associated with the
+  key \a cacheKey. Returns true and sets it into \a fragment if an
+  unexpired one is found; otherwise returns false.
+*/
+bool TFragmentCache::find(const QString &templateName, const QString &cacheKey, QString &fragment) const
+{
+    if (!isEnabled())
+        return false;
+
+    QString key = cacheKeyString(templateName, cacheKey);
+    QMutexLocker locker(&mutex);
+    Fragment *frag = cache.object(key);  // moves it to the most recently used
+    if (!frag)
+        return false;
+
+    if (frag->expiration < QDateTime::currentDateTime().toTime_t()) {
+        cache.remove(key);
+        return false;
+    }
+
+    fragment = frag->data;
+    return true;
+}
+
+/*!
+  Inserts the \a fragment rendered from the template \a templateName with
+  the key \a cacheKey. If \a lifeTime is negative, the default lifetime
+  is used. Fragments larger than the memory limit are never cached.
+*/
+void TFragmentCache::insert(const QString &templateName, const QString &cacheKey, const QString &fragment, int lifeTime)
+{
+    if (!isEnabled())
+        return;
+
+    if (lifeTime < 0) {
+        lifeTime = lifeTimeSecs;
+    }
+
+    if (lifeTime == 0)
+        return;
+
+    Fragment *frag = new Fragment;
+    frag->data = fragment;
+    frag->expiration = QDateTime::currentDateTime().toTime_t() + lifeTime;
+
+    int cost = qMax(fragment.size() * (int)sizeof(QChar), 1);
+    QMutexLocker locker(&mutex);
+    if (!cache.insert(cacheKeyString(templateName, cacheKey), frag, cost)) {  // deletes frag on failure
+        tSystemDebug("Fragment too large to cache: %s  size:%d", qPrintable(templateName), cost);
+    }
+}
+
+/*!
+  Removes the fragment of the template \a templateName associated with
+  the key \a cacheKey. If \a cacheKey is empty, removes all the fragments
+  of the template.
+*/
+void TFragmentCache::remove(const QString &templateName, const QString &cacheKey)
+{
+    QMutexLocker locker(&mutex);
+
+    if (!cacheKey.isEmpty()) {
+        cache.remove(cacheKeyString(templateName, cacheKey));
+        return;
+    }
+
+    QString prefix = templatePath(templateName) + QLatin1Char(':');
+    const QList<QString> keys = cache.keys();
+    for (QListIterator<QString> it(keys); it.hasNext(); ) {
+        const QString &k = it.next();
+        if (k.startsWith(prefix)) {
+            cache.remove(k);
+        }
+    }
+}
+
+/*!
+  Removes all the fragments.
+*/
+void TFragmentCache::clear()
+{
+    QMutexLocker locker(&mutex);
+    cache.clear();
+}
+
+/*!
+  Returns the number of the fragments cached.
+*/
+int TFragmentCache::count() const
+{
+    QMutexLocker locker(&mutex);
+    return cache.count();
+}
+
+/*!
+  Returns the total size in bytes of the fragments cached.
+*/
+int TFragmentCache::totalSize() const
+{
+    QMutexLocker locker(&mutex);
+    return cache.totalCost();
+}
+
+/*!
+  Returns the maximum memory size in bytes. The value 0 means that
+  the cache is disabled.
+*/
+int TFragmentCache::maxSize() const
+{
+    return cache.maxCost();
+}
+
+/*!
+  Returns the fragment cache configured by the application settings.
+*/
+TFragmentCache &TFragmentCache::instance()
+{
+    static TFragmentCache fragmentCache(Tf::app()->appSettings().value(MAX_MEMORY_SIZE, 0).toInt() * 1024,
+                                        Tf::app()->appSettings().value(DEFAULT_LIFE_TIME, 300).toInt());
+    return fragmentCache;
+}
+
+
+QString TFragmentCache::templatePath(const QString &templateName)
+{
+    // Same directory rule as TActionView::renderPartial()
+    return (templateName.contains('/')) ? templateName : QLatin1String("partial/") + templateName;
+}
+
+
+QString TFragmentCache::cacheKeyString(const QString &templateName, const QString &cacheKey)
+{
+    return templatePath(templateName) + QLatin1Char(':') + cacheKey;
+}
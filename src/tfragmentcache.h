@@ -0,0 +1,45 @@
+#ifndef TFRAGMENTCACHE_H
+#define TFRAGMENTCACHE_H
+
+#include <QString>
+#include <QCache>
+#include <QMutex>
+#include <TGlobal>
+
+
+class T_CORE_EXPORT TFragmentCache
+{
+public:
+    TFragmentCache(int maxSize, int defaultLifeTime);
+    ~TFragmentCache();
+
+    bool find(const QString &templateName, const QString &cacheKey, QString &fragment) const;
+    void insert(const QString &templateName, const QString &cacheKey, const QString &fragment, int lifeTime = -1);
+    void remove(const QString &templateName, const QString &cacheKey = QString());
+    void clear();
+    int count() const;
+    int totalSize() const;
+    int maxSize() const;
+    int defaultLifeTime() const { return lifeTimeSecs; }
+    bool isEnabled() const { return maxSize() > 0; }
+
+    static TFragmentCache &instance();
+
+private:
+    struct Fragment
+    {
+        QString data;
+        uint expiration;
+    };
+
+    static QString templatePath(const QString &templateName);
+    static QString cacheKeyString(const QString &templateName, const QString &cacheKey);
+
+    mutable QMutex mutex;
+    mutable QCache<QString, Fragment> cache;
+    int lifeTimeSecs;
+
+    Q_DISABLE_COPY(TFragmentCache)
+};
+
+#endif // TFRAGMENTCACHE_H
@@ -6,6 +6,7 @@
  */
 
 #include <QStringList>
+#include <QDateTime>
 #include <TGlobal>
 #include <TWebApplication>
 #include <TLogger>
@@ -160,6 +161,20 @@ void Tf::msleep(unsigned long msecs)
 #endif
 }
 
+/*!
+  Returns the number of milliseconds since 1970-01-01T00:00:00 UTC,
+  as QDateTime::currentMSecsSinceEpoch() of Qt 4.7 does.
+*/
+qint64 Tf::currentMSecsSinceEpoch()
+{
+#if QT_VERSION >= 0x040700
+    return QDateTime::currentMSecsSinceEpoch();
+#else
+    QDateTime now = QDateTime::currentDateTime().toUTC();
+    return (qint64)now.toTime_t() * 1000 + now.time().msec();
+#endif
+}
+
 /*!
   Random number generator in the range from 0 to \a max.
   The maximum number of \a max is UINT_MAX.
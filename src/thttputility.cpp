@@ -60,6 +60,7 @@ Q_GLOBAL_STATIC_WITH_INITIALIZER(IntHash, reasonPhrase,
     x->insert(Tf::UnsupportedMediaType, "Unsupported Media Type");
     x->insert(Tf::RequestedRangeNotSatisfiable, "Requested Range Not Satisfiable");
     x->insert(Tf::ExpectationFailed, "Expectation Failed");
+    x->insert(Tf::TooManyRequests, "Too Many Requests");
     // Server Error 5xx
     x->insert(Tf::InternalServerError, "Internal Server Error");
     x->insert(Tf::NotImplemented, "Not Implemented");
@@ -247,6 +248,77 @@ QString THttpUtility::fromMimeEncoded(const QByteArray &in)
 }
 
 
+/*!
+  Returns the \a data encoded in the URL and filename safe base64
+  alphabet of RFC 4648 without padding.
+*/
+QByteArray THttpUtility::toBase64Url(const QByteArray &data)
+{
+    QByteArray base = data.toBase64();
+    while (base.endsWith('=')) {
+        base.chop(1);
+    }
+    return base.replace('+', '-').replace('/', '_');
+}
+
+/*!
+  Returns a decoded copy of the base64url encoded array \a base64url.
+*/
+QByteArray THttpUtility::fromBase64Url(const QByteArray &base64url)
+{
+    QByteArray base = base64url;
+    base.replace('-', '+').replace('_', '/');
+    if (base.length() % 4) {
+        base.append(QByteArray(4 - base.length() % 4, '='));
+    }
+    return QByteArray::fromBase64(base);
+}
+
+/*!
+  Returns the entity tag of \a tag for the ETag header. A tag quoted
+  as "xyz" or W/"xyz" is returned as it is; any other is quoted after
+  removing the double quotes in it.
+*/
+QByteArray THttpUtility::toEntityTag(const QByteArray &tag)
+{
+    int start = (tag.startsWith("W/")) ? 2 : 0;
+    if (tag.length() >= start + 2 && tag.at(start) == '"' && tag.endsWith('"')
+        && tag.indexOf('"', start + 1) == tag.length() - 1) {
+        return tag;
+    }
+
+    QByteArray opaque = tag;
+    opaque.replace('"', QByteArray());
+    return '"' + opaque + '"';
+}
+
+/*!
+  Returns true if the entity tag \a eTag matches the value of the
+  If-None-Match header \a ifNoneMatch, a list of entity tags or "*",
+  using the weak comparison; otherwise returns false.
+*/
+bool THttpUtility::entityTagMatches(const QByteArray &eTag, const QByteArray &ifNoneMatch)
+{
+    if (eTag.isEmpty() || ifNoneMatch.isEmpty())
+        return false;
+
+    QByteArray opaque = (eTag.startsWith("W/")) ? eTag.mid(2) : eTag;
+    const QList<QByteArray> tags = ifNoneMatch.split(',');
+    for (QListIterator<QByteArray> i(tags); i.hasNext(); ) {
+        QByteArray t = i.next().trimmed();
+        if (t == "*")
+            return true;
+
+        if (t.startsWith("W/")) {
+            t.remove(0, 2);
+        }
+        if (t == opaque)
+            return true;
+    }
+    return false;
+}
+
+
 QByteArray THttpUtility::getResponseReasonPhrase(int statusCode)
 {
     return reasonPhrase()->value(statusCode);
@@ -27,6 +27,10 @@ public:
     static QByteArray toMimeEncoded(const QString &text, const QByteArray &encoding = "UTF-8");
     static QByteArray toMimeEncoded(const QString &text, QTextCodec *codec);
     static QString fromMimeEncoded(const QByteArray &in);
+    static QByteArray toBase64Url(const QByteArray &data);
+    static QByteArray fromBase64Url(const QByteArray &base64url);
+    static QByteArray toEntityTag(const QByteArray &tag);
+    static bool entityTagMatches(const QByteArray &eTag, const QByteArray &ifNoneMatch);
     static QByteArray getResponseReasonPhrase(int statusCode);
     static QString trimmedQuotes(const QString &string);
     static QByteArray timeZone();
@@ -0,0 +1,535 @@
+/* Copyright (c) 2010-2012, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <QTcpSocket>
+#include <QCryptographicHash>
+#include <QSet>
+#include <TWebApplication>
+#include <TMemcached>
+#include "tsystemglobal.h"
+#include "tclientpool.h"
+
+#define MEMCACHED_SERVERS  "Memcached.Servers"
+#define MEMCACHED_TIMEOUT  "Memcached.Timeout"
+#define DEFAULT_PORT       11211
+#define POINTS_PER_SERVER  160
+#define RETRY_INTERVAL     10000  // msecs
+#define MAX_KEY_LENGTH     250
+
+/*!
+  \class TMemcached
+  \brief The TMemcached class is a client of memcached servers, which
+  provide a cache shared by the application servers on several hosts.
+
+  Keys are distributed over the servers by consistent hashing, which is
+  compatible with the ketama algorithm, so adding or removing a server
+  moves only a part of the keys. A server failing to connect is skipped
+  for ten seconds, and its keys go to the next server on the hash ring.
+
+  The connections are kept open. An object must be used by only one
+  thread at a time; instance() returns the object checked out for the
+  current thread from a pool of the process, connected to the servers
+  specified by the Memcached.Servers setting.
+
+  The expiration is the number of seconds up to 30 days; the value 0
+  means that the item never expires.
+  \sa TSessionMemcachedStore
+*/
+
+struct TMemcached::Server
+{
+    QString host;
+    quint16 port;
+    QTcpSocket *socket;
+    qint64 retryTime;  // msecs since epoch
+};
+
+
+static inline quint32 ketamaPoint(const QByteArray &digest, int i)
+{
+    return ((quint32)(uchar)digest[3 + i * 4] << 24) | ((quint32)(uchar)digest[2 + i * 4] << 16)
+        | ((quint32)(uchar)digest[1 + i * 4] << 8) | (quint32)(uchar)digest[i * 4];
+}
+
+
+static bool isValidKey(const QByteArray &key)
+{
+    if (key.isEmpty() || key.length() > MAX_KEY_LENGTH)
+        return false;
+
+    for (int i = 0; i < key.length(); ++i) {
+        uchar c = (uchar)key.at(i);
+        if (c <= ' ' || c == 0x7F)
+            return false;
+    }
+    return true;
+}
+
+/*!
+  Constructor with the servers specified by the Memcached.Servers
+  setting.
+*/
+TMemcached::TMemcached()
+    : timeout(1000)
+{
+    QSettings &settings = Tf::app()->appSettings();
+    timeout = qMax(settings.value(MEMCACHED_TIMEOUT, 1000).toInt(), 1);
+    addServers(settings.value(MEMCACHED_SERVERS, "localhost:11211").toString().split(QLatin1Char(','), QString::SkipEmptyParts));
+}
+
+/*!
+  Constructor with the list of servers \a servers, each of which is in
+  the form of "host:port", and the timeout \a timeout in milliseconds of
+  each I/O operation.
+*/
+TMemcached::TMemcached(const QStringList &servers, int timeout)
+    : timeout(qMax(timeout, 1))
+{
+    addServers(servers);
+}
+
+
+TMemcached::~TMemcached()
+{
+    for (int i = 0; i < servers.count(); ++i) {
+        delete servers[i]->socket;
+        delete servers[i];
+    }
+}
+
+
+void TMemcached::addServers(const QStringList &list)
+{
+    for (QStringListIterator it(list); it.hasNext(); ) {
+        QString name = it.next().trimmed();
+        if (name.isEmpty())
+            continue;
+
+        Server *srv = new Server;
+        int idx = name.lastIndexOf(QLatin1Char(':'));
+        srv->host = (idx > 0) ? name.left(idx) : name;
+        srv->port = (idx > 0) ? name.mid(idx + 1).toUShort() : DEFAULT_PORT;
+        srv->socket = 0;
+        srv->retryTime = 0;
+        if (srv->port == 0) {
+            srv->port = DEFAULT_PORT;
+        }
+        servers << srv;
+
+        // Points on the ring
+        QByteArray prefix = (srv->host + QLatin1Char(':') + QString::number(srv->port) + QLatin1Char('-')).toLatin1();
+        for (int i = 0; i < POINTS_PER_SERVER / 4; ++i) {
+            QByteArray digest = QCryptographicHash::hash(prefix + QByteArray::number(i), QCryptographicHash::Md5);
+            for (int j = 0; j < 4; ++j) {
+                ring.insert(ketamaPoint(digest, j), servers.count() - 1);
+            }
+        }
+    }
+
+    if (servers.isEmpty()) {
+        tSystemError("No memcached server specified");
+    }
+}
+
+
+int TMemcached::serverIndex(const QByteArray &key) const
+{
+    if (servers.isEmpty())
+        return -1;
+
+    qint64 now = Tf::currentMSecsSinceEpoch();
+    if (servers.count() == 1)
+        return (servers[0]->retryTime <= now) ? 0 : -1;
+
+    quint32 point = ketamaPoint(QCryptographicHash::hash(key, QCryptographicHash::Md5), 0);
+    QMap<quint32, int>::const_iterator it = ring.lowerBound(point);
+
+    // Skips the failing servers
+    for (int i = 0; i < ring.count(); ++i, ++it) {
+        if (it == ring.constEnd()) {
+            it = ring.constBegin();
+        }
+        if (servers[it.value()]->retryTime <= now)
+            return it.value();
+    }
+    return -1;
+}
+
+/*!
+  Returns the name of the server, in the form of "host:port", that the
+  key \a key is stored in.
+*/
+QString TMemcached::serverName(const QByteArray &key) const
+{
+    int idx = serverIndex(key);
+    if (idx < 0)
+        return QString();
+
+    return servers[idx]->host + QLatin1Char(':') + QString::number(servers[idx]->port);
+}
+
+
+QTcpSocket *TMemcached::connection(int index)
+{
+    if (index < 0)
+        return 0;
+
+    Server *srv = servers[index];
+    if (srv->socket && srv->socket->state() == QAbstractSocket::ConnectedState)
+        return srv->socket;
+
+    if (!srv->socket) {
+        srv->socket = new QTcpSocket;
+    }
+
+    srv->socket->abort();
+    srv->socket->connectToHost(srv->host, srv->port);
+    if (!srv->socket->waitForConnected(timeout)) {
+        tSystemError("memcached connection failed: %s:%d  %s", qPrintable(srv->host), srv->port, qPrintable(srv->socket->errorString()));
+        disconnect(index);
+        return 0;
+    }
+
+    srv->socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    srv->retryTime = 0;
+    return srv->socket;
+}
+
+
+QTcpSocket *TMemcached::connection(const QByteArray &key, int &index)
+{
+    // Fails over to the next server on the ring; a server failing to
+    // connect is skipped by serverIndex() until the retry time
+    for (int i = 0; i < servers.count(); ++i) {
+        index = serverIndex(key);
+        if (index < 0)
+            break;
+
+        QTcpSocket *socket = connection(index);
+        if (socket)
+            return socket;
+    }
+    index = -1;
+    return 0;
+}
+
+
+void TMemcached::disconnect(int index)
+{
+    // The state of the protocol is unknown
+    servers[index]->socket->abort();
+    servers[index]->retryTime = Tf::currentMSecsSinceEpoch() + RETRY_INTERVAL;
+}
+
+
+bool TMemcached::write(QTcpSocket *socket, const QByteArray &command)
+{
+    if (socket->write(command) != command.length())
+        return false;
+
+    socket->flush();
+    return true;
+}
+
+
+bool TMemcached::readLine(QTcpSocket *socket, QByteArray &line)
+{
+    while (!socket->canReadLine()) {
+        if (!socket->waitForReadyRead(timeout)) {
+            tSystemError("memcached read error: %s", qPrintable(socket->errorString()));
+            return false;
+        }
+    }
+
+    line = socket->readLine();
+    if (!line.endsWith("\r\n"))
+        return false;
+
+    line.chop(2);
+    return true;
+}
+
+
+bool TMemcached::readValues(QTcpSocket *socket, QHash<QByteArray, QByteArray> &values)
+{
+    QByteArray line;
+
+    for (;;) {
+        if (!readLine(socket, line))
+            return false;
+
+        if (line == "END")
+            return true;
+
+        // VALUE <key> <flags> <bytes> [<cas unique>]
+        QList<QByteArray> tokens = line.split(' ');
+        if (tokens.count() < 4 || tokens[0] != "VALUE") {
+            tSystemError("memcached error: %s", line.data());
+            return false;
+        }
+
+        bool ok;
+        int len = tokens[3].toInt(&ok);
+        if (!ok || len < 0)
+            return false;
+
+        while (socket->bytesAvailable() < len + 2) {
+            if (!socket->waitForReadyRead(timeout))
+                return false;
+        }
+
+        QByteArray data = socket->read(len);
+        if (socket->read(2) != "\r\n")
+            return false;
+
+        values.insert(tokens[1], data);
+    }
+}
+
+
+QByteArray TMemcached::request(const QByteArray &key, const QByteArray &command)
+{
+    int idx;
+    QTcpSocket *socket = connection(key, idx);
+    QByteArray reply;
+
+    if (socket && !(write(socket, command) && readLine(socket, reply))) {
+        disconnect(idx);
+        reply.clear();
+    }
+    return reply;
+}
+
+
+QByteArray TMemcached::retrieve(const QByteArray &key, const QByteArray &command, bool *found)
+{
+    QHash<QByteArray, QByteArray> values;
+
+    if (isValidKey(key)) {
+        int idx;
+        QTcpSocket *socket = connection(key, idx);
+        if (socket && !(write(socket, command) && readValues(socket, values))) {
+            disconnect(idx);
+            values.clear();
+        }
+    } else {
+        tSystemWarn("Invalid memcached key: %s", key.data());
+    }
+
+    if (found) {
+        *found = values.contains(key);
+    }
+    return values.value(key);
+}
+
+
+QByteArray TMemcached::storageCommand(const char *name, const QByteArray &key, const QByteArray &value, int expiration) const
+{
+    QByteArray cmd;
+    cmd.reserve(key.length() + value.length() + 64);
+    cmd += name;
+    cmd += ' ';
+    cmd += key;
+    cmd += " 0 ";
+    cmd += QByteArray::number(expiration);
+    cmd += ' ';
+    cmd += QByteArray::number(value.length());
+    cmd += "\r\n";
+    cmd += value;
+    cmd += "\r\n";
+    return cmd;
+}
+
+/*!
+  Returns the value associated with the key \a key. If \a found is not
+  0, it's set to true if the key is found; otherwise false.
+*/
+QByteArray TMemcached::get(const QByteArray &key, bool *found)
+{
+    return retrieve(key, "get " + key + "\r\n", found);
+}
+
+/*!
+  Returns the values associated with the keys \a keys; the keys not
+  found are not contained. The requests to the servers are sent at
+  once before reading the replies.
+*/
+QHash<QByteArray, QByteArray> TMemcached::get(const QList<QByteArray> &keys)
+{
+    QHash<QByteArray, QByteArray> values;
+    QMap<int, QByteArray> commands;
+
+    for (QListIterator<QByteArray> it(keys); it.hasNext(); ) {
+        const QByteArray &key = it.next();
+        if (!isValidKey(key)) {
+            tSystemWarn("Invalid memcached key: %s", key.data());
+            continue;
+        }
+
+        int idx = serverIndex(key);
+        if (idx >= 0) {
+            QByteArray &cmd = commands[idx];
+            cmd += (cmd.isEmpty()) ? "get " : " ";
+            cmd += key;
+        }
+    }
+
+    // Pipelines the requests to the servers
+    QList<int> sent;
+    for (QMapIterator<int, QByteArray> it(commands); it.hasNext(); ) {
+        it.next();
+        QTcpSocket *socket = connection(it.key());
+        if (socket) {
+            if (write(socket, it.value() + "\r\n")) {
+                sent << it.key();
+            } else {
+                disconnect(it.key());
+            }
+        }
+    }
+
+    for (QListIterator<int> it(sent); it.hasNext(); ) {
+        int idx = it.next();
+        if (!readValues(servers[idx]->socket, values)) {
+            disconnect(idx);
+        }
+    }
+    return values;
+}
+
+/*!
+  Returns the value associated with the key \a key, and updates the
+  expiration of the item to \a expiration in the same request. Requires
+  memcached 1.5.3 or later.
+*/
+QByteArray TMemcached::getAndTouch(const QByteArray &key, int expiration, bool *found)
+{
+    return retrieve(key, "gat " + QByteArray::number(expiration) + ' ' + key + "\r\n", found);
+}
+
+/*!
+  Stores the \a value associated with the key \a key. Returns true if
+  successful; otherwise returns false.
+*/
+bool TMemcached::set(const QByteArray &key, const QByteArray &value, int expiration)
+{
+    if (!isValidKey(key))
+        return false;
+
+    return request(key, storageCommand("set", key, value, expiration)) == "STORED";
+}
+
+/*!
+  Stores the \a items. The requests are pipelined; all of them are sent
+  to the servers before reading the replies. Returns the number of the
+  items stored.
+*/
+int TMemcached::set(const QHash<QByteArray, QByteArray> &items, int expiration)
+{
+    QMap<int, int> counts;  // requests sent to each server
+    QSet<int> failed;
+
+    for (QHashIterator<QByteArray, QByteArray> it(items); it.hasNext(); ) {
+        it.next();
+        if (!isValidKey(it.key()))
+            continue;
+
+        int idx = serverIndex(it.key());
+        if (failed.contains(idx))
+            continue;
+
+        QTcpSocket *socket = connection(idx);
+        if (socket && write(socket, storageCommand("set", it.key(), it.value(), expiration))) {
+            counts[idx]++;
+        } else if (idx >= 0) {
+            failed << idx;
+        }
+    }
+
+    int stored = 0;
+    for (QMapIterator<int, int> it(counts); it.hasNext(); ) {
+        it.next();
+        if (failed.contains(it.key())) {
+            disconnect(it.key());
+            continue;
+        }
+
+        QByteArray reply;
+        for (int i = 0; i < it.value(); ++i) {
+            if (!readLine(servers[it.key()]->socket, reply)) {
+                disconnect(it.key());
+                break;
+            }
+            if (reply == "STORED") {
+                ++stored;
+            }
+        }
+    }
+    return stored;
+}
+
+/*!
+  Stores the \a value associated with the key \a key only if the key is
+  not stored yet. Returns true if successful; otherwise returns false.
+*/
+bool TMemcached::add(const QByteArray &key, const QByteArray &value, int expiration)
+{
+    if (!isValidKey(key))
+        return false;
+
+    return request(key, storageCommand("add", key, value, expiration)) == "STORED";
+}
+
+/*!
+  Removes the item of the key \a key. Returns true if it's removed;
+  otherwise returns false.
+*/
+bool TMemcached::remove(const QByteArray &key)
+{
+    if (!isValidKey(key))
+        return false;
+
+    return request(key, "delete " + key + "\r\n") == "DELETED";
+}
+
+/*!
+  Updates the expiration of the item of the key \a key to \a expiration.
+  Returns true if successful; otherwise returns false.
+*/
+bool TMemcached::touch(const QByteArray &key, int expiration)
+{
+    if (!isValidKey(key))
+        return false;
+
+    return request(key, "touch " + key + ' ' + QByteArray::number(expiration) + "\r\n") == "TOUCHED";
+}
+
+/*!
+  Changes the thread affinity of the connections to \a thread. The
+  object must be moved to no thread, 0, before another thread uses it.
+*/
+void TMemcached::moveToThread(QThread *thread)
+{
+    for (int i = 0; i < servers.count(); ++i) {
+        if (servers[i]->socket) {
+            servers[i]->socket->moveToThread(thread);
+        }
+    }
+}
+
+/*!
+  Returns the client checked out for the current thread, connected to
+  the servers specified by the Memcached.Servers setting. It's given
+  back to the pool of the process when the thread exits, and its
+  connections are reused by another thread.
+*/
+TMemcached &TMemcached::instance()
+{
+    // Not deleted, since the thread data may outlive it
+    static TClientPool<TMemcached> *pool = new TClientPool<TMemcached>();
+    return pool->local();
+}
@@ -0,0 +1,57 @@
+#ifndef TMEMCACHED_H
+#define TMEMCACHED_H
+
+#include <QByteArray>
+#include <QStringList>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <TGlobal>
+
+class QTcpSocket;
+class QThread;
+
+
+class T_CORE_EXPORT TMemcached
+{
+public:
+    TMemcached();
+    TMemcached(const QStringList &servers, int timeout = 1000);
+    ~TMemcached();
+
+    QByteArray get(const QByteArray &key, bool *found = 0);
+    QHash<QByteArray, QByteArray> get(const QList<QByteArray> &keys);
+    QByteArray getAndTouch(const QByteArray &key, int expiration, bool *found = 0);
+    bool set(const QByteArray &key, const QByteArray &value, int expiration = 0);
+    int set(const QHash<QByteArray, QByteArray> &items, int expiration = 0);
+    bool add(const QByteArray &key, const QByteArray &value, int expiration = 0);
+    bool remove(const QByteArray &key);
+    bool touch(const QByteArray &key, int expiration);
+    QString serverName(const QByteArray &key) const;
+    void moveToThread(QThread *thread);
+
+    static TMemcached &instance();
+
+private:
+    struct Server;
+
+    void addServers(const QStringList &list);
+    int serverIndex(const QByteArray &key) const;
+    QTcpSocket *connection(int index);
+    QTcpSocket *connection(const QByteArray &key, int &index);
+    void disconnect(int index);
+    bool write(QTcpSocket *socket, const QByteArray &command);
+    bool readLine(QTcpSocket *socket, QByteArray &line);
+    bool readValues(QTcpSocket *socket, QHash<QByteArray, QByteArray> &values);
+    QByteArray request(const QByteArray &key, const QByteArray &command);
+    QByteArray retrieve(const QByteArray &key, const QByteArray &command, bool *found);
+    QByteArray storageCommand(const char *name, const QByteArray &key, const QByteArray &value, int expiration) const;
+
+    QList<Server *> servers;
+    QMap<quint32, int> ring;  // consistent hashing
+    int timeout;
+
+    Q_DISABLE_COPY(TMemcached)
+};
+
+#endif // TMEMCACHED_H
@@ -0,0 +1,100 @@
+/* Copyright (c) 2010-2012, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <QCoreApplication>
+#include <TGlobal>
+#include "tsystemglobal.h"
+#include "tprocessspinlock.h"
+#if defined(Q_OS_WIN)
+#include <qt_windows.h>
+#else
+#include <signal.h>
+#include <errno.h>
+#endif
+
+#define SPIN_COUNT  4096
+
+/*!
+  \class TProcessSpinLock
+  \brief The TProcessSpinLock class provides a spinlock on an atomic
+  integer in shared memory, which the processes of an application on a
+  host share.
+
+  The locked integer holds the process ID of the owner. A waiter spins
+  for a while and then sleeps; each time it wakes up it checks the
+  owner, and takes the lock over only if the owner process has died.
+  A lock held by a live process is never broken, however long it is
+  held. Internal use.
+*/
+
+/*!
+  Locks the spinlock \a word, waiting as long as it is held by a live
+  process. If the lock was taken over from a dead process, sets
+  \a recovered to true; the data it guards may be half-written.
+*/
+void TProcessSpinLock::lock(QBasicAtomicInt &word, bool *recovered)
+{
+    const int self = (int)QCoreApplication::applicationPid();
+    bool warned = false;
+
+    if (recovered)
+        *recovered = false;
+
+    for (;;) {
+        for (int i = 0; i < SPIN_COUNT; ++i) {
+            if (word.testAndSetAcquire(0, self))
+                return;
+        }
+
+        int owner = word.fetchAndAddOrdered(0);
+        if (owner != 0 && owner != self && !isProcessAlive(owner)) {
+            if (word.testAndSetAcquire(owner, self)) {
+                tSystemWarn("Spinlock recovered from dead process: %d", owner);
+                if (recovered)
+                    *recovered = true;
+                return;
+            }
+            continue;
+        }
+
+        if (!warned) {
+            tSystemDebug("Waiting for spinlock held by process: %d", owner);
+            warned = true;
+        }
+        Tf::msleep(1);
+    }
+}
+
+/*!
+  Unlocks the spinlock \a word.
+*/
+void TProcessSpinLock::unlock(QBasicAtomicInt &word)
+{
+    word.fetchAndStoreRelease(0);
+}
+
+/*!
+  Returns true if the process of the ID \a pid exists; otherwise
+  returns false.
+*/
+bool TProcessSpinLock::isProcessAlive(qint64 pid)
+{
+    if (pid <= 0)
+        return false;
+
+#if defined(Q_OS_WIN)
+    HANDLE handle = ::OpenProcess(SYNCHRONIZE, FALSE, (DWORD)pid);
+    if (!handle)
+        return (::GetLastError() == ERROR_ACCESS_DENIED);
+
+    bool alive = (::WaitForSingleObject(handle, 0) == WAIT_TIMEOUT);
+    ::CloseHandle(handle);
+    return alive;
+#else
+    return (::kill((pid_t)pid, 0) == 0 || errno == EPERM);
+#endif
+}
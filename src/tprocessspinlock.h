@@ -0,0 +1,16 @@
+#ifndef TPROCESSSPINLOCK_H
+#define TPROCESSSPINLOCK_H
+
+#include <QAtomicInt>
+#include <TGlobal>
+
+
+class T_CORE_EXPORT TProcessSpinLock
+{
+public:
+    static void lock(QBasicAtomicInt &word, bool *recovered = 0);
+    static void unlock(QBasicAtomicInt &word);
+    static bool isProcessAlive(qint64 pid);
+};
+
+#endif // TPROCESSSPINLOCK_H
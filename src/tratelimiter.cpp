@@ -0,0 +1,270 @@
+/* Copyright (c) 2010-2012, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <QSharedMemory>
+#include <QHostAddress>
+#include <QFile>
+#include <THttpRequest>
+#include <THttpUtility>
+#include <TWebApplication>
+#include <TSession>
+#include "tsystemglobal.h"
+#include "tratelimiter.h"
+#include "tprocessspinlock.h"
+
+#define RATE_LIMIT_ENABLE  "RateLimit.Enable"
+#define RATE_LIMIT_RATE    "RateLimit.Rate"
+#define RATE_LIMIT_BURST   "RateLimit.Burst"
+#define RATE_LIMIT_KEY     "RateLimit.Key"
+#define RATE_LIMIT_TABLE   "RateLimit.TableSize"
+#define CREATE_KEY         "TreeFrogRateLimit"
+#define PROBE_LIMIT        8
+
+/*!
+  \class TRateLimiter
+  \brief The TRateLimiter class limits the request rate of each client
+  by the token bucket algorithm.
+
+  The buckets are stored in an open addressing hash table in shared
+  memory, so all the threads and the prefork processes of an application
+  on a host share the same counts. Each bucket is guarded by its own
+  TProcessSpinLock; no system-wide lock is taken. Internal use.
+*/
+
+struct Bucket
+{
+    QBasicAtomicInt lock;
+    qint32 reserved;
+    quint64 keyHash;   // 0 means empty
+    qint64 timestamp;  // msecs since epoch of the last refill
+    qint64 tokens;     // in thousandths
+};
+
+static TRateLimiter *rateLimiter = 0;
+
+
+static void cleanup()
+{
+    if (rateLimiter) {
+        delete rateLimiter;
+        rateLimiter = 0;
+    }
+}
+
+
+static inline quint64 hashKey(const QByteArray &key)
+{
+    // 64-bit FNV-1a
+    quint64 h = Q_UINT64_C(14695981039346656037);
+    for (const char *p = key.constData(), *end = p + key.size(); p < end; ++p) {
+        h ^= (uchar)*p;
+        h *= Q_UINT64_C(1099511628211);
+    }
+    return (h) ? h : 1;
+}
+
+
+static inline void lockBucket(Bucket *bucket)
+{
+    bool recovered;
+    TProcessSpinLock::lock(bucket->lock, &recovered);
+    if (recovered) {
+        bucket->keyHash = 0;  // may be half-written by the dead owner
+    }
+}
+
+
+static inline void unlockBucket(Bucket *bucket)
+{
+    TProcessSpinLock::unlock(bucket->lock);
+}
+
+
+TRateLimiter::TRateLimiter()
+    : shareMem(0), bucketCount(0), rate(0), burst(0), keyType(RemoteAddress)
+{
+    QSettings &settings = Tf::app()->appSettings();
+    rate = qMax(settings.value(RATE_LIMIT_RATE, 10).toLongLong(), Q_INT64_C(1));
+    burst = qMax(settings.value(RATE_LIMIT_BURST, 20).toLongLong(), Q_INT64_C(1));
+    bucketCount = qMax(settings.value(RATE_LIMIT_TABLE, 65536).toInt(), PROBE_LIMIT);
+
+    QString key = settings.value(RATE_LIMIT_KEY).toString().trimmed();
+    if (key.startsWith(QLatin1String("header:"), Qt::CaseInsensitive)) {
+        keyType = Header;
+        headerName = key.mid(7).trimmed().toLatin1();
+    } else if (key.compare(QLatin1String("session"), Qt::CaseInsensitive) == 0) {
+        keyType = Session;
+    } else {
+        keyType = RemoteAddress;
+    }
+
+    // Precomputed response body
+    QFile html(Tf::app()->publicPath() + QString::number(Tf::TooManyRequests) + ".html");
+    if (html.exists() && html.open(QIODevice::ReadOnly)) {
+        rejectBody = html.readAll();
+        html.close();
+    }
+    if (rejectBody.isEmpty()) {
+        rejectBody  = "<html><body>";
+        rejectBody += THttpUtility::getResponseReasonPhrase(Tf::TooManyRequests);
+        rejectBody += " (429)</body></html>";
+    }
+}
+
+
+TRateLimiter::~TRateLimiter()
+{
+    delete shareMem;
+}
+
+
+bool TRateLimiter::attach()
+{
+    // One table per application on the host
+    QString memKey = QLatin1String(CREATE_KEY) + QLatin1Char('_') + QString::number(qHash(Tf::app()->webRootPath()));
+    shareMem = new QSharedMemory(memKey);
+
+    if (shareMem->create(bucketCount * sizeof(Bucket))) {
+        // Zero-filled by the system
+        tSystemDebug("Rate limit table created: %d buckets", bucketCount);
+    } else {
+        if (shareMem->error() != QSharedMemory::AlreadyExists || !shareMem->attach()) {
+            tSystemError("Shared memory error: %s", qPrintable(shareMem->errorString()));
+            return false;
+        }
+        bucketCount = shareMem->size() / sizeof(Bucket);
+    }
+    return bucketCount > 0;
+}
+
+/*!
+  Takes a token from the bucket of the key \a key. Returns true if the
+  request is allowed; otherwise returns false and sets the number of
+  seconds until a token is available into \a retryAfter.
+*/
+bool TRateLimiter::allow(const QByteArray &key, int *retryAfter)
+{
+    const quint64 h = hashKey(key);
+    const qint64 now = Tf::currentMSecsSinceEpoch();
+    const qint64 capacity = burst * 1000;
+    const qint64 refillTime = capacity / rate;  // msecs to fill up an empty bucket
+    Bucket *buckets = static_cast<Bucket *>(shareMem->data());
+    Bucket *bucket = 0;
+
+    int idx = h % bucketCount;
+    Bucket *vacant = 0;
+    for (int i = 0; i < PROBE_LIMIT; ++i) {
+        Bucket *b = &buckets[(idx + i) % bucketCount];
+        lockBucket(b);
+        if (b->keyHash == h) {
+            bucket = b;
+            break;
+        }
+
+        // Empty, or full enough to be reused by another key
+        if (!vacant && (b->keyHash == 0 || now - b->timestamp >= refillTime)) {
+            vacant = b;
+        }
+        unlockBucket(b);
+    }
+
+    if (!bucket && vacant) {
+        lockBucket(vacant);
+        if (vacant->keyHash == h) {
+            bucket = vacant;  // taken by another thread for the same key
+        } else if (vacant->keyHash == 0 || now - vacant->timestamp >= refillTime) {
+            vacant->keyHash = h;
+            vacant->timestamp = now;
+            vacant->tokens = capacity;
+            bucket = vacant;
+        } else {
+            unlockBucket(vacant);
+        }
+    }
+
+    if (!bucket) {
+        // The table is crowded here; never rejects
+        return true;
+    }
+
+    qint64 elapsed = now - bucket->timestamp;
+    if (elapsed > 0) {
+        bucket->tokens = qMin(capacity, bucket->tokens + elapsed * rate);
+        bucket->timestamp = now;
+    }
+
+    bool ret = (bucket->tokens >= 1000);
+    if (ret) {
+        bucket->tokens -= 1000;
+    } else if (retryAfter) {
+        *retryAfter = (int)(((1000 - bucket->tokens) / rate + 999) / 1000);
+        *retryAfter = qMax(*retryAfter, 1);
+    }
+    unlockBucket(bucket);
+    return ret;
+}
+
+/*!
+  Returns the key of the bucket for the request \a request from the
+  remote address \a remoteAddress, according to the RateLimit.Key
+  setting. The session cookie or the header falls back on the remote
+  address if it's not sent.
+*/
+QByteArray TRateLimiter::key(const THttpRequest &request, const QHostAddress &remoteAddress) const
+{
+    QByteArray ret;
+
+    switch (keyType) {
+    case Session:
+        ret = request.cookie(TSession::sessionName());
+        break;
+
+    case Header:
+        ret = request.header().rawHeader(headerName);
+        break;
+
+    default:
+        break;
+    }
+
+    if (ret.isEmpty()) {
+        if (remoteAddress.protocol() == QAbstractSocket::IPv4Protocol) {
+            quint32 addr = remoteAddress.toIPv4Address();
+            ret = QByteArray((const char *)&addr, sizeof(addr));
+        } else {
+            Q_IPV6ADDR addr = remoteAddress.toIPv6Address();
+            ret = QByteArray((const char *)&addr, sizeof(addr));
+        }
+    }
+    return ret;
+}
+
+/*!
+ * Initializes if the RateLimit.Enable setting is true.
+ * Call this in main thread.
+ */
+void TRateLimiter::instantiate()
+{
+    if (!rateLimiter && Tf::app()->appSettings().value(RATE_LIMIT_ENABLE, false).toBool()) {
+        rateLimiter = new TRateLimiter();
+        if (!rateLimiter->attach()) {
+            tSystemError("Rate limiting disabled");
+            delete rateLimiter;
+            rateLimiter = 0;
+            return;
+        }
+        qAddPostRoutine(cleanup);
+    }
+}
+
+/*!
+  Returns the rate limiter, or 0 if the rate limiting is disabled.
+*/
+TRateLimiter *TRateLimiter::instance()
+{
+    return rateLimiter;
+}
@@ -0,0 +1,44 @@
+#ifndef TRATELIMITER_H
+#define TRATELIMITER_H
+
+#include <QByteArray>
+#include <TGlobal>
+
+class QSharedMemory;
+class QHostAddress;
+class THttpRequest;
+
+
+class T_CORE_EXPORT TRateLimiter
+{
+public:
+    enum KeyType {
+        RemoteAddress = 0,
+        Session,
+        Header,
+    };
+
+    ~TRateLimiter();
+    bool allow(const QByteArray &key, int *retryAfter = 0);
+    QByteArray key(const THttpRequest &request, const QHostAddress &remoteAddress) const;
+    const QByteArray &rejectionBody() const { return rejectBody; }
+
+    static void instantiate();
+    static TRateLimiter *instance();
+
+private:
+    TRateLimiter();
+    bool attach();
+
+    QSharedMemory *shareMem;
+    int bucketCount;
+    qint64 rate;      // tokens per second
+    qint64 burst;
+    KeyType keyType;
+    QByteArray headerName;
+    QByteArray rejectBody;
+
+    Q_DISABLE_COPY(TRateLimiter)
+};
+
+#endif // TRATELIMITER_H
@@ -0,0 +1,338 @@
+/* Copyright (c) 2010-2012, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <QTcpSocket>
+#include <TWebApplication>
+#include <TRedis>
+#include "tsystemglobal.h"
+#include "tclientpool.h"
+
+#define REDIS_SERVER    "Redis.Server"
+#define REDIS_TIMEOUT   "Redis.Timeout"
+#define DEFAULT_PORT    6379
+#define RETRY_INTERVAL  10000  // msecs
+
+/*!
+  \class TRedis
+  \brief The TRedis class is a client of a Redis server, speaking the
+  Redis serialization protocol (RESP).
+
+  The connection is kept open and is reconnected on demand; after a
+  failure to connect, the server is not tried again for ten seconds.
+  An object must be used by only one thread at a time; instance()
+  returns the object checked out for the current thread from a pool of
+  the process, connected to the server specified by the Redis.Server
+  setting.
+
+  Replies are converted to QVariant; bulk and simple strings become
+  QByteArray, integers qlonglong, arrays QVariantList, and nulls and
+  errors invalid QVariant.
+  \sa TSessionRedisStore
+*/
+
+static QByteArray encodeCommand(const QList<QByteArray> &args)
+{
+    QByteArray cmd;
+    cmd += '*';
+    cmd += QByteArray::number(args.count());
+    cmd += "\r\n";
+    for (QListIterator<QByteArray> it(args); it.hasNext(); ) {
+        const QByteArray &arg = it.next();
+        cmd += '$';
+        cmd += QByteArray::number(arg.length());
+        cmd += "\r\n";
+        cmd += arg;
+        cmd += "\r\n";
+    }
+    return cmd;
+}
+
+/*!
+  Constructor with the server specified by the Redis.Server setting.
+*/
+TRedis::TRedis()
+    : port(DEFAULT_PORT), timeout(1000), socket(0), retryTime(0)
+{
+    QSettings &settings = Tf::app()->appSettings();
+    timeout = qMax(settings.value(REDIS_TIMEOUT, 1000).toInt(), 1);
+    init(settings.value(REDIS_SERVER, "localhost:6379").toString());
+}
+
+/*!
+  Constructor with the server \a server in the form of "host:port", and
+  the timeout \a timeout in milliseconds of each I/O operation.
+*/
+TRedis::TRedis(const QString &server, int timeout)
+    : port(DEFAULT_PORT), timeout(qMax(timeout, 1)), socket(0), retryTime(0)
+{
+    init(server);
+}
+
+
+TRedis::~TRedis()
+{
+    delete socket;
+}
+
+
+void TRedis::init(const QString &server)
+{
+    QString name = server.trimmed();
+    int idx = name.lastIndexOf(QLatin1Char(':'));
+    host = (idx > 0) ? name.left(idx) : name;
+    if (idx > 0) {
+        port = name.mid(idx + 1).toUShort();
+        if (port == 0) {
+            port = DEFAULT_PORT;
+        }
+    }
+}
+
+
+bool TRedis::connectToServer()
+{
+    if (socket && socket->state() == QAbstractSocket::ConnectedState)
+        return true;
+
+    if (retryTime > Tf::currentMSecsSinceEpoch())
+        return false;
+
+    if (!socket) {
+        socket = new QTcpSocket;
+    }
+
+    socket->abort();
+    socket->connectToHost(host, port);
+    if (!socket->waitForConnected(timeout)) {
+        tSystemError("Redis connection failed: %s:%d  %s", qPrintable(host), port, qPrintable(socket->errorString()));
+        disconnect();
+        return false;
+    }
+
+    socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    retryTime = 0;
+    return true;
+}
+
+
+void TRedis::disconnect()
+{
+    // The state of the protocol is unknown
+    socket->abort();
+    retryTime = Tf::currentMSecsSinceEpoch() + RETRY_INTERVAL;
+}
+
+
+bool TRedis::readLine(QByteArray &line)
+{
+    while (!socket->canReadLine()) {
+        if (!socket->waitForReadyRead(timeout)) {
+            tSystemError("Redis read error: %s", qPrintable(socket->errorString()));
+            return false;
+        }
+    }
+
+    line = socket->readLine();
+    if (!line.endsWith("\r\n"))
+        return false;
+
+    line.chop(2);
+    return true;
+}
+
+
+bool TRedis::readReply(QVariant &reply)
+{
+    QByteArray line;
+    if (!readLine(line) || line.isEmpty())
+        return false;
+
+    char type = line.at(0);
+    line.remove(0, 1);
+    reply = QVariant();
+
+    switch (type) {
+    case '+':
+        reply = line;
+        return true;
+
+    case '-':
+        tSystemError("Redis error: %s", line.data());
+        return true;
+
+    case ':': {
+        bool ok;
+        qlonglong n = line.toLongLong(&ok);
+        if (ok) {
+            reply = n;
+        }
+        return ok; }
+
+    case '$': {
+        bool ok;
+        int len = line.toInt(&ok);
+        if (!ok)
+            return false;
+
+        if (len < 0)
+            return true;  // null
+
+        while (socket->bytesAvailable() < len + 2) {
+            if (!socket->waitForReadyRead(timeout))
+                return false;
+        }
+        reply = socket->read(len);
+        return socket->read(2) == "\r\n"; }
+
+    case '*': {
+        bool ok;
+        int count = line.toInt(&ok);
+        if (!ok)
+            return false;
+
+        if (count < 0)
+            return true;  // null
+
+        QVariantList list;
+        for (int i = 0; i < count; ++i) {
+            QVariant v;
+            if (!readReply(v))
+                return false;
+            list << v;
+        }
+        reply = list;
+        return true; }
+
+    default:
+        tSystemError("Invalid Redis reply: %c", type);
+        return false;
+    }
+}
+
+/*!
+  Sends the \a commands at once, and returns the replies in the same
+  order. Each command is a list of the arguments, beginning with the
+  name of the command. If the server is unavailable, returns an empty
+  list.
+*/
+QList<QVariant> TRedis::pipeline(const QList<QList<QByteArray> > &commands)
+{
+    QList<QVariant> replies;
+    if (commands.isEmpty() || !connectToServer())
+        return replies;
+
+    QByteArray buf;
+    for (int i = 0; i < commands.count(); ++i) {
+        buf += encodeCommand(commands[i]);
+    }
+
+    if (socket->write(buf) != buf.length()) {
+        disconnect();
+        return replies;
+    }
+    socket->flush();
+
+    for (int i = 0; i < commands.count(); ++i) {
+        QVariant reply;
+        if (!readReply(reply)) {
+            disconnect();
+            return QList<QVariant>();
+        }
+        replies << reply;
+    }
+    return replies;
+}
+
+/*!
+  Returns the value of the key \a key. If \a found is not 0, it's set to
+  true if the key is found; otherwise false.
+*/
+QByteArray TRedis::get(const QByteArray &key, bool *found)
+{
+    QList<QList<QByteArray> > cmds;
+    cmds << (QList<QByteArray>() << "GET" << key);
+
+    QVariant reply = pipeline(cmds).value(0);
+    if (found) {
+        *found = reply.isValid();
+    }
+    return reply.toByteArray();
+}
+
+/*!
+  Returns the value of the key \a key, and sets the timeout of the key
+  to \a seconds in the same round trip.
+*/
+QByteArray TRedis::getAndExpire(const QByteArray &key, int seconds, bool *found)
+{
+    QList<QList<QByteArray> > cmds;
+    cmds << (QList<QByteArray>() << "GET" << key)
+         << (QList<QByteArray>() << "EXPIRE" << key << QByteArray::number(seconds));
+
+    QVariant reply = pipeline(cmds).value(0);
+    if (found) {
+        *found = reply.isValid();
+    }
+    return reply.toByteArray();
+}
+
+/*!
+  Sets the key \a key to hold the \a value with the timeout of \a seconds.
+  Returns true if successful; otherwise returns false.
+*/
+bool TRedis::setEx(const QByteArray &key, const QByteArray &value, int seconds)
+{
+    QList<QList<QByteArray> > cmds;
+    cmds << (QList<QByteArray>() << "SETEX" << key << QByteArray::number(qMax(seconds, 1)) << value);
+    return pipeline(cmds).value(0).toByteArray() == "OK";
+}
+
+/*!
+  Sets the timeout of the key \a key to \a seconds. Returns true if the
+  key exists; otherwise returns false.
+*/
+bool TRedis::expire(const QByteArray &key, int seconds)
+{
+    QList<QList<QByteArray> > cmds;
+    cmds << (QList<QByteArray>() << "EXPIRE" << key << QByteArray::number(seconds));
+    return pipeline(cmds).value(0).toLongLong() == 1;
+}
+
+/*!
+  Removes the key \a key. Returns true if it's removed; otherwise
+  returns false.
+*/
+bool TRedis::remove(const QByteArray &key)
+{
+    QList<QList<QByteArray> > cmds;
+    cmds << (QList<QByteArray>() << "DEL" << key);
+    return pipeline(cmds).value(0).toLongLong() == 1;
+}
+
+/*!
+  Changes the thread affinity of the connection to \a thread. The
+  object must be moved to no thread, 0, before another thread uses it.
+*/
+void TRedis::moveToThread(QThread *thread)
+{
+    if (socket) {
+        socket->moveToThread(thread);
+    }
+}
+
+/*!
+  Returns the client checked out for the current thread, connected to
+  the server specified by the Redis.Server setting. It's given back to
+  the pool of the process when the thread exits, and its connection is
+  reused by another thread.
+*/
+TRedis &TRedis::instance()
+{
+    // Not deleted, since the thread data may outlive it
+    static TClientPool<TRedis> *pool = new TClientPool<TRedis>();
+    return pool->local();
+}
@@ -0,0 +1,46 @@
+#ifndef TREDIS_H
+#define TREDIS_H
+
+#include <QByteArray>
+#include <QList>
+#include <QVariant>
+#include <TGlobal>
+
+class QTcpSocket;
+class QThread;
+
+
+class T_CORE_EXPORT TRedis
+{
+public:
+    TRedis();
+    TRedis(const QString &server, int timeout = 1000);
+    ~TRedis();
+
+    QByteArray get(const QByteArray &key, bool *found = 0);
+    QByteArray getAndExpire(const QByteArray &key, int seconds, bool *found = 0);
+    bool setEx(const QByteArray &key, const QByteArray &value, int seconds);
+    bool expire(const QByteArray &key, int seconds);
+    bool remove(const QByteArray &key);
+    QList<QVariant> pipeline(const QList<QList<QByteArray> > &commands);
+    void moveToThread(QThread *thread);
+
+    static TRedis &instance();
+
+private:
+    void init(const QString &server);
+    bool connectToServer();
+    void disconnect();
+    bool readLine(QByteArray &line);
+    bool readReply(QVariant &reply);
+
+    QString host;
+    quint16 port;
+    int timeout;
+    QTcpSocket *socket;
+    qint64 retryTime;
+
+    Q_DISABLE_COPY(TRedis)
+};
+
+#endif // TREDIS_H
@@ -0,0 +1,195 @@
+/* Copyright (c) 2010-2012, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QTime>
+#include <QStringList>
+#include <THttpRequest>
+#include <TWebApplication>
+#include "tsystemglobal.h"
+#include "trequestcoalescer.h"
+
+#define KEY_HEADERS   "RequestCoalescing.KeyHeaders"
+#define WAIT_TIMEOUT  "RequestCoalescing.WaitTimeout"
+
+/*!
+  \class TRequestCoalescer
+  \brief The TRequestCoalescer class coalesces identical requests
+  processed concurrently into one execution of the action.
+
+  The first request for a key becomes the leader and runs the action;
+  the requests which arrive while it is in flight wait for the leader
+  and receive a copy of its response. Internal use.
+  \sa TActionController::requestCoalescingEnabled()
+*/
+
+class TRequestCoalescer::Flight
+{
+public:
+    Flight(const QByteArray &k) : key(k), done(false), success(false), waiters(0) { }
+
+    QByteArray key;
+    QWaitCondition cond;
+    bool done;
+    bool success;
+    int waiters;
+    THttpResponseHeader header;
+    QByteArray body;
+};
+
+
+/*!
+  Constructor. The requests wait for the leader up to \a waitTimeout
+  milliseconds, and the headers \a keyHeaders are part of the key.
+*/
+TRequestCoalescer::TRequestCoalescer(int waitTimeout, const QList<QByteArray> &keyHeaders)
+    : keyHeaders(keyHeaders), waitTimeout(qMax(waitTimeout, 1))
+{
+    // Conditional requests are answered differently
+    this->keyHeaders << "If-None-Match" << "If-Modified-Since";
+}
+
+/*!
+  Joins the flight for the key \a key. If no request for the key is in
+  flight, a new flight is started and \a leader is set to true; the
+  caller must end it by finish() or abandon(). Otherwise \a leader is
+  set to false and the caller must call wait().
+*/
+TRequestCoalescer::Flight *TRequestCoalescer::join(const QByteArray &key, bool &leader)
+{
+    QMutexLocker locker(&mutex);
+    Flight *flight = flights.value(key);
+    leader = !flight;
+
+    if (leader) {
+        flight = new Flight(key);
+        flights.insert(key, flight);
+    } else {
+        flight->waiters++;
+    }
+    return flight;
+}
+
+/*!
+  Waits for the leader of the \a flight to finish, and copies its
+  response into \a header and \a body. Returns false if the leader
+  abandoned the flight or it timed out, in which case the caller should
+  process the request by itself.
+*/
+bool TRequestCoalescer::wait(Flight *flight, THttpResponseHeader &header, QByteArray &body)
+{
+    QMutexLocker locker(&mutex);
+    QTime timer;
+    timer.start();
+
+    while (!flight->done) {
+        int remaining = waitTimeout - timer.elapsed();
+        if (remaining <= 0 || !flight->cond.wait(&mutex, (ulong)remaining)) {
+            tSystemWarn("Request coalescing timed out: %s", flight->key.data());
+            break;
+        }
+    }
+
+    bool ret = flight->done && flight->success;
+    if (ret) {
+        header = flight->header;
+        body = flight->body;
+    }
+
+    // The last one of a finished flight deletes it
+    if (--flight->waiters == 0 && flight->done) {
+        delete flight;
+    }
+    return ret;
+}
+
+/*!
+  Ends the \a flight as the leader and passes the response, \a header
+  and \a body, to the requests waiting for it.
+*/
+void TRequestCoalescer::finish(Flight *flight, const THttpResponseHeader &header, const QByteArray &body)
+{
+    complete(flight, true, header, body);
+}
+
+/*!
+  Ends the \a flight without a response to share.
+*/
+void TRequestCoalescer::abandon(Flight *flight)
+{
+    complete(flight, false, THttpResponseHeader(), QByteArray());
+}
+
+
+void TRequestCoalescer::complete(Flight *flight, bool success, const THttpResponseHeader &header, const QByteArray &body)
+{
+    QMutexLocker locker(&mutex);
+    flights.remove(flight->key);
+
+    if (flight->waiters == 0) {
+        delete flight;
+        return;
+    }
+
+    flight->success = success;
+    if (success) {
+        flight->header = header;
+        flight->header.removeAllRawHeaders("Set-Cookie");  // never shares cookies
+        flight->body = body;
+    }
+    flight->done = true;
+    flight->cond.wakeAll();
+}
+
+/*!
+  Returns the coalescing key of the request \a request, which consists
+  of the method, the path including the query and the headers specified
+  by the RequestCoalescing.KeyHeaders setting.
+*/
+QByteArray TRequestCoalescer::key(const THttpRequest &request) const
+{
+    const THttpRequestHeader &hdr = request.header();
+    QByteArray key;
+    key.reserve(256);
+    key += hdr.method();
+    key += ' ';
+    key += hdr.path();
+
+    for (QListIterator<QByteArray> it(keyHeaders); it.hasNext(); ) {
+        const QByteArray &name = it.next();
+        key += '\n';
+        key += hdr.rawHeader(name);
+    }
+    return key;
+}
+
+static QList<QByteArray> keyHeadersSetting()
+{
+    QList<QByteArray> headers;
+    QStringList names = Tf::app()->appSettings().value(KEY_HEADERS).toString().split(QLatin1Char(','), QString::SkipEmptyParts);
+    for (QStringListIterator it(names); it.hasNext(); ) {
+        headers << it.next().trimmed().toLatin1();
+    }
+    return headers;
+}
+
+
+static int waitTimeoutSetting()
+{
+    int timeout = Tf::app()->appSettings().value(WAIT_TIMEOUT).toInt();
+    return (timeout > 0) ? timeout : 30000;
+}
+
+/*!
+  Returns a global instance.
+*/
+TRequestCoalescer &TRequestCoalescer::instance()
+{
+    static TRequestCoalescer coalescer(waitTimeoutSetting(), keyHeadersSetting());
+    return coalescer;
+}
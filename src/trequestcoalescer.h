@@ -0,0 +1,39 @@
+#ifndef TREQUESTCOALESCER_H
+#define TREQUESTCOALESCER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <TGlobal>
+#include <THttpResponseHeader>
+
+class THttpRequest;
+
+
+class T_CORE_EXPORT TRequestCoalescer
+{
+public:
+    class Flight;
+
+    TRequestCoalescer(int waitTimeout = 30000, const QList<QByteArray> &keyHeaders = QList<QByteArray>());
+    Flight *join(const QByteArray &key, bool &leader);
+    bool wait(Flight *flight, THttpResponseHeader &header, QByteArray &body);
+    void finish(Flight *flight, const THttpResponseHeader &header, const QByteArray &body);
+    void abandon(Flight *flight);
+    QByteArray key(const THttpRequest &request) const;
+
+    static TRequestCoalescer &instance();
+
+private:
+    void complete(Flight *flight, bool success, const THttpResponseHeader &header, const QByteArray &body);
+
+    QMutex mutex;
+    QHash<QByteArray, Flight *> flights;
+    QList<QByteArray> keyHeaders;
+    int waitTimeout;
+
+    Q_DISABLE_COPY(TRequestCoalescer)
+};
+
+#endif // TREQUESTCOALESCER_H
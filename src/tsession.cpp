@@ -31,6 +31,18 @@ void TSession::reset()
 }
 
 
+/*!
+  Returns true if the session has been modified since it was loaded
+  from the session store; otherwise returns false.
+ */
+bool TSession::isModified() const
+{
+    const QVariantHash &current = *this;
+    // Any non-const access detaches the data, so compares them only then
+    return !current.isSharedWith(initialData) && current != initialData;
+}
+
+
 /*!
   Returns the session name specified by the \a application.ini file.
  */
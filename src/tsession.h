@@ -3,6 +3,7 @@
 
 #include <QVariant>
 #include <QByteArray>
+#include <QDateTime>
 #include <TGlobal>
 
 
@@ -15,14 +16,24 @@ public:
 
     QByteArray id() const { return sessionId; }
     void reset();
+    bool isModified() const;
 
     static QByteArray sessionName();
 
 private:
     QByteArray sessionId;
+    QVariantHash initialData;  // as loaded from the store
+    QDateTime updatedTime;     // when the store last saved it
 
     void clear() {} // disabled
     friend class TSessionCookieStore;
+    friend class TSessionFileStore;
+    friend class TSessionSqlObjectStore;
+    friend class TSessionMemoryStore;
+    friend class TSessionSharedMemoryStore;
+    friend class TSessionMemcachedStore;
+    friend class TSessionRedisStore;
+    friend class TSessionManager;
     friend class TActionContext;
 };
 
@@ -32,13 +43,16 @@ inline TSession::TSession(const QByteArray &id)
 { }
 
 inline TSession::TSession(const TSession &session)
-    : QVariantHash(*static_cast<const QVariantHash *>(&session)), sessionId(session.sessionId)
+    : QVariantHash(*static_cast<const QVariantHash *>(&session)), sessionId(session.sessionId),
+      initialData(session.initialData), updatedTime(session.updatedTime)
 { }
 
 inline TSession &TSession::operator=(const TSession &session)
 {
     QVariantHash::operator=(*static_cast<const QVariantHash *>(&session));
     sessionId = session.sessionId;
+    initialData = session.initialData;
+    updatedTime = session.updatedTime;
     return *this;
 }
 
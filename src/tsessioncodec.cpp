@@ -0,0 +1,421 @@
+/* Copyright (c) 2010-2012, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QStringList>
+#include <QtEndian>
+#include <TWebApplication>
+#include <TSessionCodec>
+#include "tsystemglobal.h"
+
+#define COMPRESSION_THRESHOLD  "Session.CompressionThreshold"
+#define FORMAT_PLAIN           0xF1
+#define FORMAT_COMPRESSED      0xF2
+
+/*!
+  \class TSessionCodec
+  \brief The TSessionCodec class serializes session data compactly.
+
+  Each entry is encoded as a varint-length UTF-8 key followed by a type
+  tag and the value; integers are varints, strings are UTF-8, and the
+  types without a specialized encoding fall back on QDataStream. The
+  data larger than the compression threshold is compressed by zlib.
+
+  Data serialized by QDataStream, as the session stores did formerly,
+  is still decoded.
+  \sa TSessionStore
+*/
+
+enum TypeTag {
+    InvalidTag = 0,
+    FalseTag,
+    TrueTag,
+    IntTag,
+    UIntTag,
+    LongLongTag,
+    ULongLongTag,
+    DoubleTag,
+    StringTag,
+    ByteArrayTag,
+    StringListTag,
+    DateTimeTag,
+    VariantTag,
+};
+
+
+static inline quint64 zigzag(qint64 n)
+{
+    return ((quint64)n << 1) ^ (quint64)(n >> 63);
+}
+
+
+static inline qint64 unzigzag(quint64 n)
+{
+    return (qint64)(n >> 1) ^ -(qint64)(n & 1);
+}
+
+
+// QDateTime::toMSecsSinceEpoch() and fromMSecsSinceEpoch() of Qt 4.7
+static qint64 toMSecsSinceEpoch(const QDateTime &dateTime)
+{
+    QDateTime utc = dateTime.toUTC();
+    return (qint64)QDate(1970, 1, 1).daysTo(utc.date()) * 86400000 + QTime(0, 0).msecsTo(utc.time());
+}
+
+
+static QDateTime fromMSecsSinceEpoch(qint64 msecs)
+{
+    qint64 days = msecs / 86400000;
+    qint64 rest = msecs % 86400000;
+    if (rest < 0) {
+        --days;
+        rest += 86400000;
+    }
+    return QDateTime(QDate(1970, 1, 1).addDays((int)days), QTime(0, 0).addMSecs((int)rest), Qt::UTC);
+}
+
+
+static inline void writeVarint(QByteArray &out, quint64 n)
+{
+    while (n >= 0x80) {
+        out += (char)((n & 0x7F) | 0x80);
+        n >>= 7;
+    }
+    out += (char)n;
+}
+
+
+static inline void writeBytes(QByteArray &out, const QByteArray &bytes)
+{
+    writeVarint(out, bytes.length());
+    out += bytes;
+}
+
+
+static void writeVariant(QByteArray &out, const QVariant &var)
+{
+    switch (var.type()) {
+    case QVariant::Invalid:
+        out += (char)InvalidTag;
+        break;
+
+    case QVariant::Bool:
+        out += (char)(var.toBool() ? TrueTag : FalseTag);
+        break;
+
+    case QVariant::Int:
+        out += (char)IntTag;
+        writeVarint(out, zigzag(var.toInt()));
+        break;
+
+    case QVariant::UInt:
+        out += (char)UIntTag;
+        writeVarint(out, var.toUInt());
+        break;
+
+    case QVariant::LongLong:
+        out += (char)LongLongTag;
+        writeVarint(out, zigzag(var.toLongLong()));
+        break;
+
+    case QVariant::ULongLong:
+        out += (char)ULongLongTag;
+        writeVarint(out, var.toULongLong());
+        break;
+
+    case QVariant::Double: {
+        double d = var.toDouble();
+        quint64 bits;
+        memcpy(&bits, &d, sizeof(bits));
+        bits = qToLittleEndian(bits);
+        out += (char)DoubleTag;
+        out.append((const char *)&bits, sizeof(bits));
+        break; }
+
+    case QVariant::String:
+        out += (char)StringTag;
+        writeBytes(out, var.toString().toUtf8());
+        break;
+
+    case QVariant::ByteArray:
+        out += (char)ByteArrayTag;
+        writeBytes(out, var.toByteArray());
+        break;
+
+    case QVariant::StringList: {
+        const QStringList list = var.toStringList();
+        out += (char)StringListTag;
+        writeVarint(out, list.count());
+        for (QStringListIterator it(list); it.hasNext(); ) {
+            writeBytes(out, it.next().toUtf8());
+        }
+        break; }
+
+    case QVariant::DateTime: {
+        QDateTime dt = var.toDateTime();
+        if (dt.isValid()) {
+            out += (char)DateTimeTag;
+            writeVarint(out, zigzag(toMSecsSinceEpoch(dt)));
+            out += (char)(dt.timeSpec() == Qt::UTC);
+            break;
+        }
+        // fall through
+    }
+
+    default: {
+        QByteArray ba;
+        QDataStream ds(&ba, QIODevice::WriteOnly);
+        ds << var;
+        out += (char)VariantTag;
+        writeBytes(out, ba);
+        break; }
+    }
+}
+
+
+class SessionDataReader
+{
+public:
+    SessionDataReader(const QByteArray &data) : ptr(data.constData()), end(data.constData() + data.length()) { }
+
+    bool atEnd() const { return ptr >= end; }
+    int remaining() const { return end - ptr; }
+
+    bool readByte(uchar &c)
+    {
+        if (ptr >= end)
+            return false;
+        c = (uchar)*ptr++;
+        return true;
+    }
+
+    bool readVarint(quint64 &n)
+    {
+        n = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uchar c;
+            if (!readByte(c))
+                return false;
+            n |= (quint64)(c & 0x7F) << shift;
+            if (!(c & 0x80))
+                return true;
+        }
+        return false;
+    }
+
+    bool readBytes(QByteArray &bytes)
+    {
+        quint64 len;
+        if (!readVarint(len) || len > (quint64)remaining())
+            return false;
+        bytes = QByteArray(ptr, (int)len);
+        ptr += len;
+        return true;
+    }
+
+    bool readRaw(char *buf, int len)
+    {
+        if (len > remaining())
+            return false;
+        memcpy(buf, ptr, len);
+        ptr += len;
+        return true;
+    }
+
+private:
+    const char *ptr;
+    const char *end;
+};
+
+
+static bool readVariant(SessionDataReader &in, QVariant &var)
+{
+    uchar tag;
+    quint64 n;
+    QByteArray bytes;
+
+    if (!in.readByte(tag))
+        return false;
+
+    switch (tag) {
+    case InvalidTag:
+        var = QVariant();
+        return true;
+
+    case FalseTag:
+    case TrueTag:
+        var = QVariant(tag == TrueTag);
+        return true;
+
+    case IntTag:
+        if (!in.readVarint(n))
+            return false;
+        var = QVariant((int)unzigzag(n));
+        return true;
+
+    case UIntTag:
+        if (!in.readVarint(n))
+            return false;
+        var = QVariant((uint)n);
+        return true;
+
+    case LongLongTag:
+        if (!in.readVarint(n))
+            return false;
+        var = QVariant((qlonglong)unzigzag(n));
+        return true;
+
+    case ULongLongTag:
+        if (!in.readVarint(n))
+            return false;
+        var = QVariant((qulonglong)n);
+        return true;
+
+    case DoubleTag: {
+        quint64 bits;
+        double d;
+        if (!in.readRaw((char *)&bits, sizeof(bits)))
+            return false;
+        bits = qFromLittleEndian(bits);
+        memcpy(&d, &bits, sizeof(d));
+        var = QVariant(d);
+        return true; }
+
+    case StringTag:
+        if (!in.readBytes(bytes))
+            return false;
+        var = QVariant(QString::fromUtf8(bytes.constData(), bytes.length()));
+        return true;
+
+    case ByteArrayTag:
+        if (!in.readBytes(bytes))
+            return false;
+        var = QVariant(bytes);
+        return true;
+
+    case StringListTag: {
+        QStringList list;
+        if (!in.readVarint(n) || n > (quint64)in.remaining())
+            return false;
+        for (quint64 i = 0; i < n; ++i) {
+            if (!in.readBytes(bytes))
+                return false;
+            list << QString::fromUtf8(bytes.constData(), bytes.length());
+        }
+        var = QVariant(list);
+        return true; }
+
+    case DateTimeTag: {
+        uchar utc;
+        if (!in.readVarint(n) || !in.readByte(utc))
+            return false;
+        QDateTime dt = fromMSecsSinceEpoch(unzigzag(n));
+        var = QVariant(utc ? dt : dt.toLocalTime());
+        return true; }
+
+    case VariantTag: {
+        if (!in.readBytes(bytes))
+            return false;
+        QDataStream ds(bytes);
+        ds >> var;
+        return ds.status() == QDataStream::Ok; }
+
+    default:
+        return false;
+    }
+}
+
+/*!
+  Constructor. The data whose encoded size is \a compressionThreshold
+  bytes or more is compressed; the value 0 disables the compression.
+*/
+TSessionCodec::TSessionCodec(int compressionThreshold)
+    : threshold(qMax(compressionThreshold, 0))
+{ }
+
+/*!
+  Returns the session data \a hash encoded.
+*/
+QByteArray TSessionCodec::encode(const QVariantHash &hash) const
+{
+    QByteArray out;
+    out.reserve(256);
+    out += (char)FORMAT_PLAIN;
+    writeVarint(out, hash.count());
+
+    for (QHashIterator<QString, QVariant> it(hash); it.hasNext(); ) {
+        it.next();
+        writeBytes(out, it.key().toUtf8());
+        writeVariant(out, it.value());
+    }
+
+    if (threshold > 0 && out.length() >= threshold) {
+        QByteArray compressed = qCompress(out.mid(1));
+        if (compressed.length() + 1 < out.length()) {
+            compressed.prepend((char)FORMAT_COMPRESSED);
+            return compressed;
+        }
+    }
+    return out;
+}
+
+/*!
+  Decodes the \a data encoded by encode() or serialized by QDataStream
+  into \a hash. Returns true if successful; otherwise returns false.
+*/
+bool TSessionCodec::decode(const QByteArray &data, QVariantHash &hash) const
+{
+    hash = QVariantHash();
+    if (data.isEmpty())
+        return false;
+
+    uchar format = (uchar)data.at(0);
+    if (format != FORMAT_PLAIN && format != FORMAT_COMPRESSED) {
+        // Former format
+        QDataStream ds(data);
+        ds >> hash;
+        if (ds.status() != QDataStream::Ok) {
+            hash = QVariantHash();
+            return false;
+        }
+        return true;
+    }
+
+    QByteArray body = (format == FORMAT_COMPRESSED) ? qUncompress(data.mid(1)) : data.mid(1);
+    SessionDataReader in(body);
+    quint64 count;
+    if (!in.readVarint(count) || count > (quint64)in.remaining())
+        return false;
+
+    hash.reserve(count);
+    for (quint64 i = 0; i < count; ++i) {
+        QByteArray key;
+        QVariant value;
+        if (!in.readBytes(key) || !readVariant(in, value)) {
+            hash = QVariantHash();
+            return false;
+        }
+        hash.insert(QString::fromUtf8(key.constData(), key.length()), value);
+    }
+
+    if (!in.atEnd()) {
+        hash = QVariantHash();
+        return false;
+    }
+    return true;
+}
+
+/*!
+  Returns the codec configured by the Session.CompressionThreshold
+  setting.
+*/
+const TSessionCodec &TSessionCodec::instance()
+{
+    static TSessionCodec codec(Tf::app()->appSettings().value(COMPRESSION_THRESHOLD, 0).toInt());
+    return codec;
+}
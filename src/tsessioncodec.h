@@ -0,0 +1,24 @@
+#ifndef TSESSIONCODEC_H
+#define TSESSIONCODEC_H
+
+#include <QByteArray>
+#include <QVariant>
+#include <TGlobal>
+
+
+class T_CORE_EXPORT TSessionCodec
+{
+public:
+    TSessionCodec(int compressionThreshold = 0);
+
+    QByteArray encode(const QVariantHash &hash) const;
+    bool decode(const QByteArray &data, QVariantHash &hash) const;
+    int compressionThreshold() const { return threshold; }
+
+    static const TSessionCodec &instance();
+
+private:
+    int threshold;
+};
+
+#endif // TSESSIONCODEC_H
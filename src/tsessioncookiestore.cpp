@@ -8,11 +8,21 @@
 #include <QCryptographicHash>
 #include <TWebApplication>
 #include <TSystemGlobal>
+#include <THttpUtility>
+#include <TCryptMac>
+#include <TSessionCodec>
 #include "tsessioncookiestore.h"
 
+#define SESSION_SECRET  "Session.Secret"
+
 /*!
   \class TSessionCookieStore
   \brief The TSessionCookieStore class stores HTTP sessions into a cookie.
+
+  The cookie value is the session data encoded by TSessionCodec and its
+  HMAC-SHA1 digest, both in base64url and joined by a dot. Cookies of
+  the former format, hex strings joined by an underscore, are still
+  accepted.
 */
 
 bool TSessionCookieStore::store(TSession &session)
@@ -20,12 +30,10 @@ bool TSessionCookieStore::store(TSession &session)
     if (session.isEmpty())
         return true;
 
-    QByteArray ba;
-    QDataStream ds(&ba, QIODevice::WriteOnly);
-    ds << *static_cast<const QVariantHash *>(&session);
-    QByteArray digest = QCryptographicHash::hash(ba + Tf::app()->appSettings().value("Session.Secret").toByteArray(),
-                                                 QCryptographicHash::Sha1);
-    session.sessionId = ba.toHex() + "_" + digest.toHex();
+    QByteArray data = TSessionCodec::instance().encode(session);
+    QByteArray digest = TCryptMac::mac(data, Tf::app()->appSettings().value(SESSION_SECRET).toByteArray(),
+                                       TCryptMac::Hmac_Sha1);
+    session.sessionId = THttpUtility::toBase64Url(data) + '.' + THttpUtility::toBase64Url(digest);
     return true;
 }
 
@@ -36,25 +44,35 @@ TSession TSessionCookieStore::find(const QByteArray &id, const QDateTime &)
     if (id.isEmpty())
         return session;
 
-    QList<QByteArray> balst = id.split('_');
-    if (balst.count() == 2 && !balst.value(0).isEmpty() && !balst.value(1).isEmpty()) {
-        QByteArray ba = QByteArray::fromHex(balst.value(0));
-        QByteArray digest = QCryptographicHash::hash(ba + Tf::app()->appSettings().value("Session.Secret").toByteArray(),
+    QByteArray data;
+    int idx = id.indexOf('.');
+    if (idx > 0) {
+        data = THttpUtility::fromBase64Url(id.left(idx));
+        QByteArray digest = TCryptMac::mac(data, Tf::app()->appSettings().value(SESSION_SECRET).toByteArray(),
+                                           TCryptMac::Hmac_Sha1);
+        if (digest != THttpUtility::fromBase64Url(id.mid(idx + 1))) {
+            tSystemWarn("Recieved a tampered cookie or that of other web application.");
+            return session;
+        }
+
+    } else {
+        // Former format
+        QList<QByteArray> balst = id.split('_');
+        if (balst.count() != 2 || balst.value(0).isEmpty() || balst.value(1).isEmpty())
+            return session;
+
+        data = QByteArray::fromHex(balst.value(0));
+        QByteArray digest = QCryptographicHash::hash(data + Tf::app()->appSettings().value(SESSION_SECRET).toByteArray(),
                                                      QCryptographicHash::Sha1);
-        
         if (digest != QByteArray::fromHex(balst.value(1))) {
             tSystemWarn("Recieved a tampered cookie or that of other web application.");
             //throw SecurityException("Tampered with cookie", __FILE__, __LINE__);
             return session;
         }
+    }
 
-        QDataStream ds(&ba, QIODevice::ReadOnly);
-        ds >> *static_cast<QVariantHash *>(&session);
-        
-        if (ds.status() != QDataStream::Ok) {
-            tSystemError("Unable to load a session from the cookie store.");
-            session.clear();
-        }
+    if (!TSessionCodec::instance().decode(data, session)) {
+        tSystemError("Unable to load a session from the cookie store.");
     }
     return session;
 }
@@ -7,66 +7,103 @@
 
 #include <QFile>
 #include <QDir>
-#include <QDataStream>
+#include <QDirIterator>
 #include <TWebApplication>
+#include <TSessionCodec>
+#include <ctype.h>
 #include "tsessionfilestore.h"
 
-#define SESSION_DIR_NAME "session"
+#define SESSION_DIR_NAME  "session"
+#define GC_FILE_LIMIT     10000  // files examined per sweep
 
 /*!
   \class TSessionFileStore
   \brief The TSessionFileStore class stores HTTP sessions to files.
+
+  The files are divided into subdirectories named after the first two
+  characters of the session IDs. The files stored directly in the
+  session directory by former versions are still found.
 */
 
-bool TSessionFileStore::store(TSession &session)
+static bool isValidId(const QByteArray &id)
 {
-    QDir dir(sessionDirPath());
-    if (!dir.exists()) {
-        dir.mkpath(".");
+    // Used as a file name
+    if (id.length() < 2)
+        return false;
+
+    for (int i = 0; i < id.length(); ++i) {
+        if (!isalnum((uchar)id[i]))
+            return false;  // including NUL
     }
-    
-    bool res = false;
-    QFile file(sessionDirPath() + session.id());
-    if (file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
-        QDataStream ds(&file);
-        ds << *static_cast<const QVariantHash *>(&session);
-        res = (ds.status() == QDataStream::Ok);
+    return true;
+}
+
+
+bool TSessionFileStore::store(TSession &session)
+{
+    if (!isValidId(session.id()))
+        return false;
+
+    QFile file(sessionFilePath(session.id()));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        QDir().mkpath(QFileInfo(file).absolutePath());
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            return false;
     }
-    return res;
+
+    QByteArray data = TSessionCodec::instance().encode(session);
+    return (file.write(data) == data.length());
 }
 
 
 TSession TSessionFileStore::find(const QByteArray &id, const QDateTime &modified)
 {
-    QFileInfo fi(sessionDirPath() + id);
+    if (!isValidId(id))
+        return TSession();
+
+    QFileInfo fi(sessionFilePath(id));
+    if (!fi.exists()) {
+        fi.setFile(sessionDirPath() + id);  // former layout
+    }
 
-    if (fi.exists() && fi.lastModified() >= modified) { 
+    if (fi.exists() && fi.lastModified() >= modified) {
         QFile file(fi.filePath());
 
         if (file.open(QIODevice::ReadOnly)) {
-            QDataStream ds(&file);
             TSession result(id);
-            ds >> *static_cast<QVariantHash *>(&result);
-            if (ds.status() == QDataStream::Ok)
-                return result; 
+            if (TSessionCodec::instance().decode(file.readAll(), result)) {
+                result.updatedTime = fi.lastModified();
+                return result;
+            }
         }
     }
     return TSession();
 }
 
-
+/*!
+  Removes the session files modified before \a garbageExpiration. The
+  subdirectories are swept from a random one, and at most GC_FILE_LIMIT
+  files are examined in a call, so that a large session directory is
+  swept over several calls.
+*/
 bool TSessionFileStore::remove(const QDateTime &garbageExpiration)
 {
-    bool res = true;
     QDir dir(sessionDirPath());
-    if (dir.exists()) {
-        QList<QFileInfo> list = dir.entryInfoList(QDir::Files, QDir::Time | QDir::Reversed);
-        for (QListIterator<QFileInfo> i(list); i.hasNext(); ) {
-            const QFileInfo &fi = i.next();
-            if (fi.lastModified() < garbageExpiration) {
-                res &= dir.remove(fi.fileName());
-            } else {
-                break;
+    if (!dir.exists())
+        return true;
+
+    QStringList dirs = dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Unsorted);
+    dirs << QLatin1String(".");  // former layout
+
+    bool res = true;
+    int budget = GC_FILE_LIMIT;
+    int start = Tf::random(dirs.count() - 1);
+    for (int i = 0; i < dirs.count() && budget > 0; ++i) {
+        QDirIterator it(dir.filePath(dirs[(start + i) % dirs.count()]), QDir::Files);
+        while (budget-- > 0 && it.hasNext()) {
+            it.next();
+            if (it.fileInfo().lastModified() < garbageExpiration) {
+                res &= QFile::remove(it.filePath());
             }
         }
     }
@@ -76,7 +113,12 @@ bool TSessionFileStore::remove(const QDateTime &garbageExpiration)
 
 bool TSessionFileStore::remove(const QByteArray &id)
 {
-    return QFile::remove(sessionDirPath() + id);
+    if (!isValidId(id))
+        return false;
+
+    bool res = QFile::remove(sessionFilePath(id));
+    res |= QFile::remove(sessionDirPath() + id);
+    return res;
 }
 
 
@@ -84,3 +126,9 @@ QString TSessionFileStore::sessionDirPath()
 {
     return Tf::app()->tmpPath() + QLatin1String(SESSION_DIR_NAME) + QDir::separator();
 }
+
+
+QString TSessionFileStore::sessionFilePath(const QByteArray &id)
+{
+    return sessionDirPath() + QString::fromLatin1(id.left(2)) + QDir::separator() + QString::fromLatin1(id);
+}
@@ -14,6 +14,9 @@ public:
     bool remove(const QByteArray &id);
 
     static QString sessionDirPath();
+
+private:
+    static QString sessionFilePath(const QByteArray &id);
 };
 
 #endif // TSESSIONFILESTORE_H
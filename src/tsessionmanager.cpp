@@ -12,14 +12,25 @@
 #include <TSessionStore>
 #include <unistd.h>
 #include <sys/time.h>
+#include <errno.h>
+#include <fcntl.h>
+#if defined(Q_OS_UNIX)
+# include <sys/syscall.h>
+#endif
 #include "tsystemglobal.h"
 #include "tsessionmanager.h"
 #include "tsessionstorefactory.h"
 
 #define STORE_TYPE          "Session.StoreType"
 #define GC_PROBABILITY      "Session.GcProbability"
+#define GC_INTERVAL         "Session.GcInterval"
 #define GC_MAX_LIFE_TIME    "Session.GcMaxLifeTime"
 #define SESSION_LIFETIME    "Session.LifeTime"
+#define TOUCH_INTERVAL      "Session.TouchInterval"
+#define SESSION_ID_BYTES    20
+
+
+static QByteArray hostName;
 
 
 static QByteArray randomString()
@@ -32,7 +43,7 @@ static QByteArray randomString()
 
     data.append(QByteArray::number((uint)tv.tv_sec));
     data.append(QByteArray::number((uint)tv.tv_usec));
-    data.append(QHostInfo::localHostName());
+    data.append(hostName);
     data.append(QByteArray::number(getpid()));
     data.append(QByteArray::number((qulonglong)QThread::currentThread()));
     data.append(QByteArray::number((qulonglong)qApp));
@@ -41,12 +52,64 @@ static QByteArray randomString()
 }
 
 
+static bool readSystemRandom(char *buf, int length)
+{
+#if defined(Q_OS_UNIX)
+    int len = 0;
+# if defined(SYS_getrandom)
+    while (len < length) {
+        long n = syscall(SYS_getrandom, buf + len, length - len, 0);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            break;  // not supported by the kernel
+        }
+        len += n;
+    }
+    if (len == length)
+        return true;
+# endif
+
+    int fd = ::open("/dev/urandom", O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    len = 0;
+    while (len < length) {
+        ssize_t n = ::read(fd, buf + len, length - len);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR)
+                continue;
+            break;
+        }
+        len += n;
+    }
+    ::close(fd);
+    return (len == length);
+#else
+    Q_UNUSED(buf);
+    Q_UNUSED(length);
+    return false;
+#endif
+}
+
+
 TSessionManager::TSessionManager()
-{ }
+    : type(Tf::app()->appSettings().value(STORE_TYPE).toString().toLower()), sharedStore(0)
+{
+    hostName = QHostInfo::localHostName().toLatin1();
+
+    if (TSessionStoreFactory::isBuiltIn(type)) {
+        sharedStore = TSessionStoreFactory::create(type);
+    }
+}
 
 
 TSessionManager::~TSessionManager()
-{ }
+{
+    delete sharedStore;
+    qDeleteAll(idleStores);
+}
 
 
 TSession TSessionManager::findSession(const QByteArray &id)
@@ -58,10 +121,11 @@ TSession TSessionManager::findSession(const QByteArray &id)
     
     TSession session;
     if (!id.isEmpty()) {
-        TSessionStore *store = TSessionStoreFactory::create(storeType());
+        TSessionStore *store = sessionStore();
         if (store) {
             session = store->find(id, validCreated);
-            delete store;
+            session.initialData = session;  // to detect modification
+            releaseSessionStore(store);
         }
     }
     return session;
@@ -78,10 +142,10 @@ bool TSessionManager::store(TSession &session)
     }
     
     bool res = false;
-    TSessionStore *store = TSessionStoreFactory::create(storeType());
+    TSessionStore *store = sessionStore();
     if (store) {
         res = store->store(session);
-        delete store;
+        releaseSessionStore(store);
     }
     return res;
 }
@@ -90,10 +154,10 @@ bool TSessionManager::store(TSession &session)
 bool TSessionManager::remove(const QByteArray &id)
 {
     if (!id.isEmpty()) {
-        TSessionStore *store = TSessionStoreFactory::create(storeType());
+        TSessionStore *store = sessionStore();
         if (store) {
             bool ret = store->remove(id);
-            delete store;
+            releaseSessionStore(store);
             return ret;
         }
     }
@@ -103,12 +167,73 @@ bool TSessionManager::remove(const QByteArray &id)
 
 QString TSessionManager::storeType() const
 {
-    return Tf::app()->appSettings().value(STORE_TYPE).toString().toLower();
+    return type;
 }
 
+/*!
+  Returns the session store. A built-in store is created once and
+  shared by all the threads, since the threads of the thread MPM live
+  only as long as a connection. A plugin store, which may not be
+  thread-safe, is checked out of a pool of the process, and created
+  only if none is idle. Pass the store to releaseSessionStore() after
+  use.
+*/
+TSessionStore *TSessionManager::sessionStore() const
+{
+    if (sharedStore)
+        return sharedStore;
+
+    {
+        QMutexLocker locker(&storeMutex);
+        if (!idleStores.isEmpty()) {
+            return idleStores.pop();  // most recently used
+        }
+    }
+    return TSessionStoreFactory::create(type);
+}
+
+/*!
+  Releases the session store \a store returned by sessionStore(); a
+  plugin store is given back to the pool for the next use.
+*/
+void TSessionManager::releaseSessionStore(TSessionStore *store) const
+{
+    if (!store || store == sharedStore)
+        return;
 
+    QMutexLocker locker(&storeMutex);
+    idleStores.push(store);
+}
+
+
+/*!
+  Returns true if the unmodified session \a session should be stored
+  again to extend its expiration, that is, if Session.TouchInterval
+  seconds have passed since the session store saved it last or the time
+  is unknown.
+*/
+bool TSessionManager::isTouchRequired(const TSession &session) const
+{
+    if (session.updatedTime.isNull())
+        return true;
+
+    return session.updatedTime.secsTo(QDateTime::currentDateTime()) >= touchInterval();
+}
+
+
+/*!
+  Returns a new session ID, 160 random bits from the system CSPRNG in
+  hex. A collision is negligible, so the session store isn't looked up.
+  The bits are read by getrandom() or from /dev/urandom for each ID.
+*/
 QByteArray TSessionManager::generateId()
 {
+    char bytes[SESSION_ID_BYTES];
+    if (readSystemRandom(bytes, sizeof(bytes))) {
+        return QByteArray(bytes, sizeof(bytes)).toHex();
+    }
+
+    // No system random source
     QByteArray id;
     int i;
     for (i = 0; i < 3; ++i) {
@@ -119,33 +244,25 @@ QByteArray TSessionManager::generateId()
 
     if (i == 3)
         throw RuntimeException("Unable to generate a unique session ID", __FILE__, __LINE__);
-    
+
     return id;
 }
 
 
+/*!
+  Removes the expired sessions from the session store. This is called
+  by the background timer of the application server, not in requests.
+  \sa gcInterval()
+*/
 void TSessionManager::collectGarbage()
 {
-    static int prob = -1;
-
-    if (prob == -1) {
-        prob = Tf::app()->appSettings().value(GC_PROBABILITY).toInt();
-    }
+    tSystemDebug("Session garbage collector started");
 
-    if (prob > 0) {
-        int r = Tf::random(prob - 1);
-        tSystemDebug("Session garbage collector : rand = %d", r);
-
-        if (r == 0) {
-            tSystemDebug("Session garbage collector started");
-            
-            TSessionStore *store = TSessionStoreFactory::create(Tf::app()->appSettings().value(STORE_TYPE).toString());
-            if (store) {
-                int lifetime = Tf::app()->appSettings().value(GC_MAX_LIFE_TIME).toInt();
-                store->remove(QDateTime::currentDateTime().addSecs(-lifetime));
-                delete store;
-            }
-        }
+    TSessionStore *store = sessionStore();
+    if (store) {
+        int lifetime = Tf::app()->appSettings().value(GC_MAX_LIFE_TIME).toInt();
+        store->remove(QDateTime::currentDateTime().addSecs(-lifetime));
+        releaseSessionStore(store);
     }
 }
 
@@ -166,3 +283,34 @@ int TSessionManager::sessionLifeTime()
     }
     return lifetime;
 }
+
+
+int TSessionManager::touchInterval()
+{
+    static int interval = -1;
+
+    if (interval < 0) {
+        interval = qMax(Tf::app()->appSettings().value(TOUCH_INTERVAL).toInt(), 0);
+    }
+    return interval;
+}
+
+/*!
+  Returns the interval in seconds of the session garbage collection
+  specified by the Session.GcInterval setting. The value 0 means that
+  the GC never starts.
+*/
+int TSessionManager::gcInterval()
+{
+    static int interval = -1;
+
+    if (interval < 0) {
+        QSettings &settings = Tf::app()->appSettings();
+        if (settings.contains(GC_PROBABILITY) && settings.value(GC_PROBABILITY).toInt() == 0) {
+            interval = 0;  // disabled by the former setting
+        } else {
+            interval = qMax(settings.value(GC_INTERVAL, 60).toInt(), 0);
+        }
+    }
+    return interval;
+}
@@ -3,9 +3,12 @@
 
 #include <QDateTime>
 #include <QMutex>
+#include <QStack>
 #include <TGlobal>
 #include <TSession>
 
+class TSessionStore;
+
 
 class T_CORE_EXPORT TSessionManager
 {
@@ -16,15 +19,26 @@ public:
     bool store(TSession &session);
     bool remove(const QByteArray &id);
     QString storeType() const;
+    bool isTouchRequired(const TSession &session) const;
     QByteArray generateId();
     void collectGarbage();
 
     static TSessionManager &instance();
     static int sessionLifeTime();
+    static int touchInterval();
+    static int gcInterval();
 
 private:
+    TSessionStore *sessionStore() const;
+    void releaseSessionStore(TSessionStore *store) const;
+
     Q_DISABLE_COPY(TSessionManager)
     TSessionManager();
+
+    QString type;
+    TSessionStore *sharedStore;
+    mutable QMutex storeMutex;
+    mutable QStack<TSessionStore *> idleStores;  // plugin stores
 };
 
 #endif // TSESSIONMANAGER_H
@@ -0,0 +1,69 @@
+/* Copyright (c) 2010-2012, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <TWebApplication>
+#include <TSessionCodec>
+#include <TMemcached>
+#include "tsessionmemcachedstore.h"
+#include "tsystemglobal.h"
+
+#define GC_MAX_LIFE_TIME  "Session.GcMaxLifeTime"
+#define KEY_PREFIX        "tfsess:"
+
+/*!
+  \class TSessionMemcachedStore
+  \brief The TSessionMemcachedStore class stores HTTP sessions in
+  memcached servers, so that the application servers on several hosts
+  share them.
+
+  Each session is stored with the expiration of Session.GcMaxLifeTime
+  seconds, which slides on each access; the expired sessions are removed
+  by the servers themselves. The servers are specified by the
+  Memcached.Servers setting.
+  \sa TMemcached
+*/
+
+static inline int lifeTime()
+{
+    return Tf::app()->appSettings().value(GC_MAX_LIFE_TIME).toInt();
+}
+
+
+TSession TSessionMemcachedStore::find(const QByteArray &id, const QDateTime &)
+{
+    bool found;
+    QByteArray data = TMemcached::instance().getAndTouch(KEY_PREFIX + id, lifeTime(), &found);
+    if (!found)
+        return TSession();
+
+    TSession result(id);
+    result.updatedTime = QDateTime::currentDateTime();  // expiration slid above
+    return TSessionCodec::instance().decode(data, result) ? result : TSession();
+}
+
+
+bool TSessionMemcachedStore::store(TSession &session)
+{
+    bool res = TMemcached::instance().set(KEY_PREFIX + session.id(), TSessionCodec::instance().encode(session), lifeTime());
+    if (!res) {
+        tSystemError("Failed to store session in memcached: %s", session.id().data());
+    }
+    return res;
+}
+
+
+bool TSessionMemcachedStore::remove(const QDateTime &)
+{
+    // Expired by the memcached servers
+    return true;
+}
+
+
+bool TSessionMemcachedStore::remove(const QByteArray &id)
+{
+    return TMemcached::instance().remove(KEY_PREFIX + id);
+}
@@ -0,0 +1,17 @@
+#ifndef TSESSIONMEMCACHEDSTORE_H
+#define TSESSIONMEMCACHEDSTORE_H
+
+#include <TSessionStore>
+
+
+class T_CORE_EXPORT TSessionMemcachedStore : public TSessionStore
+{
+public:
+    QString key() const { return "memcached"; }
+    TSession find(const QByteArray &id, const QDateTime &expiration);
+    bool store(TSession &session);
+    bool remove(const QDateTime &garbageExpiration);
+    bool remove(const QByteArray &id);
+};
+
+#endif // TSESSIONMEMCACHEDSTORE_H
@@ -0,0 +1,264 @@
+/* Copyright (c) 2010-2012, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <QCache>
+#include <QHash>
+#include <QAtomicInt>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QBasicTimer>
+#include <QTimerEvent>
+#include <TWebApplication>
+#include <TSessionCodec>
+#include "tsessionmemorystore.h"
+#include "tsessionmanager.h"
+#include "tsystemglobal.h"
+
+#define MAX_MEMORY_SIZE   "Session.MemoryStoreMaxSize"
+#define GC_MAX_LIFE_TIME  "Session.GcMaxLifeTime"
+#define STRIPE_COUNT      16
+#define EXPIRY_INTERVAL   60000  // msecs
+
+/*!
+  \class TSessionMemoryStore
+  \brief The TSessionMemoryStore class stores HTTP sessions in the
+  memory of the application server process.
+
+  Sessions are kept serialized in a hash table divided into stripes,
+  each guarded by its own mutex, so threads accessing different sessions
+  rarely contend. The expiration slides on each access; the sessions
+  not accessed for Session.GcMaxLifeTime seconds are removed by a timer
+  of the main thread.
+
+  Session.MemoryStoreMaxSize bounds the total size of all the stripes.
+  When it's exceeded, the least recently used sessions of the stripes
+  are evicted in turn; the order of eviction is least recently used
+  within a stripe, not across the stripes.
+
+  The sessions are lost when the process exits, so this store is
+  available only for the thread MPM.
+*/
+
+struct SessionStripe
+{
+    QMutex mutex;
+    QCache<QByteArray, QByteArray> cache;  // serialized sessions in LRU order
+    QHash<QByteArray, uint> accessed;      // not to disturb the LRU order
+};
+
+
+class TSessionMemoryExpirer : public QObject
+{
+public:
+    TSessionMemoryExpirer() : QObject() { timer.start(EXPIRY_INTERVAL, this); }
+
+protected:
+    void timerEvent(QTimerEvent *event)
+    {
+        if (event->timerId() == timer.timerId()) {
+            int lifetime = Tf::app()->appSettings().value(GC_MAX_LIFE_TIME).toInt();
+            int cnt = TSessionMemoryStore::expire(QDateTime::currentDateTime().addSecs(-lifetime));
+            tSystemDebug("Expired sessions in memory: %d", cnt);
+        } else {
+            QObject::timerEvent(event);
+        }
+    }
+
+private:
+    QBasicTimer timer;
+};
+
+
+static SessionStripe *stripes = 0;
+static TSessionMemoryExpirer *expirer = 0;
+static int maxTotalCost = 0;
+static QBasicAtomicInt totalCost = Q_BASIC_ATOMIC_INITIALIZER(0);
+static QBasicAtomicInt evictIndex = Q_BASIC_ATOMIC_INITIALIZER(0);
+
+
+static void cleanup()
+{
+    delete expirer;
+    expirer = 0;
+    delete[] stripes;
+    stripes = 0;
+}
+
+
+static inline SessionStripe &stripe(const QByteArray &id)
+{
+    return stripes[qHash(id) % STRIPE_COUNT];
+}
+
+
+// Adds the change of the stripe cost from 'before' to the total.
+// Call this with the mutex of the stripe locked.
+static inline void addCost(SessionStripe &s, int before)
+{
+    totalCost.fetchAndAddOrdered(s.cache.totalCost() - before);
+}
+
+
+// Evicts sessions from the stripes in turn until the total cost is
+// within the limit. Call this with no stripe locked.
+static void evictExcess()
+{
+    for (int i = 0; i < STRIPE_COUNT; ++i) {
+        int excess = totalCost.fetchAndAddOrdered(0) - maxTotalCost;
+        if (excess <= 0)
+            break;
+
+        SessionStripe &s = stripes[(uint)evictIndex.fetchAndAddRelaxed(1) % STRIPE_COUNT];
+        QMutexLocker locker(&s.mutex);
+        int before = s.cache.totalCost();
+        s.cache.setMaxCost(qMax(before - excess, 0));  // evicts the least recently used
+        s.cache.setMaxCost(maxTotalCost);
+        addCost(s, before);
+    }
+}
+
+
+TSession TSessionMemoryStore::find(const QByteArray &id, const QDateTime &expiration)
+{
+    if (!stripes) {
+        tSystemError("Memory session store not initialized");
+        return TSession();
+    }
+
+    QByteArray data;
+    {
+        SessionStripe &s = stripe(id);
+        QMutexLocker locker(&s.mutex);
+        QByteArray *entry = s.cache.object(id);
+        if (!entry) {
+            s.accessed.remove(id);  // evicted
+            return TSession();
+        }
+
+        if (s.accessed.value(id) < expiration.toTime_t()) {
+            int before = s.cache.totalCost();
+            s.cache.remove(id);
+            s.accessed.remove(id);
+            addCost(s, before);
+            return TSession();
+        }
+
+        s.accessed.insert(id, QDateTime::currentDateTime().toTime_t());  // slides the expiration
+        data = *entry;
+    }
+
+    TSession result(id);
+    result.updatedTime = QDateTime::currentDateTime();  // expiration slid above
+    return TSessionCodec::instance().decode(data, result) ? result : TSession();
+}
+
+
+bool TSessionMemoryStore::store(TSession &session)
+{
+    if (!stripes) {
+        tSystemError("Memory session store not initialized");
+        return false;
+    }
+
+    QByteArray *entry = new QByteArray(TSessionCodec::instance().encode(session));
+
+    int cost = entry->size() + session.id().size() * 2 + 64;
+    SessionStripe &s = stripe(session.id());
+    bool res;
+    {
+        QMutexLocker locker(&s.mutex);
+        int before = s.cache.totalCost();
+        res = s.cache.insert(session.id(), entry, cost);  // deletes entry on failure
+        if (res) {
+            s.accessed.insert(session.id(), QDateTime::currentDateTime().toTime_t());
+        } else {
+            s.accessed.remove(session.id());
+            tSystemError("Session too large for memory store: %d bytes", cost);
+        }
+        addCost(s, before);
+    }
+
+    evictExcess();
+    return res;
+}
+
+
+bool TSessionMemoryStore::remove(const QDateTime &)
+{
+    // Expired by the timer of the main thread, not by request threads
+    return true;
+}
+
+
+bool TSessionMemoryStore::remove(const QByteArray &id)
+{
+    if (!stripes)
+        return false;
+
+    SessionStripe &s = stripe(id);
+    QMutexLocker locker(&s.mutex);
+    int before = s.cache.totalCost();
+    s.accessed.remove(id);
+    bool res = s.cache.remove(id);
+    addCost(s, before);
+    return res;
+}
+
+/*!
+  Removes the sessions not accessed since \a garbageExpiration, and
+  returns the number of the removed sessions.
+*/
+int TSessionMemoryStore::expire(const QDateTime &garbageExpiration)
+{
+    if (!stripes)
+        return 0;
+
+    int cnt = 0;
+    uint exp = garbageExpiration.toTime_t();
+    for (int i = 0; i < STRIPE_COUNT; ++i) {
+        SessionStripe &s = stripes[i];
+        QMutexLocker locker(&s.mutex);
+        int before = s.cache.totalCost();
+        QHash<QByteArray, uint>::iterator it = s.accessed.begin();
+        while (it != s.accessed.end()) {
+            if (it.value() < exp) {
+                s.cache.remove(it.key());
+                it = s.accessed.erase(it);
+                ++cnt;
+            } else if (!s.cache.contains(it.key())) {
+                it = s.accessed.erase(it);  // evicted
+            } else {
+                ++it;
+            }
+        }
+        addCost(s, before);
+    }
+    return cnt;
+}
+
+/*!
+ * Initializes the table and starts the expiry timer if the session
+ * store type is "memory".
+ * Call this in main thread.
+ */
+void TSessionMemoryStore::instantiate()
+{
+    if (stripes || TSessionManager::instance().storeType() != TSessionMemoryStore().key())
+        return;
+
+    if (Tf::app()->multiProcessingModule() != TWebApplication::Thread) {
+        tSystemWarn("Memory session store is not shared between processes; use it for the thread MPM");
+    }
+
+    maxTotalCost = qMax(Tf::app()->appSettings().value(MAX_MEMORY_SIZE, 65536).toInt(), 1) * 1024;
+    stripes = new SessionStripe[STRIPE_COUNT];
+    for (int i = 0; i < STRIPE_COUNT; ++i) {
+        stripes[i].cache.setMaxCost(maxTotalCost);  // bounded by the total
+    }
+    expirer = new TSessionMemoryExpirer();
+    qAddPostRoutine(cleanup);
+}
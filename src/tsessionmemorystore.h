@@ -0,0 +1,20 @@
+#ifndef TSESSIONMEMORYSTORE_H
+#define TSESSIONMEMORYSTORE_H
+
+#include <TSessionStore>
+
+
+class T_CORE_EXPORT TSessionMemoryStore : public TSessionStore
+{
+public:
+    QString key() const { return "memory"; }
+    TSession find(const QByteArray &id, const QDateTime &expiration);
+    bool store(TSession &session);
+    bool remove(const QDateTime &garbageExpiration);
+    bool remove(const QByteArray &id);
+
+    static void instantiate();
+    static int expire(const QDateTime &garbageExpiration);
+};
+
+#endif // TSESSIONMEMORYSTORE_H
@@ -0,0 +1,70 @@
+/* Copyright (c) 2010-2012, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <TWebApplication>
+#include <TSessionCodec>
+#include <TRedis>
+#include "tsessionredisstore.h"
+#include "tsystemglobal.h"
+
+#define GC_MAX_LIFE_TIME  "Session.GcMaxLifeTime"
+#define KEY_PREFIX        "tfsess:"
+
+/*!
+  \class TSessionRedisStore
+  \brief The TSessionRedisStore class stores HTTP sessions in a Redis
+  server, so that the application servers on several hosts share them.
+
+  Each session is stored by SETEX with the timeout of
+  Session.GcMaxLifeTime seconds; finding a session sends GET and EXPIRE
+  in one round trip to slide the timeout. The expired sessions are
+  removed by the server itself, so the garbage collection does nothing.
+  The connections are kept open in a pool of the process and reused by
+  the requests. The server is specified by the Redis.Server setting.
+  \sa TRedis
+*/
+
+static inline int lifeTime()
+{
+    return Tf::app()->appSettings().value(GC_MAX_LIFE_TIME).toInt();
+}
+
+
+TSession TSessionRedisStore::find(const QByteArray &id, const QDateTime &)
+{
+    bool found;
+    QByteArray data = TRedis::instance().getAndExpire(KEY_PREFIX + id, lifeTime(), &found);
+    if (!found)
+        return TSession();
+
+    TSession result(id);
+    result.updatedTime = QDateTime::currentDateTime();  // expiration slid above
+    return TSessionCodec::instance().decode(data, result) ? result : TSession();
+}
+
+
+bool TSessionRedisStore::store(TSession &session)
+{
+    bool res = TRedis::instance().setEx(KEY_PREFIX + session.id(), TSessionCodec::instance().encode(session), lifeTime());
+    if (!res) {
+        tSystemError("Failed to store session in Redis: %s", session.id().data());
+    }
+    return res;
+}
+
+
+bool TSessionRedisStore::remove(const QDateTime &)
+{
+    // Expired by the Redis server
+    return true;
+}
+
+
+bool TSessionRedisStore::remove(const QByteArray &id)
+{
+    return TRedis::instance().remove(KEY_PREFIX + id);
+}
@@ -0,0 +1,17 @@
+#ifndef TSESSIONREDISSTORE_H
+#define TSESSIONREDISSTORE_H
+
+#include <TSessionStore>
+
+
+class T_CORE_EXPORT TSessionRedisStore : public TSessionStore
+{
+public:
+    QString key() const { return "redis"; }
+    TSession find(const QByteArray &id, const QDateTime &expiration);
+    bool store(TSession &session);
+    bool remove(const QDateTime &garbageExpiration);
+    bool remove(const QByteArray &id);
+};
+
+#endif // TSESSIONREDISSTORE_H
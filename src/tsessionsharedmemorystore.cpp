@@ -0,0 +1,363 @@
+/* Copyright (c) 2010-2012, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <QSharedMemory>
+#include <TWebApplication>
+#include <TSessionCodec>
+#include <TSessionSharedMemoryStore>
+#include "tsystemglobal.h"
+#include "tprocessspinlock.h"
+
+#define STORE_TYPE        "Session.StoreType"
+#define SLOT_COUNT        "Session.SharedMemoryStoreSlotCount"
+#define VALUE_SIZE        "Session.SharedMemoryStoreValueSize"
+#define CREATE_KEY        "TreeFrogSession"
+#define TABLE_MAGIC       0x54465332  // "TFS2"
+#define MAX_ID_LENGTH     64
+#define PROBE_LIMIT       16
+#define STORE_RETRY_LIMIT 8
+
+/*!
+  \class TSessionSharedMemoryStore
+  \brief The TSessionSharedMemoryStore class stores HTTP sessions in
+  shared memory, so that all the server processes on a host share them.
+
+  The shared memory holds a fixed-size hash table of slots; each slot
+  has a session ID, the time of the last access and a value area of
+  Session.SharedMemoryStoreValueSize bytes, and is guarded by its own
+  TProcessSpinLock. A session larger than the value area can't be
+  stored. When all the slots probed for an ID are in use, the least
+  recently accessed one is reused.
+
+  The segment is created and sized by tfmanager at startup, and the
+  application servers attach to it.
+*/
+
+struct TableHeader
+{
+    quint32 magic;
+    quint32 slotCount;
+    quint32 valueSize;
+    quint32 reserved;
+};
+
+
+struct SlotHeader
+{
+    QBasicAtomicInt lock;
+    quint32 idLength;  // 0 means empty
+    quint32 accessed;  // time_t
+    quint32 dataLength;
+    quint32 version;   // incremented on each change
+    quint32 reserved;
+    char id[MAX_ID_LENGTH];
+};
+
+
+static QSharedMemory *sharedMemory = 0;
+
+
+static void cleanup()
+{
+    delete sharedMemory;
+    sharedMemory = 0;
+}
+
+
+static inline void lockSlot(SlotHeader *slot)
+{
+    bool recovered;
+    TProcessSpinLock::lock(slot->lock, &recovered);
+    if (recovered) {
+        // May be half-written by the dead owner
+        slot->idLength = 0;
+        slot->dataLength = 0;
+        slot->version++;
+    }
+}
+
+
+static inline void unlockSlot(SlotHeader *slot)
+{
+    TProcessSpinLock::unlock(slot->lock);
+}
+
+
+class SessionTable
+{
+public:
+    SessionTable(QSharedMemory *memory)
+        : header(0), slotSize(0)
+    {
+        if (memory && memory->data()) {
+            header = static_cast<TableHeader *>(memory->data());
+            slotSize = (sizeof(SlotHeader) + header->valueSize + 7) & ~7;
+        }
+    }
+
+    bool isValid() const { return header && header->magic == TABLE_MAGIC; }
+    int count() const { return header->slotCount; }
+    int valueSize() const { return header->valueSize; }
+
+    SlotHeader *slot(int i) const
+    {
+        return reinterpret_cast<SlotHeader *>((char *)header + sizeof(TableHeader) + (size_t)slotSize * i);
+    }
+
+    char *value(SlotHeader *slot) const
+    {
+        return reinterpret_cast<char *>(slot) + sizeof(SlotHeader);
+    }
+
+    int startIndex(const QByteArray &id) const
+    {
+        return qHash(id) % header->slotCount;
+    }
+
+    static bool matches(const SlotHeader *slot, const QByteArray &id)
+    {
+        return slot->idLength == (uint)id.length() && memcmp(slot->id, id.constData(), id.length()) == 0;
+    }
+
+    static void clear(SlotHeader *slot)
+    {
+        slot->idLength = 0;
+        slot->dataLength = 0;
+        slot->version++;
+    }
+
+private:
+    TableHeader *header;
+    int slotSize;
+};
+
+
+TSession TSessionSharedMemoryStore::find(const QByteArray &id, const QDateTime &expiration)
+{
+    SessionTable table(sharedMemory);
+    if (!table.isValid()) {
+        tSystemError("Shared memory session store not initialized");
+        return TSession();
+    }
+
+    QByteArray data;
+    uint exp = expiration.toTime_t();
+    int idx = table.startIndex(id);
+
+    for (int i = 0; i < PROBE_LIMIT && i < table.count(); ++i) {
+        SlotHeader *slot = table.slot((idx + i) % table.count());
+        lockSlot(slot);
+        if (SessionTable::matches(slot, id)) {
+            if (slot->accessed < exp) {
+                SessionTable::clear(slot);
+            } else {
+                slot->accessed = QDateTime::currentDateTime().toTime_t();  // slides the expiration
+                slot->version++;
+                data = QByteArray(table.value(slot), slot->dataLength);
+            }
+            unlockSlot(slot);
+            break;
+        }
+        unlockSlot(slot);
+    }
+
+    if (data.isEmpty())
+        return TSession();
+
+    TSession result(id);
+    result.updatedTime = QDateTime::currentDateTime();  // expiration slid above
+    return TSessionCodec::instance().decode(data, result) ? result : TSession();
+}
+
+
+bool TSessionSharedMemoryStore::store(TSession &session)
+{
+    SessionTable table(sharedMemory);
+    if (!table.isValid()) {
+        tSystemError("Shared memory session store not initialized");
+        return false;
+    }
+
+    const QByteArray &id = session.id();
+    if (id.length() > MAX_ID_LENGTH) {
+        tSystemError("Session ID too long for shared memory store: %d", id.length());
+        return false;
+    }
+
+    QByteArray data = TSessionCodec::instance().encode(session);
+    if (data.size() > table.valueSize()) {
+        tSystemError("Session too large for shared memory store: %d bytes", data.size());
+        return false;
+    }
+
+    uint now = QDateTime::currentDateTime().toTime_t();
+    int idx = table.startIndex(id);
+    SlotHeader *target = 0;
+
+    for (int retry = 0; retry < STORE_RETRY_LIMIT && !target; ++retry) {
+        SlotHeader *candidate = 0;
+        quint32 candidateIdLength = 0;
+        quint32 candidateAccessed = 0;
+        quint32 candidateVersion = 0;
+
+        for (int i = 0; i < PROBE_LIMIT && i < table.count(); ++i) {
+            SlotHeader *slot = table.slot((idx + i) % table.count());
+            lockSlot(slot);
+            if (SessionTable::matches(slot, id)) {
+                target = slot;  // keeps locked
+                break;
+            }
+
+            // Empty slot, or the least recently accessed one
+            if (!candidate || (candidateIdLength > 0 && (slot->idLength == 0 || slot->accessed < candidateAccessed))) {
+                candidate = slot;
+                candidateIdLength = slot->idLength;
+                candidateAccessed = slot->accessed;
+                candidateVersion = slot->version;
+            }
+            unlockSlot(slot);
+        }
+
+        if (!target && candidate) {
+            lockSlot(candidate);
+            if (SessionTable::matches(candidate, id)) {
+                target = candidate;  // stored by another thread meanwhile
+            } else if (candidate->version == candidateVersion) {
+                if (candidateIdLength > 0) {
+                    tSystemDebug("Session evicted from shared memory store");
+                }
+                target = candidate;
+            } else {
+                unlockSlot(candidate);  // changed since probed; probes again
+            }
+        }
+    }
+
+    if (!target) {
+        tSystemError("Shared memory session store busy; session not stored");
+        return false;
+    }
+
+    memcpy(target->id, id.constData(), id.length());
+    memcpy(table.value(target), data.constData(), data.size());
+    target->idLength = id.length();
+    target->dataLength = data.size();
+    target->accessed = now;
+    target->version++;
+    unlockSlot(target);
+    return true;
+}
+
+
+bool TSessionSharedMemoryStore::remove(const QDateTime &garbageExpiration)
+{
+    SessionTable table(sharedMemory);
+    if (!table.isValid())
+        return false;
+
+    uint exp = garbageExpiration.toTime_t();
+    for (int i = 0; i < table.count(); ++i) {
+        SlotHeader *slot = table.slot(i);
+        if (slot->idLength == 0 || slot->accessed >= exp)
+            continue;
+
+        lockSlot(slot);
+        if (slot->idLength > 0 && slot->accessed < exp) {
+            SessionTable::clear(slot);
+        }
+        unlockSlot(slot);
+    }
+    return true;
+}
+
+
+bool TSessionSharedMemoryStore::remove(const QByteArray &id)
+{
+    SessionTable table(sharedMemory);
+    if (!table.isValid())
+        return false;
+
+    bool res = false;
+    int idx = table.startIndex(id);
+    for (int i = 0; i < PROBE_LIMIT && i < table.count(); ++i) {
+        SlotHeader *slot = table.slot((idx + i) % table.count());
+        lockSlot(slot);
+        if (SessionTable::matches(slot, id)) {
+            SessionTable::clear(slot);  // and duplicates left by a race, if any
+            res = true;
+        }
+        unlockSlot(slot);
+    }
+    return res;
+}
+
+/*!
+  Creates the shared memory segment sized by the settings, or attaches
+  to the existing one, if the session store type is "sharedmemory".
+  Returns the segment, which the caller must keep until it exits, or 0.
+*/
+QSharedMemory *TSessionSharedMemoryStore::createSharedMemory()
+{
+    QSettings &settings = Tf::app()->appSettings();
+    if (settings.value(STORE_TYPE).toString().toLower() != TSessionSharedMemoryStore().key())
+        return 0;
+
+    quint32 slotCount = qMax(settings.value(SLOT_COUNT, 10000).toInt(), PROBE_LIMIT);
+    quint32 valueSize = qMax(settings.value(VALUE_SIZE, 4096).toInt(), 64);
+    int slotSize = (sizeof(SlotHeader) + valueSize + 7) & ~7;
+
+    // One segment per application on the host
+    QString memKey = QLatin1String(CREATE_KEY) + QLatin1Char('_') + QString::number(qHash(Tf::app()->webRootPath()));
+    QSharedMemory *memory = new QSharedMemory(memKey);
+
+    if (memory->create(sizeof(TableHeader) + slotSize * slotCount)) {
+        memory->lock();
+        TableHeader *header = static_cast<TableHeader *>(memory->data());
+        header->slotCount = slotCount;
+        header->valueSize = valueSize;
+        header->magic = TABLE_MAGIC;  // zero-filled slots are empty
+        memory->unlock();
+        tSystemDebug("Shared memory session store created: %d slots", slotCount);
+
+    } else if (memory->error() == QSharedMemory::AlreadyExists && memory->attach()) {
+        bool valid = false;
+        for (int i = 0; i < 100 && !valid; ++i) {
+            if (i > 0) {
+                Tf::msleep(10);  // waits for the creator to initialize
+            }
+            memory->lock();
+            valid = (static_cast<TableHeader *>(memory->data())->magic == TABLE_MAGIC);
+            memory->unlock();
+        }
+
+        if (!valid) {
+            tSystemError("Invalid shared memory session store");
+            delete memory;
+            memory = 0;
+        }
+    } else {
+        tSystemError("Shared memory error: %s", qPrintable(memory->errorString()));
+        delete memory;
+        memory = 0;
+    }
+    return memory;
+}
+
+/*!
+ * Attaches to the shared memory if the session store type is
+ * "sharedmemory".
+ * Call this in main thread.
+ */
+void TSessionSharedMemoryStore::instantiate()
+{
+    if (!sharedMemory) {
+        sharedMemory = createSharedMemory();
+        if (sharedMemory) {
+            qAddPostRoutine(cleanup);
+        }
+    }
+}
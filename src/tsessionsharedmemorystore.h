@@ -0,0 +1,22 @@
+#ifndef TSESSIONSHAREDMEMORYSTORE_H
+#define TSESSIONSHAREDMEMORYSTORE_H
+
+#include <TSessionStore>
+
+class QSharedMemory;
+
+
+class T_CORE_EXPORT TSessionSharedMemoryStore : public TSessionStore
+{
+public:
+    QString key() const { return "sharedmemory"; }
+    TSession find(const QByteArray &id, const QDateTime &expiration);
+    bool store(TSession &session);
+    bool remove(const QDateTime &garbageExpiration);
+    bool remove(const QByteArray &id);
+
+    static void instantiate();
+    static QSharedMemory *createSharedMemory();
+};
+
+#endif // TSESSIONSHAREDMEMORYSTORE_H
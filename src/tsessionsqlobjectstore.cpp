@@ -6,66 +6,193 @@
  */
 
 #include <TSqlORMapper>
+#include <TSqlQuery>
+#include <TSqlStatementCache>
 #include <TCriteria>
+#include <TActionContext>
+#include <TSessionCodec>
 #include "tsessionsqlobjectstore.h"
 #include "tsessionobject.h"
+#include "tsystemglobal.h"
+
+#define GC_BATCH_SIZE  1000
 
 /*!
   \class TSessionSqlObjectStore
   \brief The TSessionSqlObjectStore class stores HTTP sessions into database
          system using object-relational mapping tool.
+
+  A session is read by a SELECT statement and written by an upsert
+  statement of the database, that is, INSERT ... ON CONFLICT for
+  PostgreSQL, INSERT ... ON DUPLICATE KEY UPDATE for MySQL and INSERT OR
+  REPLACE for SQLite; for other databases, an UPDATE statement followed
+  by an INSERT statement if no row is updated. The statements take bound
+  values and are prepared once for each connection by
+  TSqlStatementCache.
+
+  The recommended schema is:
+  \code
+  CREATE TABLE session ( id VARCHAR(50) PRIMARY KEY, data BLOB, updated_at TIMESTAMP );
+  CREATE INDEX session_updated_at ON session (updated_at);
+  \endcode
+  The index is used by the garbage collection; use BYTEA instead of
+  BLOB for PostgreSQL.
   \sa TSessionObject
 */
 
-/* create table session ( id varchar(50) primary key, data blob, updated_at datetime ); */
+class SessionTable
+{
+public:
+    SessionTable(QSqlDatabase &database)
+        : db(database)
+    {
+        table = TSqlQuery::escapeIdentifier(TSessionObject().tableName(), QSqlDriver::TableName, db);
+        id = TSqlQuery::escapeIdentifier("id", QSqlDriver::FieldName, db);
+        data = TSqlQuery::escapeIdentifier("data", QSqlDriver::FieldName, db);
+        updatedAt = TSqlQuery::escapeIdentifier("updated_at", QSqlDriver::FieldName, db);
+    }
+
+    QSqlDatabase &db;
+    QString table;
+    QString id;
+    QString data;
+    QString updatedAt;
+};
+
+
+static bool execute(QSqlDatabase &db, const QString &sql, const QList<QVariant> &values, int *numRowsAffected = 0)
+{
+    QSqlQuery query;
+    bool ret = TSqlStatementCache::exec(db, sql, values, query);
+    if (ret) {
+        if (numRowsAffected) {
+            *numRowsAffected = query.numRowsAffected();
+        }
+    } else {
+        tSystemError("SQL error: %s", qPrintable(query.lastError().text()));
+    }
+    TSqlStatementCache::release(db, sql, query);
+    return ret;
+}
+
 
 bool TSessionSqlObjectStore::store(TSession &session)
 {
-    TSqlORMapper<TSessionObject> mapper;
-    TCriteria cri(TSessionObject::Id, TSql::Equal, session.id());
-    TSessionObject so = mapper.findFirst(cri);
+    SessionTable t(TActionContext::current()->getPrimaryDatabase(TSessionObject().databaseId()));
+    QVariant id = QString::fromLatin1(session.id());
+    QVariant data = TSessionCodec::instance().encode(session);
+    QVariant now = QDateTime::currentDateTime();
+    QString driver = t.db.driverName().toUpper();
+
+    QList<QVariant> values;
+    values << id << data << now;
+    QString insert = QLatin1String("INSERT INTO ") + t.table + QLatin1String(" (") + t.id + QLatin1String(", ") + t.data
+        + QLatin1String(", ") + t.updatedAt + QLatin1String(") VALUES (?, ?, ?)");
 
-    QDataStream ds(&so.data, QIODevice::WriteOnly);
-    ds << *static_cast<const QVariantHash *>(&session);
+    if (driver.startsWith(QLatin1String("QPSQL"))) {
+        return execute(t.db, insert + QLatin1String(" ON CONFLICT (") + t.id + QLatin1String(") DO UPDATE SET ")
+                       + t.data + QLatin1String(" = EXCLUDED.") + t.data + QLatin1String(", ")
+                       + t.updatedAt + QLatin1String(" = EXCLUDED.") + t.updatedAt, values);
 
-    if (so.isEmpty()) {
-        so.id = session.id();
-        return so.create();
+    } else if (driver.startsWith(QLatin1String("QMYSQL"))) {
+        return execute(t.db, insert + QLatin1String(" ON DUPLICATE KEY UPDATE ")
+                       + t.data + QLatin1String(" = VALUES(") + t.data + QLatin1String("), ")
+                       + t.updatedAt + QLatin1String(" = VALUES(") + t.updatedAt + QLatin1String(")"), values);
+
+    } else if (driver.startsWith(QLatin1String("QSQLITE"))) {
+        return execute(t.db, QLatin1String("INSERT OR REPLACE") + insert.mid(6), values);
     }
-    return so.update();
+
+    // Other databases
+    QList<QVariant> updateValues;
+    updateValues << data << now << id;
+    QString update = QLatin1String("UPDATE ") + t.table + QLatin1String(" SET ") + t.data + QLatin1String(" = ?, ")
+        + t.updatedAt + QLatin1String(" = ? WHERE ") + t.id + QLatin1String(" = ?");
+
+    int rows = 0;
+    if (!execute(t.db, update, updateValues, &rows))
+        return false;
+
+    return (rows > 0) || execute(t.db, insert, values);
 }
 
 
 TSession TSessionSqlObjectStore::find(const QByteArray &id, const QDateTime &modified)
 {
-    TSqlORMapper<TSessionObject> mapper;
-    TCriteria cri;
-    cri.add(TSessionObject::Id, TSql::Equal, id);
-    cri.add(TSessionObject::UpdatedAt, TSql::GreaterEqual, modified);
+    SessionTable t(TActionContext::current()->getPrimaryDatabase(TSessionObject().databaseId()));
+    QString select = QLatin1String("SELECT ") + t.data + QLatin1String(", ") + t.updatedAt + QLatin1String(" FROM ")
+        + t.table + QLatin1String(" WHERE ") + t.id + QLatin1String(" = ? AND ") + t.updatedAt + QLatin1String(" >= ?");
+
+    QList<QVariant> values;
+    values << QString::fromLatin1(id) << modified;
 
-    TSessionObject sess = mapper.findFirst(cri);
-    if (sess.isEmpty())
+    QSqlQuery query;
+    QByteArray data;
+    QDateTime updated;
+    bool found = TSqlStatementCache::exec(t.db, select, values, query);
+    if (found) {
+        found = query.next();
+        if (found) {
+            data = query.value(0).toByteArray();
+            updated = query.value(1).toDateTime();
+        }
+    } else {
+        tSystemError("SQL error: %s", qPrintable(query.lastError().text()));
+    }
+    TSqlStatementCache::release(t.db, select, query);
+
+    if (!found)
         return TSession();
-    
+
     TSession result(id);
-    QDataStream ds(&sess.data, QIODevice::ReadOnly);
-    ds >> *static_cast<QVariantHash *>(&result);
-    return result;  
+    if (!TSessionCodec::instance().decode(data, result))
+        return TSession();
+
+    result.updatedTime = updated;
+    return result;
 }
 
 
+/*!
+  Removes the sessions updated before \a garbageExpiration, in batches
+  of about GC_BATCH_SIZE rows from the oldest, so that each DELETE
+  statement holds the locks briefly.
+*/
 bool TSessionSqlObjectStore::remove(const QDateTime &garbageExpiration)
 {
     TSqlORMapper<TSessionObject> mapper;
-    TCriteria cri(TSessionObject::UpdatedAt, TSql::LessThan, garbageExpiration);
-    int cnt = mapper.removeAll(cri);
-    return (cnt >= 0);
+    mapper.setSort(TSessionObject::UpdatedAt, TSql::AscendingOrder);
+    mapper.setOffset(GC_BATCH_SIZE);
+
+    for (;;) {
+        // The oldest session next to a batch
+        TSessionObject so = mapper.findFirst(TCriteria(TSessionObject::UpdatedAt, TSql::LessThan, garbageExpiration));
+        QDateTime boundary = (so.isEmpty()) ? garbageExpiration : so.updated_at;
+
+        int cnt = mapper.removeAll(TCriteria(TSessionObject::UpdatedAt, TSql::LessThan, boundary));
+        if (cnt == 0 && !so.isEmpty()) {
+            // All of the batch updated at the same time
+            cnt = mapper.removeAll(TCriteria(TSessionObject::UpdatedAt, TSql::LessEqual, boundary));
+        }
+
+        if (cnt < 0)
+            return false;
+
+        if (so.isEmpty() || cnt == 0)
+            break;
+    }
+    return true;
 }
 
 
 bool TSessionSqlObjectStore::remove(const QByteArray &id)
 {
-    TSqlORMapper<TSessionObject> mapper;
-    int cnt = mapper.removeAll(TCriteria(TSessionObject::Id, id));
-    return (cnt > 0);
+    SessionTable t(TActionContext::current()->getPrimaryDatabase(TSessionObject().databaseId()));
+    QString del = QLatin1String("DELETE FROM ") + t.table + QLatin1String(" WHERE ") + t.id + QLatin1String(" = ?");
+
+    QList<QVariant> values;
+    values << QString::fromLatin1(id);
+
+    int rows = 0;
+    return execute(t.db, del, values, &rows) && rows > 0;
 }
@@ -11,30 +11,43 @@
 #include <QPluginLoader>
 #include <QMutex>
 #include <QMutexLocker>
+#include <QAtomicPointer>
 #include <TWebApplication>
 #include <TSessionStorePlugin>
 #include "tsessionstorefactory.h"
 #include "tsessionsqlobjectstore.h"
 #include "tsessioncookiestore.h"
 #include "tsessionfilestore.h"
+#include "tsessionmemorystore.h"
+#include "tsessionsharedmemorystore.h"
+#include "tsessionmemcachedstore.h"
+#include "tsessionredisstore.h"
 #include "tsystemglobal.h"
 
 static QMutex mutex;
 static QHash<QString, int> hash;
-static QList<TSessionStoreInterface *> *ssifs = 0;
+static QBasicAtomicPointer<QList<TSessionStoreInterface *> > ssifs = Q_BASIC_ATOMIC_INITIALIZER(0);
 
 /*!
   \class TSessionStoreFactory
   \brief The TSessionStoreFactory class creates TSessionStore objects.
+
+  The plugins are loaded once by instantiate() at startup; after that,
+  create() takes no lock.
 */
 
 static void cleanup()
 {
     QMutexLocker locker(&mutex);
+    delete ssifs.fetchAndStoreOrdered(0);
+}
+
 
-    if (ssifs)
-        delete ssifs;
-    ssifs = 0;
+static inline QList<TSessionStoreInterface *> *loadedInterfaces()
+{
+    // Acquire load, which pairs with the release store in loadPlugins();
+    // Qt 4 has no loadAcquire()
+    return ssifs.fetchAndAddAcquire(0);
 }
 
 
@@ -46,9 +59,13 @@ QStringList TSessionStoreFactory::keys()
     QStringList ret;
     ret << TSessionSqlObjectStore().key()
         << TSessionCookieStore().key()
-        << TSessionFileStore().key();
+        << TSessionFileStore().key()
+        << TSessionMemoryStore().key()
+        << TSessionSharedMemoryStore().key()
+        << TSessionMemcachedStore().key()
+        << TSessionRedisStore().key();
 
-    for (QListIterator<TSessionStoreInterface *> i(*ssifs); i.hasNext(); ) {
+    for (QListIterator<TSessionStoreInterface *> i(*loadedInterfaces()); i.hasNext(); ) {
         ret << i.next()->keys();
     }
     return ret;
@@ -59,9 +76,14 @@ TSessionStore *TSessionStoreFactory::create(const QString &key)
 {
     T_TRACEFUNC("key: %s", qPrintable(key));
 
-    QMutexLocker locker(&mutex);
- 
-    loadPlugins();
+    QList<TSessionStoreInterface *> *ifaces = loadedInterfaces();
+    if (!ifaces) {
+        // Not instantiated
+        QMutexLocker locker(&mutex);
+        loadPlugins();
+        ifaces = loadedInterfaces();
+    }
+
     TSessionStore *ret = 0;
     QString k = key.toLower();
     int type = hash.value(k, Invalid);
@@ -78,8 +100,24 @@ TSessionStore *TSessionStoreFactory::create(const QString &key)
         ret = new TSessionFileStore;
         break;
 
+    case Memory:
+        ret = new TSessionMemoryStore;
+        break;
+
+    case SharedMemory:
+        ret = new TSessionSharedMemoryStore;
+        break;
+
+    case Memcached:
+        ret = new TSessionMemcachedStore;
+        break;
+
+    case Redis:
+        ret = new TSessionRedisStore;
+        break;
+
     case Plugin: {
-        for (QListIterator<TSessionStoreInterface *> i(*ssifs); i.hasNext(); ) {
+        for (QListIterator<TSessionStoreInterface *> i(*ifaces); i.hasNext(); ) {
              TSessionStoreInterface *p = i.next();
              if (p->keys().contains(k)) {
                  ret = p->create(k);
@@ -96,17 +134,47 @@ TSessionStore *TSessionStoreFactory::create(const QString &key)
     return ret;
 }
 
+/*!
+  Returns true if the session store of the key \a key is built in. The
+  built-in stores have no state, so one object of them can be shared by
+  all the threads; a plugin store is created for each use.
+*/
+bool TSessionStoreFactory::isBuiltIn(const QString &key)
+{
+    if (!loadedInterfaces()) {
+        QMutexLocker locker(&mutex);
+        loadPlugins();
+    }
+
+    int type = hash.value(key.toLower(), Invalid);
+    return (type != Invalid && type != Plugin);
+}
+
+
+/*!
+ * Loads the session store plugins.
+ * Call this in main thread.
+ */
+void TSessionStoreFactory::instantiate()
+{
+    QMutexLocker locker(&mutex);
+    loadPlugins();
+}
+
 
 void TSessionStoreFactory::loadPlugins()
 {
-    if (!ssifs) {
-        ssifs = new QList<TSessionStoreInterface *>();
-        qAddPostRoutine(cleanup);
-        
+    if (!loadedInterfaces()) {
+        QList<TSessionStoreInterface *> *ifaces = new QList<TSessionStoreInterface *>();
+
         // Init hash
         hash.insert(TSessionSqlObjectStore().key().toLower(), SqlObject);
         hash.insert(TSessionCookieStore().key().toLower(), Cookie);
         hash.insert(TSessionFileStore().key().toLower(), File);
+        hash.insert(TSessionMemoryStore().key().toLower(), Memory);
+        hash.insert(TSessionSharedMemoryStore().key().toLower(), SharedMemory);
+        hash.insert(TSessionMemcachedStore().key().toLower(), Memcached);
+        hash.insert(TSessionRedisStore().key().toLower(), Redis);
 
         QDir dir(Tf::app()->pluginPath());
         QStringList list = dir.entryList(QDir::Files);
@@ -114,12 +182,15 @@ void TSessionStoreFactory::loadPlugins()
             QPluginLoader loader(dir.absoluteFilePath(i.next()));
             TSessionStoreInterface *iface = qobject_cast<TSessionStoreInterface *>(loader.instance());
             if ( iface ) {
-                ssifs->append(iface);
+                ifaces->append(iface);
                 QStringList keys = iface->keys();
                 for (QStringListIterator j(keys); j.hasNext(); ) {
                     hash.insert(j.next(), Plugin);
                 }
-            }   
+            }
         }
+
+        ssifs.fetchAndStoreRelease(ifaces);  // publishes the hash; create() reads it without the lock
+        qAddPostRoutine(cleanup);
     }
 }
@@ -12,6 +12,8 @@ class T_CORE_EXPORT TSessionStoreFactory
 public:
     static QStringList keys();
     static TSessionStore *create(const QString &key);
+    static bool isBuiltIn(const QString &key);
+    static void instantiate();
 
 protected:
     enum StoreType {
@@ -19,6 +21,10 @@ protected:
         SqlObject,
         Cookie,
         File,
+        Memory,
+        SharedMemory,
+        Memcached,
+        Redis,
         Plugin,
     };
 
@@ -7,11 +7,86 @@
 
 #include <QMutexLocker>
 #include <QFileInfo>
+#include <QStringList>
+#include <QStack>
+#include <QSqlQuery>
+#include <QSqlError>
 #include <QDir>
 #include <TSqlDatabasePool>
+#include <TSqlStatementCache>
 #include <TWebApplication>
 #include "tsystemglobal.h"
 
+#define REPLICA_HOSTS        "ReplicaHosts"
+#define REPLICA_BALANCING    "ReplicaBalancing"
+#define MIN_IDLE             "SqlDatabasePool.MinIdle"
+#define WAIT_TIMEOUT         "SqlDatabasePool.WaitTimeout"
+#define IDLE_TIMEOUT         "SqlDatabasePool.IdleTimeout"
+#define VALIDATION_INTERVAL  "SqlDatabasePool.ValidationInterval"
+#define RETRY_INTERVAL       10000  // msecs
+
+/*!
+  \class TSqlDatabasePool
+  \brief The TSqlDatabasePool class manages the pooled connections of
+  the databases.
+
+  The idle connections are kept in a stack, so that the most recently
+  used one, whose prepared statements are likely cached, is handed out
+  first. If all the connections are in use, pop() waits for one to be
+  pushed back up to SqlDatabasePool.WaitTimeout milliseconds. A
+  connection idle for longer than SqlDatabasePool.ValidationInterval
+  seconds is validated by a trivial query before it's handed out, and
+  is reconnected if it's broken. In the thread module,
+  SqlDatabasePool.MinIdle connections of each database are opened at
+  startup and kept open; the other connections are closed after
+  SqlDatabasePool.IdleTimeout seconds idle.
+
+  Read replicas of a database are specified by the ReplicaHosts
+  parameter of the database settings, as a comma-separated list of
+  "host" or "host:port"; the other parameters are shared with the
+  primary. popReplica() balances the connections among the replicas in
+  round-robin order, or to the replica with the least connections in
+  use if the ReplicaBalancing parameter is "LeastConnections". A replica
+  that fails to connect is not tried again for ten seconds.
+  \sa TActionContext::getReadDatabase()
+*/
+
+/*!
+  \class TSqlDatabasePool::Statistics
+  \brief The Statistics class holds the counters of a connection pool.
+  The times are in milliseconds.
+*/
+
+struct IdleConnection
+{
+    QString name;
+    qint64 time;  // pushed back
+};
+
+
+struct TSqlDatabasePool::Pool
+{
+    QStack<IdleConnection> idle;  // most recently used on top
+    QStack<QString> closed;
+    int busy;
+    qint64 retryTime;  // replica down until
+    Statistics stats;
+
+    Pool() : busy(0), retryTime(0) { }
+};
+
+
+struct TSqlDatabasePool::ReplicaGroup
+{
+    QVector<Pool *> replicas;
+    bool leastConnections;
+    int next;
+
+    ReplicaGroup() : leastConnections(false), next(0) { }
+    ~ReplicaGroup() { qDeleteAll(replicas); }
+};
+
+
 static TSqlDatabasePool *databasePool = 0;
 
 
@@ -24,106 +99,323 @@ static void cleanup()
 }
 
 
+static bool validateConnection(QSqlDatabase &database)
+{
+    QString driver = database.driverName().toUpper();
+    if (driver.startsWith(QLatin1String("QSQLITE")))
+        return database.isOpen();
+
+    QString sql;
+    if (driver.startsWith(QLatin1String("QOCI"))) {
+        sql = QLatin1String("SELECT 1 FROM DUAL");
+    } else if (driver.startsWith(QLatin1String("QDB2"))) {
+        sql = QLatin1String("SELECT 1 FROM SYSIBM.SYSDUMMY1");
+    } else if (driver.startsWith(QLatin1String("QIBASE"))) {
+        sql = QLatin1String("SELECT 1 FROM RDB$DATABASE");
+    } else {
+        sql = QLatin1String("SELECT 1");
+    }
+
+    QSqlQuery query(database);
+    if (!query.exec(sql)) {
+        tSystemWarn("Pooled database connection broken: %s  %s", qPrintable(database.connectionName()), qPrintable(query.lastError().text()));
+        return false;
+    }
+    return true;
+}
+
+
 TSqlDatabasePool::~TSqlDatabasePool()
 {
     timer.stop();
+    TSqlStatementCache::clearAll();
 
     QMutexLocker locker(&mutex);
-    for (int j = 0; j < pooledConnections.count(); ++j) {
-        QMap<QString, QDateTime> &map = pooledConnections[j];
-        QMap<QString, QDateTime>::iterator it = map.begin();
-        while (it != map.end()) {
-            QSqlDatabase::database(it.key(), false).close();
-            it = map.erase(it);
-        }
-        
-        for (int i = 0; i < maxConnections; ++i) {
-            QString name = QString::number(j) + '_' + QString::number(i);
-            if (QSqlDatabase::contains(name)) {
-                QSqlDatabase::removeDatabase(name);
-            } else {
-                break;
-            }
-        }
+    for (QHashIterator<QString, Connection> it(connections); it.hasNext(); ) {
+        it.next();
+        QSqlDatabase::database(it.key(), false).close();
+        QSqlDatabase::removeDatabase(it.key());
     }
+    connections.clear();
+
+    qDeleteAll(pools);
+    pools.clear();
+    qDeleteAll(replicaGroups);
+    replicaGroups.clear();
 }
 
 
 TSqlDatabasePool::TSqlDatabasePool(const QString &environment)
-    : QObject(), maxConnections(0), dbEnvironment(environment)
+    : QObject(), maxConnections(0), minIdle(0), waitTimeout(5000), idleTimeout(30),
+      validationInterval(30), dbEnvironment(environment)
 {
     // Starts the timer to close extra-connection
     timer.start(10000, this); 
 }
 
 
+TSqlDatabasePool::Pool *TSqlDatabasePool::addPool(const QString &type, int databaseId, int replica)
+{
+    Pool *pool = new Pool;
+    for (int i = maxConnections - 1; i >= 0; --i) {
+        QString name = (replica < 0) ? QString().sprintf("%02d_%d", databaseId, i)
+            : QString().sprintf("%02d_r%d_%d", databaseId, replica, i);
+        QSqlDatabase db = QSqlDatabase::addDatabase(type, name);
+        if (!db.isValid()) {
+            tWarn("Parameter 'driverType' is invalid");
+            break;
+        }
+        tSystemDebug("Add Database successfully. name:%s", qPrintable(db.connectionName()));
+
+        Connection conn = { databaseId, replica };
+        connections.insert(name, conn);
+        pool->closed.push(name);
+    }
+    return pool;
+}
+
+
 void TSqlDatabasePool::init()
 {
     // Adds databases previously
     maxConnections = (Tf::app()->multiProcessingModule() == TWebApplication::Thread) ? Tf::app()->maxNumberOfServers() : 1;
 
+    QSettings &appSettings = Tf::app()->appSettings();
+    waitTimeout = qMax(appSettings.value(WAIT_TIMEOUT, 5000).toInt(), 0);
+    idleTimeout = qMax(appSettings.value(IDLE_TIMEOUT, 30).toInt(), 1);
+    validationInterval = appSettings.value(VALIDATION_INTERVAL, 30).toInt();
+    if (Tf::app()->multiProcessingModule() == TWebApplication::Thread) {
+        // Not to share connections among forked processes
+        minIdle = qBound(0, appSettings.value(MIN_IDLE, 0).toInt(), maxConnections);
+    }
+
     for (int j = 0; j < Tf::app()->databaseSettingsCount(); ++j) {
         QString type = driverType(dbEnvironment, j);
         if (type.isEmpty()) {
+            pools.append(0);
+            replicaGroups.append(0);
             continue;
         }
-        
-        for (int i = 0; i < maxConnections; ++i) {
-            QSqlDatabase db = QSqlDatabase::addDatabase(type, QString().sprintf("%02d_%d", j, i));
-            if (!db.isValid()) {
-                tWarn("Parameter 'driverType' is invalid");
-                break;
-            }
-            tSystemDebug("Add Database successfully. name:%s", qPrintable(db.connectionName())); 
+        pools.append(addPool(type, j, -1));
+
+        // Read replicas
+        QSettings &settings = Tf::app()->databaseSettings(j);
+        settings.beginGroup(dbEnvironment);
+        int replicaCount = settings.value(REPLICA_HOSTS).toStringList().count();
+        QString balancing = settings.value(REPLICA_BALANCING).toString().trimmed();
+        settings.endGroup();
+
+        ReplicaGroup *group = new ReplicaGroup;
+        group->leastConnections = (balancing.compare(QLatin1String("LeastConnections"), Qt::CaseInsensitive) == 0);
+        for (int r = 0; r < replicaCount; ++r) {
+            group->replicas << addPool(type, j, r);
+        }
+        replicaGroups.append(group);
+    }
+
+    // Opens the minimum idle connections
+    for (int j = 0; j < pools.count(); ++j) {
+        if (!pools[j])
+            continue;
+
+        warmUp(pools[j], j, -1);
+        for (int r = 0; r < replicaGroups[j]->replicas.count(); ++r) {
+            warmUp(replicaGroups[j]->replicas[r], j, r);
+        }
+    }
+}
+
+
+void TSqlDatabasePool::warmUp(Pool *pool, int databaseId, int replica)
+{
+    qint64 now = Tf::currentMSecsSinceEpoch();
+    while (pool->idle.count() < minIdle && !pool->closed.isEmpty()) {
+        QString name = pool->closed.pop();
+        QSqlDatabase db = QSqlDatabase::database(name, false);
+        if (!openDatabase(db, dbEnvironment, databaseId, replica)) {
+            pool->closed.push(name);
+            break;
+        }
+
+        IdleConnection conn = { name, now };
+        pool->idle.push(conn);
+    }
+}
+
+/*!
+  Takes a connection out of the \a pool; must be called with the mutex
+  locked. Returns false if all the connections are in use.
+*/
+bool TSqlDatabasePool::take(Pool *pool, QString &name, qint64 &idleTime)
+{
+    if (!pool->idle.isEmpty()) {
+        IdleConnection conn = pool->idle.pop();
+        name = conn.name;
+        idleTime = Tf::currentMSecsSinceEpoch() - conn.time;
+    } else if (!pool->closed.isEmpty()) {
+        name = pool->closed.pop();
+        idleTime = -1;
+    } else {
+        return false;
+    }
+
+    ++pool->busy;
+    ++pool->stats.popCount;
+    return true;
+}
+
+/*!
+  Returns the open connection of the \a name taken out of the \a pool,
+  validating or opening it. If it fails, gives the connection back to
+  the pool and returns an invalid object.
+*/
+QSqlDatabase TSqlDatabasePool::prepare(Pool *pool, const QString &name, qint64 idleTime, int databaseId, int replica)
+{
+    QSqlDatabase db = QSqlDatabase::database(name, false);
+
+    if (idleTime >= 0 && validationInterval >= 0 && idleTime > validationInterval * 1000LL) {
+        if (!validateConnection(db)) {
+            TSqlStatementCache::clear(name);
+            db.close();
         }
+    }
 
-        pooledConnections.append(QMap<QString, QDateTime>());
+    if (!db.isOpen() && !openDatabase(db, dbEnvironment, databaseId, replica)) {
+        QMutexLocker locker(&mutex);
+        pool->closed.push(name);
+        --pool->busy;
+        released.wakeAll();
+        return QSqlDatabase();
     }
+
+    tSystemDebug("pop database: %s", qPrintable(db.connectionName()));
+    return db;
 }
 
 
 QSqlDatabase TSqlDatabasePool::pop(int databaseId)
 {
     T_TRACEFUNC();
-    QMutexLocker locker(&mutex);
 
-    QSqlDatabase db;
-    if (databaseId < 0 || databaseId >= pooledConnections.count())
-        return db;
-
-    if (maxConnections > 0) {
-        QMap<QString, QDateTime> &map = pooledConnections[databaseId];
-        QMap<QString, QDateTime>::iterator it = map.begin();
-        while (it != map.end()) {
-            db = QSqlDatabase::database(it.key(), false);
-            it = map.erase(it);
-            if (db.isOpen()) {
-                tSystemDebug("pop database: %s", qPrintable(db.connectionName()));
-                return db;
-            } else {
-                tSystemError("Pooled database is not open: %s  [%s:%d]", qPrintable(db.connectionName()), __FILE__, __LINE__);
+    if (databaseId < 0 || databaseId >= pools.count() || !pools[databaseId])
+        return QSqlDatabase();
+
+    Pool *pool = pools[databaseId];
+    QString name;
+    qint64 idleTime;
+    {
+        QMutexLocker locker(&mutex);
+        if (!take(pool, name, idleTime)) {
+            // Waits for a connection pushed back
+            qint64 start = Tf::currentMSecsSinceEpoch();
+            qint64 waited = 0;
+            bool ok = false;
+            while (!ok && waited < waitTimeout) {
+                released.wait(&mutex, waitTimeout - waited);
+                ok = take(pool, name, idleTime);
+                waited = Tf::currentMSecsSinceEpoch() - start;
+            }
+
+            ++pool->stats.waitCount;
+            pool->stats.totalWaitTime += waited;
+            pool->stats.maxWaitTime = qMax(pool->stats.maxWaitTime, (int)waited);
+            if (!ok) {
+                ++pool->stats.timeoutCount;
+                throw RuntimeException("No pooled connection", __FILE__, __LINE__);
             }
         }
-        
-        for (int i = 0; i < maxConnections; ++i) {
-            db = QSqlDatabase::database(QString().sprintf("%02d_%d", databaseId, i), false);
-            if (!db.isOpen()) {
-                break;
+    }
+    return prepare(pool, name, idleTime, databaseId, -1);
+}
+
+/*!
+  Returns a connection to a read replica of the database \a databaseId.
+  Returns an invalid object if the database has no replicas or none of
+  them is available; the primary must be used then.
+*/
+QSqlDatabase TSqlDatabasePool::popReplica(int databaseId)
+{
+    T_TRACEFUNC();
+
+    if (!hasReplicas(databaseId))
+        return QSqlDatabase();
+
+    ReplicaGroup *group = replicaGroups[databaseId];
+    int count = group->replicas.count();
+    QList<int> order;  // order of the replicas to try
+    {
+        QMutexLocker locker(&mutex);
+        for (int k = 0; k < count; ++k) {
+            order << (group->next + k) % count;
+        }
+        group->next = (group->next + 1) % count;
+
+        if (group->leastConnections) {
+            for (int k = 1; k < order.count(); ++k) {
+                for (int m = k; m > 0 && group->replicas[order[m]]->busy < group->replicas[order[m - 1]]->busy; --m) {
+                    order.swap(m, m - 1);
+                }
             }
         }
-        
-        if (db.isOpen()) {
-            throw RuntimeException("No pooled connection", __FILE__, __LINE__);
+    }
+
+    for (int k = 0; k < order.count(); ++k) {
+        int r = order[k];
+        Pool *pool = group->replicas[r];
+        QString name;
+        qint64 idleTime;
+        {
+            QMutexLocker locker(&mutex);
+            if (pool->retryTime > Tf::currentMSecsSinceEpoch() || !take(pool, name, idleTime))
+                continue;  // down or all in use
         }
-        
-        openDatabase(db, dbEnvironment, databaseId);
-        tSystemDebug("pop database: %s", qPrintable(db.connectionName()));
+
+        QSqlDatabase db = prepare(pool, name, idleTime, databaseId, r);
+        if (db.isValid())
+            return db;
+
+        tSystemWarn("Replica unavailable, databaseId:%d replica:%d", databaseId, r);
+        QMutexLocker locker(&mutex);
+        pool->retryTime = Tf::currentMSecsSinceEpoch() + RETRY_INTERVAL;
     }
-    return db;
+    return QSqlDatabase();
+}
+
+/*!
+  Returns true if the database \a databaseId has read replicas;
+  otherwise returns false.
+*/
+bool TSqlDatabasePool::hasReplicas(int databaseId) const
+{
+    return databaseId >= 0 && databaseId < replicaGroups.count() && replicaGroups[databaseId]
+        && !replicaGroups[databaseId]->replicas.isEmpty();
+}
+
+/*!
+  Returns the statistics of the connections to the primary of the
+  database \a databaseId.
+*/
+TSqlDatabasePool::Statistics TSqlDatabasePool::statistics(int databaseId) const
+{
+    Statistics stats;
+    if (databaseId < 0 || databaseId >= pools.count() || !pools[databaseId])
+        return stats;
+
+    QMutexLocker locker(&mutex);
+    const Pool *pool = pools[databaseId];
+    stats = pool->stats;
+    stats.busyCount = pool->busy;
+    stats.idleCount = pool->idle.count();
+    return stats;
 }
 
 
-bool TSqlDatabasePool::openDatabase(QSqlDatabase &database, const QString &env, int databaseId)
+/*!
+  Opens the connection \a database to the database \a databaseId. If
+  \a replica is not negative, connects to the replica of the index
+  instead of the primary.
+*/
+bool TSqlDatabasePool::openDatabase(QSqlDatabase &database, const QString &env, int databaseId, int replica)
 {
     // Initiates database
     QSettings &settings = Tf::app()->databaseSettings(databaseId);
@@ -153,6 +445,19 @@ bool TSqlDatabasePool::openDatabase(QSqlDatabase &database, const QString &env,
         database.setHostName(hostName);
     
     int port = settings.value("Port").toInt();
+
+    if (replica >= 0) {
+        QString replicaHost = settings.value(REPLICA_HOSTS).toStringList().value(replica).trimmed();
+        int idx = replicaHost.lastIndexOf(QLatin1Char(':'));
+        hostName = (idx > 0) ? replicaHost.left(idx) : replicaHost;
+        if (idx > 0) {
+            port = replicaHost.mid(idx + 1).toInt();
+        }
+        tSystemDebug("Database Replica HostName: %s", qPrintable(hostName));
+        if (!hostName.isEmpty())
+            database.setHostName(hostName);
+    }
+
     tSystemDebug("Database Port: %d", port);
     if (port > 0)
         database.setPort(port);
@@ -188,23 +493,47 @@ bool TSqlDatabasePool::openDatabase(QSqlDatabase &database, const QString &env,
 void TSqlDatabasePool::push(QSqlDatabase &database)
 {
     T_TRACEFUNC();
-    QMutexLocker locker(&mutex);
 
     if (database.isValid()) {
-        bool ok;
-        int databaseId = database.connectionName().left(2).toInt(&ok);
-
-        if (ok && databaseId >= 0 && databaseId < pooledConnections.count()) {
-            pooledConnections[databaseId].insert(database.connectionName(), QDateTime::currentDateTime());
-            tSystemDebug("push database: %s", qPrintable(database.connectionName()));
+        QString name = database.connectionName();
+        QHash<QString, Connection>::const_iterator it = connections.constFind(name);
+        if (it != connections.constEnd()) {
+            const Connection &conn = it.value();
+            Pool *pool = (conn.replica < 0) ? pools[conn.databaseId] : replicaGroups[conn.databaseId]->replicas[conn.replica];
+
+            QMutexLocker locker(&mutex);
+            if (database.isOpen()) {
+                IdleConnection idle = { name, Tf::currentMSecsSinceEpoch() };
+                pool->idle.push(idle);
+            } else {
+                pool->closed.push(name);
+            }
+            --pool->busy;
+            released.wakeAll();
+            tSystemDebug("push database: %s", qPrintable(name));
         } else {
-            tSystemError("Invalid connection name: %s  [%s:%d]", qPrintable(database.connectionName()), __FILE__, __LINE__);
+            tSystemError("Invalid connection name: %s  [%s:%d]", qPrintable(name), __FILE__, __LINE__);
         }
     }
     database = QSqlDatabase();  // Sets an invalid object
 }
 
 
+void TSqlDatabasePool::closeIdleConnections(Pool *pool)
+{
+    // The least recently used at the bottom
+    qint64 expire = Tf::currentMSecsSinceEpoch() - idleTimeout * 1000LL;
+    while (pool->idle.count() > minIdle && pool->idle.first().time < expire) {
+        QString name = pool->idle.first().name;
+        pool->idle.remove(0);
+        TSqlStatementCache::clear(name);
+        QSqlDatabase::database(name, false).close();
+        pool->closed.push(name);
+        tSystemDebug("Closed database connection, name: %s", qPrintable(name));
+    }
+}
+
+
 void TSqlDatabasePool::timerEvent(QTimerEvent *event)
 {
     T_TRACEFUNC();
@@ -212,18 +541,13 @@ void TSqlDatabasePool::timerEvent(QTimerEvent *event)
     if (event->timerId() == timer.timerId()) {
         // Closes extra-connection
         if (mutex.tryLock()) {
-            for (int i = 0; i < pooledConnections.count(); ++i) {
-                QMap<QString, QDateTime> &map = pooledConnections[i];
-                QMap<QString, QDateTime>::iterator it = map.begin();
-                while (it != map.end()) {
-                    QDateTime dt = it.value();
-                    if (dt.addSecs(30) < QDateTime::currentDateTime()) {
-                        QSqlDatabase::database(it.key(), false).close();
-                        tSystemDebug("Closed database connection, name: %s", qPrintable(it.key()));
-                        it = map.erase(it);
-                    } else {
-                        ++it;
-                    }
+            for (int i = 0; i < pools.count(); ++i) {
+                if (!pools[i])
+                    continue;
+
+                closeIdleConnections(pools[i]);
+                for (int r = 0; r < replicaGroups[i]->replicas.count(); ++r) {
+                    closeIdleConnections(replicaGroups[i]->replicas[r]);
                 }
             }
             mutex.unlock();
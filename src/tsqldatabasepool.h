@@ -4,9 +4,10 @@
 #include <QObject>
 #include <QSqlDatabase>
 #include <QVector>
-#include <QMap>
+#include <QHash>
 #include <QString>
 #include <QMutex>
+#include <QWaitCondition>
 #include <QDateTime>
 #include <QBasicTimer>
 #include <TGlobal>
@@ -16,16 +17,32 @@ class T_CORE_EXPORT TSqlDatabasePool : QObject
 {
     Q_OBJECT
 public:
+    struct Statistics
+    {
+        qint64 popCount;
+        qint64 waitCount;
+        qint64 timeoutCount;
+        qint64 totalWaitTime;
+        int maxWaitTime;
+        int busyCount;
+        int idleCount;
+
+        Statistics() : popCount(0), waitCount(0), timeoutCount(0), totalWaitTime(0), maxWaitTime(0), busyCount(0), idleCount(0) { }
+    };
+
     ~TSqlDatabasePool();
     QSqlDatabase pop(int databaseId = 0);
+    QSqlDatabase popReplica(int databaseId = 0);
     void push(QSqlDatabase &database);
+    bool hasReplicas(int databaseId) const;
+    Statistics statistics(int databaseId = 0) const;
     const QString &environment() const { return dbEnvironment; }
 
     static void instantiate();
     static TSqlDatabasePool *instance();
 
     static QString driverType(const QString &env, int databaseId);
-    static bool openDatabase(QSqlDatabase &database, const QString &env, int databaseId);
+    static bool openDatabase(QSqlDatabase &database, const QString &env, int databaseId, int replica = -1);
 
 protected:
     void init();
@@ -33,12 +50,32 @@ protected:
 
 private:
     Q_DISABLE_COPY(TSqlDatabasePool)
-    
+
+    struct Pool;
+    struct ReplicaGroup;
+    struct Connection
+    {
+        int databaseId;
+        int replica;  // -1 for the primary
+    };
+
     TSqlDatabasePool(const QString &environment);
+    Pool *addPool(const QString &type, int databaseId, int replica);
+    void warmUp(Pool *pool, int databaseId, int replica);
+    bool take(Pool *pool, QString &name, qint64 &idleTime);
+    QSqlDatabase prepare(Pool *pool, const QString &name, qint64 idleTime, int databaseId, int replica);
+    void closeIdleConnections(Pool *pool);
 
     int maxConnections;
-    QVector<QMap<QString, QDateTime> > pooledConnections;
-    QMutex mutex;
+    int minIdle;
+    int waitTimeout;         // msecs
+    int idleTimeout;         // secs
+    int validationInterval;  // secs
+    QVector<Pool *> pools;
+    QVector<ReplicaGroup *> replicaGroups;
+    QHash<QString, Connection> connections;  // not modified after init()
+    mutable QMutex mutex;
+    QWaitCondition released;
     QString dbEnvironment;
     QBasicTimer timer;
 };
@@ -0,0 +1,347 @@
+/* Copyright (c) 2010-2012, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QStringList>
+#include <TWebApplication>
+#include <TCryptMac>
+#include <THttpUtility>
+#include <TSqlKeyset>
+#include "tsystemglobal.h"
+
+#define SESSION_SECRET     "Session.Secret"
+#define MAX_CURSOR_LENGTH  1024
+
+/*!
+  \class TSqlKeyset
+  \brief The TSqlKeyset class builds the conditions and the tokens of
+  the keyset pagination of TSqlORMapper.
+
+  A token is the keys of a row encoded as a fixed sequence of tagged
+  scalar values, followed by its HMAC with the session secret, both in
+  base64url. Tokens longer than 1024 characters, or whose HMAC doesn't
+  match, are rejected before they are decoded.
+  This class is for internal use only.
+  \sa TSqlORMapper::findAfter()
+*/
+
+enum KeyTag {
+    NullTag = 0,
+    BoolTag,
+    IntTag,
+    UIntTag,
+    LongLongTag,
+    ULongLongTag,
+    DoubleTag,
+    StringTag,
+    ByteArrayTag,
+    DateTag,
+    TimeTag,
+    DateTimeTag,
+};
+
+
+static void writeBytes(QDataStream &ds, const QByteArray &bytes)
+{
+    ds << (quint16)bytes.length();
+    ds.writeRawData(bytes.constData(), bytes.length());
+}
+
+
+static bool readBytes(QDataStream &ds, QByteArray &bytes)
+{
+    quint16 len;
+    ds >> len;
+    if (ds.status() != QDataStream::Ok || len > ds.device()->bytesAvailable())
+        return false;
+
+    bytes.resize(len);
+    return ds.readRawData(bytes.data(), len) == len;
+}
+
+
+static bool readKey(QDataStream &ds, QVariant &key)
+{
+    quint8 tag;
+    ds >> tag;
+    if (ds.status() != QDataStream::Ok)
+        return false;
+
+    switch (tag) {
+    case NullTag:
+        key = QVariant();
+        break;
+
+    case BoolTag: {
+        quint8 b;
+        ds >> b;
+        key = QVariant((bool)b);
+        break; }
+
+    case IntTag: {
+        qint32 n;
+        ds >> n;
+        key = QVariant((int)n);
+        break; }
+
+    case UIntTag: {
+        quint32 n;
+        ds >> n;
+        key = QVariant((uint)n);
+        break; }
+
+    case LongLongTag: {
+        qint64 n;
+        ds >> n;
+        key = QVariant((qlonglong)n);
+        break; }
+
+    case ULongLongTag: {
+        quint64 n;
+        ds >> n;
+        key = QVariant((qulonglong)n);
+        break; }
+
+    case DoubleTag: {
+        double d;
+        ds >> d;
+        key = QVariant(d);
+        break; }
+
+    case StringTag:
+    case ByteArrayTag: {
+        QByteArray bytes;
+        if (!readBytes(ds, bytes))
+            return false;
+        key = (tag == StringTag) ? QVariant(QString::fromUtf8(bytes.constData(), bytes.length())) : QVariant(bytes);
+        break; }
+
+    case DateTag: {
+        qint32 jd;
+        ds >> jd;
+        key = QVariant(QDate::fromJulianDay(jd));
+        break; }
+
+    case TimeTag: {
+        qint32 msecs;
+        ds >> msecs;
+        key = QVariant(QTime(0, 0).addMSecs(msecs));
+        break; }
+
+    case DateTimeTag: {
+        qint32 jd, msecs;
+        quint8 utc;
+        ds >> jd >> msecs >> utc;
+        key = QVariant(QDateTime(QDate::fromJulianDay(jd), QTime(0, 0).addMSecs(msecs), (utc) ? Qt::UTC : Qt::LocalTime));
+        break; }
+
+    default:
+        return false;
+    }
+    return ds.status() == QDataStream::Ok;
+}
+
+
+static bool equals(const QByteArray &a, const QByteArray &b)
+{
+    if (a.length() != b.length())
+        return false;
+
+    // Takes the same time wherever they differ
+    char diff = 0;
+    for (int i = 0; i < a.length(); ++i) {
+        diff |= a[i] ^ b[i];
+    }
+    return diff == 0;
+}
+
+/*!
+  Returns the condition of the rows following the row of \a lastKeys,
+  appending the values to be bound to \a values. The \a columns are the
+  escaped names and the sort orders of the keys. If \a rowValueComparison
+  is true and all the columns are sorted in the same order, a row value
+  comparison such as "(a, b) > (?, ?)" is used; otherwise the comparison
+  is expanded to "((a>?) OR (a=? AND b>?))". Returns an empty string if
+  the keys don't match the columns.
+*/
+QString TSqlKeyset::phrase(const QList<QPair<QString, TSql::SortOrder> > &columns, bool rowValueComparison,
+                           const QList<QVariant> &lastKeys, QList<QVariant> &values)
+{
+    if (columns.isEmpty() || lastKeys.count() != columns.count()) {
+        tWarn("Invalid keys of keyset pagination, count: %d", lastKeys.count());
+        return QString();
+    }
+
+    bool sameOrder = true;
+    for (int i = 1; i < columns.count(); ++i) {
+        sameOrder = sameOrder && (columns[i].second == columns[0].second);
+    }
+
+    QString phrase;
+    if (rowValueComparison && sameOrder) {
+        QStringList names;
+        for (int i = 0; i < columns.count(); ++i) {
+            names << columns[i].first;
+        }
+        phrase.append(QLatin1Char('(')).append(names.join(QLatin1String(", ")));
+        phrase.append((columns[0].second == TSql::AscendingOrder) ? QLatin1String(") > (") : QLatin1String(") < ("));
+        for (int i = 0; i < lastKeys.count(); ++i) {
+            phrase.append(QLatin1String("?, "));
+        }
+        phrase.chop(2);
+        phrase.append(QLatin1Char(')'));
+        values << lastKeys;
+        return phrase;
+    }
+
+    for (int i = 0; i < columns.count(); ++i) {
+        phrase.append((i == 0) ? QLatin1String("((") : QLatin1String(" OR ("));
+        for (int j = 0; j < i; ++j) {
+            phrase.append(columns[j].first).append(QLatin1String("=? AND "));
+            values << lastKeys[j];
+        }
+        phrase.append(columns[i].first).append((columns[i].second == TSql::AscendingOrder) ? QLatin1String(">?)") : QLatin1String("<?)"));
+        values << lastKeys[i];
+    }
+    phrase.append(QLatin1Char(')'));
+    return phrase;
+}
+
+/*!
+  Returns the token of the keys \a keys signed with \a secret, or an
+  empty string if a key isn't a scalar value.
+*/
+QString TSqlKeyset::toCursor(const QList<QVariant> &keys, const QByteArray &secret)
+{
+    if (keys.count() > 0xFF) {
+        tWarn("Too many keys of keyset pagination: %d", keys.count());
+        return QString();
+    }
+
+    QByteArray data;
+    QDataStream ds(&data, QIODevice::WriteOnly);
+    ds.setVersion(QDataStream::Qt_4_6);
+    ds << (quint8)keys.count();
+
+    for (QListIterator<QVariant> it(keys); it.hasNext(); ) {
+        const QVariant &v = it.next();
+        if (v.isNull()) {
+            ds << (quint8)NullTag;
+            continue;
+        }
+
+        switch (v.type()) {
+        case QVariant::Bool:
+            ds << (quint8)BoolTag << (quint8)v.toBool();
+            break;
+
+        case QVariant::Int:
+            ds << (quint8)IntTag << (qint32)v.toInt();
+            break;
+
+        case QVariant::UInt:
+            ds << (quint8)UIntTag << (quint32)v.toUInt();
+            break;
+
+        case QVariant::LongLong:
+            ds << (quint8)LongLongTag << (qint64)v.toLongLong();
+            break;
+
+        case QVariant::ULongLong:
+            ds << (quint8)ULongLongTag << (quint64)v.toULongLong();
+            break;
+
+        case QVariant::Double:
+            ds << (quint8)DoubleTag << v.toDouble();
+            break;
+
+        case QVariant::String:
+        case QVariant::ByteArray: {
+            QByteArray bytes = (v.type() == QVariant::String) ? v.toString().toUtf8() : v.toByteArray();
+            if (bytes.length() > 0xFFFF) {
+                tWarn("Too long key of keyset pagination: %d", bytes.length());
+                return QString();
+            }
+            ds << (quint8)((v.type() == QVariant::String) ? StringTag : ByteArrayTag);
+            writeBytes(ds, bytes);
+            break; }
+
+        case QVariant::Date:
+            ds << (quint8)DateTag << (qint32)v.toDate().toJulianDay();
+            break;
+
+        case QVariant::Time:
+            ds << (quint8)TimeTag << (qint32)QTime(0, 0).msecsTo(v.toTime());
+            break;
+
+        case QVariant::DateTime: {
+            QDateTime dt = v.toDateTime();
+            ds << (quint8)DateTimeTag << (qint32)dt.date().toJulianDay() << (qint32)QTime(0, 0).msecsTo(dt.time())
+               << (quint8)(dt.timeSpec() == Qt::UTC);
+            break; }
+
+        default:
+            tWarn("Invalid key of keyset pagination, type: %s", v.typeName());
+            return QString();
+        }
+    }
+
+    QByteArray digest = TCryptMac::mac(data, secret, TCryptMac::Hmac_Sha1);
+    return QString::fromLatin1(THttpUtility::toBase64Url(data) + '.' + THttpUtility::toBase64Url(digest));
+}
+
+/*!
+  Decodes the token \a cursor made by toCursor() with \a secret to the
+  \a count keys \a keys. Returns false if the token is too long, its
+  HMAC doesn't match or it doesn't hold \a count scalar values.
+*/
+bool TSqlKeyset::fromCursor(const QString &cursor, int count, const QByteArray &secret, QList<QVariant> &keys)
+{
+    keys.clear();
+    if (cursor.length() > MAX_CURSOR_LENGTH)
+        return false;
+
+    int idx = cursor.indexOf(QLatin1Char('.'));
+    if (idx <= 0)
+        return false;
+
+    QByteArray data = THttpUtility::fromBase64Url(cursor.left(idx).toLatin1());
+    QByteArray digest = THttpUtility::fromBase64Url(cursor.mid(idx + 1).toLatin1());
+    if (!equals(digest, TCryptMac::mac(data, secret, TCryptMac::Hmac_Sha1)))
+        return false;
+
+    QDataStream ds(data);
+    ds.setVersion(QDataStream::Qt_4_6);
+    quint8 n;
+    ds >> n;
+    if (ds.status() != QDataStream::Ok || (int)n != count)
+        return false;
+
+    QList<QVariant> list;
+    for (int i = 0; i < count; ++i) {
+        QVariant key;
+        if (!readKey(ds, key))
+            return false;
+        list << key;
+    }
+
+    if (!ds.atEnd())
+        return false;
+
+    keys = list;
+    return true;
+}
+
+/*!
+  Returns the secret to sign the tokens with; the same as that of the
+  session cookies.
+*/
+QByteArray TSqlKeyset::secret()
+{
+    return Tf::app()->appSettings().value(SESSION_SECRET).toByteArray();
+}
@@ -0,0 +1,22 @@
+#ifndef TSQLKEYSET_H
+#define TSQLKEYSET_H
+
+#include <QByteArray>
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QVariant>
+#include <TGlobal>
+
+
+class T_CORE_EXPORT TSqlKeyset
+{
+public:
+    static QString phrase(const QList<QPair<QString, TSql::SortOrder> > &columns, bool rowValueComparison,
+                          const QList<QVariant> &lastKeys, QList<QVariant> &values);
+    static QString toCursor(const QList<QVariant> &keys, const QByteArray &secret);
+    static bool fromCursor(const QString &cursor, int count, const QByteArray &secret, QList<QVariant> &keys);
+    static QByteArray secret();
+};
+
+#endif // TSQLKEYSET_H
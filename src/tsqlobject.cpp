@@ -8,9 +8,15 @@
 #include <QtSql>
 #include <QCoreApplication>
 #include <QMetaObject>
+#include <QHash>
+#include <QReadWriteLock>
+#include <QReadLocker>
+#include <QWriteLocker>
 #include <TSqlObject>
 #include <TActionContext>
 #include <TSqlQuery>
+#include <TSqlSchemaCache>
+#include <TSqlStatementCache>
 #include <TSystemGlobal>
 
 #define REVISION_PROPERTY_NAME  "lock_revision"
@@ -21,11 +27,75 @@
   \sa TSqlORMapper
 */
 
+/*
+  Reflection data computed once for each class of ORM objects
+*/
+struct TSqlObjectMetaData
+{
+    QString tableName;
+    QHash<QString, int> propertyIndexes;  // property name -> property index
+    QList<int> creationTimestamps;        // 'created_at', 'updated_at' and 'modified_at'
+    int updateTimestamp;                  // 'updated_at' or 'modified_at'
+    int revision;                         // 'lock_revision'
+
+    TSqlObjectMetaData(const QMetaObject *metaObj);
+    int propertyIndex(const QString &fieldName) const;
+};
+
+
+TSqlObjectMetaData::TSqlObjectMetaData(const QMetaObject *metaObj)
+    : updateTimestamp(-1), revision(-1)
+{
+    // Table name generated from the class name
+    QString clsname(metaObj->className());
+    for (int i = 0; i < clsname.length(); ++i) {
+        if (i > 0 && clsname[i].isUpper()) {
+            tableName += '_';
+        }
+        tableName += clsname[i].toLower();
+    }
+    tableName.remove(QRegExp("_object$"));
+
+    for (int i = metaObj->propertyOffset(); i < metaObj->propertyCount(); ++i) {
+        const char *propName = metaObj->property(i).name();
+        propertyIndexes.insert(QLatin1String(propName), i);
+
+        if (QLatin1String("created_at") == propName) {
+            creationTimestamps << i;
+        } else if (QLatin1String("updated_at") == propName || QLatin1String("modified_at") == propName) {
+            creationTimestamps << i;
+            if (updateTimestamp < 0) {
+                updateTimestamp = i;
+            }
+        } else if (QLatin1String(REVISION_PROPERTY_NAME) == propName) {
+            revision = i;
+        }
+    }
+}
+
+/*
+  Returns the index of the property for the field \a fieldName, or -1.
+*/
+inline int TSqlObjectMetaData::propertyIndex(const QString &fieldName) const
+{
+    QHash<QString, int>::const_iterator it = propertyIndexes.constFind(fieldName);
+    if (it != propertyIndexes.constEnd())
+        return it.value();
+
+    // Some drivers return the field names in uppercase
+    return propertyIndexes.value(fieldName.toLower(), -1);
+}
+
+
+static QHash<const QMetaObject *, TSqlObjectMetaData *> metaDataHash;
+static QReadWriteLock metaDataLock;
+
+
 /*!
   Constructor.
  */
 TSqlObject::TSqlObject()
-    : QObject(), QSqlRecord(), tblName(), sqlError()
+    : QObject(), QSqlRecord(), meta(0), sqlError()
 { }
 
 /*!
@@ -33,14 +103,13 @@ TSqlObject::TSqlObject()
  */
 TSqlObject::TSqlObject(const TSqlObject &other)
     : QObject(), QSqlRecord(*static_cast<const QSqlRecord *>(&other)),
-      tblName(other.tblName), sqlError(other.sqlError)
+      meta(0), sqlError(other.sqlError)
 { }
 
 
 TSqlObject &TSqlObject::operator=(const TSqlObject &other)
 {
     QSqlRecord::operator=(*static_cast<const QSqlRecord *>(&other));
-    tblName = other.tblName;
     sqlError = other.sqlError;
     return *this;
 }
@@ -50,17 +119,32 @@ TSqlObject &TSqlObject::operator=(const TSqlObject &other)
  */
 QString TSqlObject::tableName() const
 {
-    if (tblName.isEmpty()) {
-        QString clsname(metaObject()->className());
-        for (int i = 0; i < clsname.length(); ++i) {
-            if (i > 0 && clsname[i].isUpper()) {
-                tblName += '_';
+    return metaData()->tableName;
+}
+
+/*!
+  Returns the reflection data of the class of this object, which is
+  computed once for each class.
+ */
+const TSqlObjectMetaData *TSqlObject::metaData() const
+{
+    if (!meta) {
+        const QMetaObject *metaObj = metaObject();
+        {
+            QReadLocker locker(&metaDataLock);
+            meta = metaDataHash.value(metaObj);
+        }
+
+        if (!meta) {
+            QWriteLocker locker(&metaDataLock);
+            meta = metaDataHash.value(metaObj);
+            if (!meta) {
+                meta = new TSqlObjectMetaData(metaObj);
+                metaDataHash.insert(metaObj, const_cast<TSqlObjectMetaData *>(meta));
             }
-            tblName += clsname[i].toLower();
         }
-        tblName.remove(QRegExp("_object$"));
     }
-    return tblName;
+    return meta;
 }
 
 /*!
@@ -106,32 +190,10 @@ void TSqlObject::setRecord(const QSqlRecord &record, const QSqlError &error)
  */
 bool TSqlObject::create()
 {
-    // Sets the default value of 'revision' property
-    int index = metaObject()->indexOfProperty(REVISION_PROPERTY_NAME);
-    if (index >= 0) {
-        setProperty(REVISION_PROPERTY_NAME, 1);  // 1 : default value
-    }
-
-    // Sets the values of 'created_at', 'updated_at' or 'modified_at' properties
-    for (int i = metaObject()->propertyOffset(); i < metaObject()->propertyCount(); ++i) {
-        const char *propName = metaObject()->property(i).name();
-        if (QLatin1String("created_at") == propName || QLatin1String("updated_at") == propName
-            || QLatin1String("modified_at") == propName) {
-            setProperty(propName, QDateTime::currentDateTime());
-        }
-    }
+    QSqlRecord record = recordToCreate();
 
-    syncToSqlRecord();
-    
-    QString autoValName;
-    QSqlRecord record = *this;
-    if (autoValueIndex() >= 0) {
-        autoValName = field(autoValueIndex()).name();
-        record.remove(autoValueIndex()); // not insert the value of auto-value field
-    }
-
-    QSqlDatabase &database = TActionContext::current()->getDatabase(databaseId());
-    QString ins = database.driver()->sqlStatement(QSqlDriver::InsertStatement, tableName(), record, false);
+    QSqlDatabase &database = TActionContext::current()->getWritableDatabase(databaseId());
+    QString ins = database.driver()->sqlStatement(QSqlDriver::InsertStatement, tableName(), record, true);
     if (ins.isEmpty()) {
         sqlError = QSqlError(QLatin1String("No fields to insert"),
                              QString(), QSqlError::StatementError);
@@ -139,9 +201,15 @@ bool TSqlObject::create()
         return false;
     }
 
-    QSqlQuery query(database);
-    bool ret = query.exec(ins);
-    tQueryLog("%s", qPrintable(ins));
+    QList<QVariant> values;
+    for (int i = 0; i < record.count(); ++i) {
+        if (record.isGenerated(i)) {
+            values << record.value(i);
+        }
+    }
+
+    QSqlQuery query;
+    bool ret = TSqlStatementCache::exec(database, ins, values, query);
     sqlError = query.lastError();
     if (!ret) {
         tSystemError("SQL insert error: %s", qPrintable(sqlError.text()));
@@ -150,13 +218,56 @@ bool TSqlObject::create()
         if (autoValueIndex() >= 0) {
             QVariant lastid = query.lastInsertId();
             if (lastid.isValid()) {
-                QObject::setProperty(autoValName.toLower().toLatin1().constData(), lastid);
+                setAutoValue(lastid);
             }
         }
     }
+    TSqlStatementCache::release(database, ins, query);
     return ret;
 }
 
+/*!
+  Sets the default values of the revision and the timestamp properties,
+  and returns the record to insert, which doesn't contain the auto-value
+  field. Internal use.
+ */
+QSqlRecord TSqlObject::recordToCreate()
+{
+    const TSqlObjectMetaData *md = metaData();
+
+    // Sets the default value of 'revision' property
+    if (md->revision >= 0) {
+        metaObject()->property(md->revision).write(this, 1);  // 1 : default value
+    }
+
+    // Sets the values of 'created_at', 'updated_at' or 'modified_at' properties
+    if (!md->creationTimestamps.isEmpty()) {
+        QDateTime now = QDateTime::currentDateTime();
+        for (QListIterator<int> it(md->creationTimestamps); it.hasNext(); ) {
+            metaObject()->property(it.next()).write(this, now);
+        }
+    }
+
+    syncToSqlRecord();
+
+    QSqlRecord record = *this;
+    if (autoValueIndex() >= 0) {
+        record.remove(autoValueIndex()); // not insert the value of auto-value field
+    }
+    return record;
+}
+
+/*!
+  Sets the \a value generated by the database to the auto-value property.
+  Internal use.
+ */
+void TSqlObject::setAutoValue(const QVariant &value)
+{
+    if (autoValueIndex() >= 0) {
+        metaObject()->property(metaObject()->propertyOffset() + autoValueIndex()).write(this, value);
+    }
+}
+
 /*!
   Updates the record on the database with the primary key.
  */
@@ -169,12 +280,14 @@ bool TSqlObject::update()
         return false;
     }
 
-    QSqlDatabase &database = TActionContext::current()->getDatabase(databaseId());
+    const TSqlObjectMetaData *md = metaData();
+    QSqlDatabase &database = TActionContext::current()->getWritableDatabase(databaseId());
     QString where(" WHERE ");
-    int revIndex = metaObject()->indexOfProperty(REVISION_PROPERTY_NAME);
+    QList<QVariant> whereValues;
+    int revIndex = md->revision;
     if (revIndex >= 0) {
         bool ok;
-        int oldRevision = property(REVISION_PROPERTY_NAME).toInt(&ok);
+        int oldRevision = metaObject()->property(revIndex).read(this).toInt(&ok);
         if (!ok || oldRevision <= 0) {
             sqlError = QSqlError(QLatin1String("Unable to convert the 'revision' property to an int"),
                                  QString(), QSqlError::UnknownError);
@@ -182,35 +295,32 @@ bool TSqlObject::update()
             return false;
         }
 
-        setProperty(REVISION_PROPERTY_NAME, oldRevision + 1);
+        metaObject()->property(revIndex).write(this, oldRevision + 1);
         
         where.append(TSqlQuery::escapeIdentifier(REVISION_PROPERTY_NAME, QSqlDriver::FieldName, database));
-        where.append("=").append(TSqlQuery::formatValue(oldRevision, database));
-        where.append(" AND ");
+        where.append(QLatin1String("=? AND "));
+        whereValues << oldRevision;
     }
 
     // Updates the value of 'updated_at' or 'modified_at'property
-    for (int i = metaObject()->propertyOffset(); i < metaObject()->propertyCount(); ++i) {
-        const char *propName = metaObject()->property(i).name();
-        if (QLatin1String("updated_at") == propName || QLatin1String("modified_at") == propName) {
-            setProperty(propName, QDateTime::currentDateTime());
-            break;
-        }
+    if (md->updateTimestamp >= 0) {
+        metaObject()->property(md->updateTimestamp).write(this, QDateTime::currentDateTime());
     }
 
     QString upd;   // UPDATE Statement
+    QList<QVariant> values;
     upd.reserve(256);
     upd.append(QLatin1String("UPDATE ")).append(tableName()).append(QLatin1String(" SET "));
 
     for (int i = metaObject()->propertyOffset(); i < metaObject()->propertyCount(); ++i) {
-        const char *propName = metaObject()->property(i).name();
-        QVariant newval = QObject::property(propName);
+        const QMetaProperty metaProp = metaObject()->property(i);
+        const char *propName = metaProp.name();
+        QVariant newval = metaProp.read(this);
         QVariant recval = QSqlRecord::value(QLatin1String(propName));
         if (recval.isValid() && recval != newval) {
             upd.append(TSqlQuery::escapeIdentifier(QLatin1String(propName), QSqlDriver::FieldName, database));
-            upd.append(QLatin1Char('='));
-            upd.append(TSqlQuery::formatValue(newval, database));
-            upd.append(QLatin1String(", "));
+            upd.append(QLatin1String("=?, "));
+            values << newval;
         }
     }
 
@@ -230,20 +340,23 @@ bool TSqlObject::update()
         return false;
     }
     where.append(TSqlQuery::escapeIdentifier(pkName, QSqlDriver::FieldName, database));
-    where.append("=").append(TSqlQuery::formatValue(property(pkName), database));
+    where.append(QLatin1String("=?"));
+    whereValues << property(pkName);
     upd.append(where);
+    values << whereValues;
 
-    QSqlQuery query(database);
-    bool res = query.exec(upd);
-    tQueryLog("%s", qPrintable(upd));    
+    QSqlQuery query;
+    bool res = TSqlStatementCache::exec(database, upd, values, query);
     sqlError = query.lastError();
+    int numRows = query.numRowsAffected();
+    TSqlStatementCache::release(database, upd, query);
     if (!res) {
         tSystemError("SQL update error: %s", qPrintable(sqlError.text()));
         return false;
     }
     
     // Optimistic lock check
-    if (revIndex >= 0 && query.numRowsAffected() != 1) {
+    if (revIndex >= 0 && numRows != 1) {
         QString msg = QString("Row was updated or deleted from table ") + tableName() + QLatin1String(" by another transaction");
         sqlError = QSqlError(msg, QString(), QSqlError::UnknownError);
         throw SqlException(msg, __FILE__, __LINE__);
@@ -258,8 +371,8 @@ bool TSqlObject::remove()
 {
     syncToSqlRecord();
 
-    QSqlDatabase &database = TActionContext::current()->getDatabase(databaseId());
-    QString del = database.driver()->sqlStatement(QSqlDriver::DeleteStatement, tableName(), *static_cast<QSqlRecord *>(this), false);
+    QSqlDatabase &database = TActionContext::current()->getWritableDatabase(databaseId());
+    QString del = database.driver()->sqlStatement(QSqlDriver::DeleteStatement, tableName(), *static_cast<QSqlRecord *>(this), true);
     if (del.isEmpty()) {
         sqlError = QSqlError(QLatin1String("Unable to delete row"),
                              QString(), QSqlError::StatementError);
@@ -267,10 +380,11 @@ bool TSqlObject::remove()
     }
 
     del.append(" WHERE ");
-    int revIndex = metaObject()->indexOfProperty(REVISION_PROPERTY_NAME);
+    QList<QVariant> values;
+    int revIndex = metaData()->revision;
     if (revIndex >= 0) {
         bool ok;
-        int revsion = property(REVISION_PROPERTY_NAME).toInt(&ok);
+        int revsion = metaObject()->property(revIndex).read(this).toInt(&ok);
         if (!ok || revsion <= 0) {
             sqlError = QSqlError(QLatin1String("Unable to convert the 'revision' property to an int"),
                                  QString(), QSqlError::UnknownError);
@@ -279,8 +393,8 @@ bool TSqlObject::remove()
         }
 
         del.append(TSqlQuery::escapeIdentifier(REVISION_PROPERTY_NAME, QSqlDriver::FieldName, database));
-        del.append("=").append(TSqlQuery::formatValue(revsion, database));
-        del.append(" AND ");
+        del.append(QLatin1String("=? AND "));
+        values << revsion;
     }
 
     const char *pkName = metaObject()->property(metaObject()->propertyOffset() + primaryKeyIndex()).name();
@@ -291,19 +405,21 @@ bool TSqlObject::remove()
         return false;
     }
     del.append(TSqlQuery::escapeIdentifier(pkName, QSqlDriver::FieldName, database));
-    del.append("=").append(TSqlQuery::formatValue(property(pkName), database));
+    del.append(QLatin1String("=?"));
+    values << property(pkName);
 
-    QSqlQuery query(database);
-    bool res = query.exec(del);
-    tQueryLog("%s", qPrintable(del));
+    QSqlQuery query;
+    bool res = TSqlStatementCache::exec(database, del, values, query);
     sqlError = query.lastError();
+    int numRows = query.numRowsAffected();
+    TSqlStatementCache::release(database, del, query);
     if (!res) {
         tSystemError("SQL delete error: %s", qPrintable(sqlError.text()));
         return false;
     }
     
     // Optimistic lock check
-    if (query.numRowsAffected() != 1) {
+    if (numRows != 1) {
         if (revIndex >= 0) {
             QString msg = QString("Row was updated or deleted from table ") + tableName() + QLatin1String(" by another transaction");
             sqlError = QSqlError(msg, QString(), QSqlError::UnknownError);
@@ -337,11 +453,11 @@ bool TSqlObject::isModified() const
     if (isNew())
         return false;
 
+    const TSqlObjectMetaData *md = metaData();
     for (int i = 0; i < QSqlRecord::count(); ++i) {
-        QString name = field(i).name().toLower();
-        int index = metaObject()->indexOfProperty(name.toLatin1().constData());
+        int index = md->propertyIndex(field(i).name());
         if (index >= 0) {
-            if (value(name) != property(name.toLatin1().constData())) {
+            if (value(i) != metaObject()->property(index).read(this)) {
                 return true;
             }
         }
@@ -352,12 +468,12 @@ bool TSqlObject::isModified() const
 
 void TSqlObject::syncToObject()
 {
-    int offset = metaObject()->propertyOffset();
+    const TSqlObjectMetaData *md = metaData();
+    const QMetaObject *metaObj = metaObject();
     for (int i = 0; i < QSqlRecord::count(); ++i) {
-        QString propertyName = field(i).name();
-        int index = metaObject()->indexOfProperty(propertyName.toLower().toLatin1().constData());
-        if (index >= offset) {
-            QObject::setProperty(propertyName.toLower().toLatin1().constData(), value(propertyName));
+        int index = md->propertyIndex(field(i).name());
+        if (index >= 0) {
+            metaObj->property(index).write(this, value(i));
         }
     }
 }
@@ -365,13 +481,14 @@ void TSqlObject::syncToObject()
 
 void TSqlObject::syncToSqlRecord()
 {
-    QSqlRecord::operator=(TActionContext::current()->getDatabase(databaseId()).record(tableName()));
+    QSqlRecord::operator=(TSqlSchemaCache::record(databaseId(), tableName()));
     const QMetaObject *metaObj = metaObject();
     for (int i = metaObj->propertyOffset(); i < metaObj->propertyCount(); ++i) {
-        const char *propName = metaObj->property(i).name();
+        const QMetaProperty metaProp = metaObj->property(i);
+        const char *propName = metaProp.name();
         int idx = indexOf(propName);
         if (idx >= 0) {
-            QSqlRecord::setValue(idx, QObject::property(propName));
+            QSqlRecord::setValue(idx, metaProp.read(this));
         } else {
             tWarn("invalid name: %s", propName);
         }
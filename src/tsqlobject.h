@@ -8,6 +8,8 @@
 #include <QVariantHash>
 #include <TGlobal>
 
+struct TSqlObjectMetaData;
+
 
 class T_CORE_EXPORT TSqlObject : public QObject, public QSqlRecord
 {
@@ -23,6 +25,8 @@ public:
     virtual int autoValueIndex() const { return -1; }
     virtual int databaseId() const { return 0; }
     void setRecord(const QSqlRecord &record, const QSqlError &error);
+    QSqlRecord recordToCreate();
+    void setAutoValue(const QVariant &value);
     bool create();
     bool update();
     bool remove();
@@ -40,7 +44,9 @@ protected:
     void syncToObject();
 
 private:
-    mutable QString tblName;
+    const TSqlObjectMetaData *metaData() const;
+
+    mutable const TSqlObjectMetaData *meta;
     QSqlError sqlError;
 };
 
@@ -3,20 +3,42 @@
 
 #include <QtSql>
 #include <QList>
+#include <QPair>
 #include <TSqlObject>
 #include <TCriteria>
 #include <TCriteriaConverter>
 #include <TActionContext>
+#include <TSqlSchemaCache>
+#include <TSqlStatementCache>
+#include <TSqlKeyset>
 #include "tsystemglobal.h"
 
 /*!
   \class TSqlORMapper
   \brief The TSqlORMapper class is a template class that provides
   functionality to object-relational mapping.
+
+  The table isn't set to the QSqlTableModel; the SELECT statement is
+  built from the schema in TSqlSchemaCache, not to query the catalog of
+  the database each time a mapper is constructed.
+
+  The SELECT statements are sent to a read replica of the database if
+  any, unless the current action has written the database. The values
+  of the criteria are bound to the statements prepared through
+  TSqlStatementCache.
+
+  findAfter() fetches a page following the row of the given sort keys,
+  instead of skipping rows by OFFSET; the sort columns set by setSort()
+  and addSort(), followed by the primary key, are the keys. The values
+  of the sort columns are assumed not to be NULL. The tokens of
+  nextCursor() are signed with the session secret.
   \sa TSqlObject
 */
 
 
+template <class T> class TSqlORMapperCursor;
+
+
 template <class T>
 class TSqlORMapper : public QSqlTableModel
 {
@@ -27,54 +49,79 @@ public:
     void setLimit(int limit);
     void setOffset(int offset);
     void setSort(int column, TSql::SortOrder order);
+    void addSort(int column, TSql::SortOrder order);
+    void setBatchSize(int size);
     void reset();
+    bool select();
 
     T findFirst(const TCriteria &cri = TCriteria());
     T findByPrimaryKey(QVariant pk);
     int find(const TCriteria &cri = TCriteria());
+    int findAfter(const QList<QVariant> &lastKeys, int limit, const TCriteria &cri = TCriteria());
+    int findAfter(const QString &cursor, int limit, const TCriteria &cri = TCriteria());
+    QList<QVariant> lastKeys() const;
+    QString nextCursor() const;
     T first() const;
     T last() const;
     T value(int i) const;
     int removeAll(const TCriteria &cri = TCriteria());
+    int removeAll(const QList<QVariant> &primaryKeys);
+    int insertAll(QList<T> &objects, bool returnKeys = false);
+    int updateAll(const TCriteria &cri, const QMap<int, QVariant> &values);
 
 protected:
     void setFilter(const QString &filter);
+    void setFilter(const QString &filter, const QList<QVariant> &values);
     QString orderByPhrase() const;
+    QList<QPair<int, TSql::SortOrder> > keysetColumns() const;
+    QString keysetPhrase(const QList<QVariant> &lastKeys, QList<QVariant> &values) const;
     virtual void clear();
     virtual QString selectStatement() const;
+    int maxBatchRows(int paramsPerRow) const;
+
+    static QString keysToCursor(const QList<QVariant> &keys);
+    bool cursorToKeys(const QString &cursor, QList<QVariant> &keys) const;
 
 private:
+    void releaseStatement();
+    QString selectStatement(const QString &filter) const;
+
     Q_DISABLE_COPY(TSqlORMapper)
+    friend class TSqlORMapperCursor<T>;
 
     QString queryFilter;
-    int sortColumn;
-    TSql::SortOrder sortOrder;
+    QList<QVariant> filterValues;
+    QString boundStatement;  // statement taken from TSqlStatementCache
+    QSqlDatabase boundDatabase;
+    QList<QPair<int, TSql::SortOrder> > sortColumns;
     int queryLimit;
     int queryOffset;
+    int bulkBatchSize;
+    int pageLimit;  // limit of findAfter()
 };
 
 
 template <class T>
 inline TSqlORMapper<T>::TSqlORMapper()
-    : QSqlTableModel(0, TActionContext::current()->getDatabase(T().databaseId())),
-      sortColumn(-1), sortOrder(TSql::AscendingOrder), queryLimit(0),
-      queryOffset(0)
-{
-    setTable(T().tableName());
-}
+    : QSqlTableModel(0, TActionContext::current()->getReadDatabase(T().databaseId())),
+      queryLimit(0), queryOffset(0), bulkBatchSize(500), pageLimit(0)
+{ }
 
 
 template <class T>
 inline TSqlORMapper<T>::~TSqlORMapper()
-{ }
+{
+    releaseStatement();
+}
 
 
 template <class T>
 inline T TSqlORMapper<T>::findFirst(const TCriteria &cri)
 {
     if (!cri.isEmpty()) {
+        QList<QVariant> values;
         TCriteriaConverter<T> conv(cri, database());
-        setFilter(conv.toString());
+        setFilter(conv.toString(values), values);
     }
 
     int oldLimit = queryLimit;
@@ -97,8 +144,9 @@ inline T TSqlORMapper<T>::findByPrimaryKey(QVariant pk)
     }
 
     TCriteria cri(idx, pk);
+    QList<QVariant> values;
     TCriteriaConverter<T> conv(cri, database());
-    setFilter(conv.toString());
+    setFilter(conv.toString(values), values);
     select();
     tSystemDebug("findByPrimaryKey() rowCount: %d", rowCount());
     return first();
@@ -109,8 +157,9 @@ template <class T>
 inline int TSqlORMapper<T>::find(const TCriteria &cri)
 {
     if (!cri.isEmpty()) {
+        QList<QVariant> values;
         TCriteriaConverter<T> conv(cri, database());
-        setFilter(conv.toString());
+        setFilter(conv.toString(values), values);
     }
     if (!select()) {
         return -1;
@@ -120,6 +169,105 @@ inline int TSqlORMapper<T>::find(const TCriteria &cri)
 }
 
 
+/*!
+ * Finds the rows that satisfy the criteria 'cri', following the row of
+ * the sort keys 'lastKeys', up to 'limit' rows. The keys are the values
+ * of the columns of keysetColumns(); if 'lastKeys' is empty, finds the
+ * first page. Returns the number of the rows found, or -1 if an error
+ * occurred.
+ */
+template <class T>
+inline int TSqlORMapper<T>::findAfter(const QList<QVariant> &lastKeys, int limit, const TCriteria &cri)
+{
+    QList<QVariant> values;
+    QString filter;
+    if (!cri.isEmpty()) {
+        TCriteriaConverter<T> conv(cri, database());
+        filter = conv.toString(values);
+    }
+
+    if (!lastKeys.isEmpty()) {
+        QString seek = keysetPhrase(lastKeys, values);
+        if (seek.isEmpty())
+            return -1;
+
+        filter = (filter.isEmpty()) ? seek : QLatin1Char('(') + filter + QLatin1String(") AND ") + seek;
+    }
+    setFilter(filter, values);
+
+    QList<QPair<int, TSql::SortOrder> > oldSort = sortColumns;
+    int oldLimit = queryLimit;
+    int oldOffset = queryOffset;
+    sortColumns = keysetColumns();
+    queryLimit = limit;
+    queryOffset = 0;
+    bool res = select();
+    sortColumns = oldSort;
+    queryLimit = oldLimit;
+    queryOffset = oldOffset;
+
+    // Fetches all the rows of the page to count them
+    while (res && canFetchMore()) {
+        fetchMore();
+    }
+
+    pageLimit = limit;
+    return (res) ? rowCount() : -1;
+}
+
+
+/*!
+ * Finds the rows following the opaque token 'cursor' returned by
+ * nextCursor(), up to 'limit' rows. If 'cursor' is empty, finds the
+ * first page. Returns the number of the rows found, or -1 if the
+ * token is invalid or an error occurred.
+ */
+template <class T>
+inline int TSqlORMapper<T>::findAfter(const QString &cursor, int limit, const TCriteria &cri)
+{
+    QList<QVariant> keys;
+    if (!cursor.isEmpty() && !cursorToKeys(cursor, keys)) {
+        tWarn("Invalid cursor of keyset pagination: %s", qPrintable(cursor));
+        return -1;
+    }
+    return findAfter(keys, limit, cri);
+}
+
+
+/*!
+ * Returns the values of the keys of findAfter() in the last row found.
+ */
+template <class T>
+inline QList<QVariant> TSqlORMapper<T>::lastKeys() const
+{
+    QList<QVariant> keys;
+    if (rowCount() == 0)
+        return keys;
+
+    T obj = last();
+    const QMetaObject &metaObject = T::staticMetaObject;
+    QList<QPair<int, TSql::SortOrder> > columns = keysetColumns();
+    for (int i = 0; i < columns.count(); ++i) {
+        keys << metaObject.property(metaObject.propertyOffset() + columns[i].first).read(&obj);
+    }
+    return keys;
+}
+
+
+/*!
+ * Returns the opaque token of the page following the rows found by
+ * findAfter(), or an empty string if it was the last page.
+ */
+template <class T>
+inline QString TSqlORMapper<T>::nextCursor() const
+{
+    if (pageLimit <= 0 || rowCount() < pageLimit)
+        return QString();
+
+    return keysToCursor(lastKeys());
+}
+
+
 template <class T>
 inline T TSqlORMapper<T>::first() const
 {
@@ -164,8 +312,86 @@ inline void TSqlORMapper<T>::setOffset(int offset)
 template <class T>
 inline void TSqlORMapper<T>::setSort(int column, TSql::SortOrder order)
 {
-    sortColumn = column;
-    sortOrder = order;
+    sortColumns.clear();
+    addSort(column, order);
+}
+
+/*!
+ * Adds the 'column' to the sort columns, following the columns set
+ * previously.
+ */
+template <class T>
+inline void TSqlORMapper<T>::addSort(int column, TSql::SortOrder order)
+{
+    if (column >= 0) {
+        sortColumns << qMakePair(column, order);
+    }
+}
+
+
+/*!
+ * Sets the maximum number of the rows processed by one statement in
+ * insertAll() and removeAll() with primary keys. Defaults to 500.
+ */
+template <class T>
+inline void TSqlORMapper<T>::setBatchSize(int size)
+{
+    bulkBatchSize = qMax(size, 1);
+}
+
+
+/*!
+ * Executes the SELECT statement of the current filter, sort and limit,
+ * on the connection for reading of the current action.
+ */
+template <class T>
+inline bool TSqlORMapper<T>::select()
+{
+    QString query = selectStatement();
+    if (query.isEmpty())
+        return false;
+
+    revertAll();
+    releaseStatement();
+    QSqlDatabase &db = TActionContext::current()->getReadDatabase(T().databaseId());
+
+    if (filterValues.isEmpty()) {
+        QSqlQuery sqlQuery(query, db);
+        setQuery(sqlQuery);
+        return sqlQuery.isActive() && !lastError().isValid();
+    }
+
+    bool ok;
+    QSqlQuery sqlQuery = TSqlStatementCache::prepare(db, query, &ok);
+    if (ok) {
+        for (int i = 0; i < filterValues.count(); ++i) {
+            sqlQuery.bindValue(i, filterValues[i]);
+        }
+        ok = sqlQuery.exec();
+    }
+    setQuery(sqlQuery);
+    if (!ok) {
+        tSystemError("SQL select error: %s", qPrintable(sqlQuery.lastError().text()));
+        return false;
+    }
+
+    // Given back to the cache when the rows are no longer needed
+    boundStatement = query;
+    boundDatabase = db;
+    return !lastError().isValid();
+}
+
+
+template <class T>
+inline void TSqlORMapper<T>::releaseStatement()
+{
+    if (!boundStatement.isEmpty()) {
+        QSqlQuery sqlQuery = query();
+        QSqlTableModel::clear();  // not to share the result
+        TSqlStatementCache::release(boundDatabase, boundStatement, sqlQuery);
+        boundStatement.clear();
+        boundDatabase = QSqlDatabase();
+    }
 }
 
 
@@ -178,15 +404,42 @@ template <class T>
 inline void TSqlORMapper<T>::setFilter(const QString &filter)
 {
     queryFilter = filter;
+    filterValues.clear();
+}
+
+/*!
+ * Sets the current filter to 'filter' with the placeholders to which
+ * the 'values' are bound.
+ */
+template <class T>
+inline void TSqlORMapper<T>::setFilter(const QString &filter, const QList<QVariant> &values)
+{
+    queryFilter = filter;
+    filterValues = values;
 }
 
 
 template <class T>
 inline QString TSqlORMapper<T>::selectStatement() const
 {
-    QString query = QSqlTableModel::selectStatement();
-    if (!queryFilter.isEmpty())
-        query.append(QLatin1String(" WHERE ")).append(queryFilter);
+    return selectStatement(queryFilter);
+}
+
+/*!
+ * Returns the SELECT statement of the filter 'filter' and the current
+ * sort and limit.
+ */
+template <class T>
+inline QString TSqlORMapper<T>::selectStatement(const QString &filter) const
+{
+    T obj;
+    QString query = database().driver()->sqlStatement(QSqlDriver::SelectStatement, obj.tableName(),
+                                                      TSqlSchemaCache::record(obj.databaseId(), obj.tableName()), false);
+    if (query.isEmpty())
+        return query;
+
+    if (!filter.isEmpty())
+        query.append(QLatin1String(" WHERE ")).append(filter);
 
     QString orderby = orderByPhrase();
     if (!orderby.isEmpty()) {
@@ -207,10 +460,12 @@ inline QString TSqlORMapper<T>::selectStatement() const
 template <class T>
 inline int TSqlORMapper<T>::removeAll(const TCriteria &cri)
 {
-    QString del = database().driver()->sqlStatement(QSqlDriver::DeleteStatement,
-                                                    T().tableName(), QSqlRecord(), false);
-    TCriteriaConverter<T> conv(cri, database());
-    QString where = conv.toString();
+    QSqlDatabase db = TActionContext::current()->getWritableDatabase(T().databaseId());
+    QString del = db.driver()->sqlStatement(QSqlDriver::DeleteStatement,
+                                            T().tableName(), QSqlRecord(), false);
+    QList<QVariant> values;
+    TCriteriaConverter<T> conv(cri, db);
+    QString where = conv.toString(values);
 
     if (del.isEmpty()) {
         tSystemError("Statement Error");
@@ -220,32 +475,241 @@ inline int TSqlORMapper<T>::removeAll(const TCriteria &cri)
         del.append(QLatin1String(" WHERE ")).append(where);
     }
 
-    tQueryLog("%s", qPrintable(del));
-  
-    QSqlQuery sqlQuery(database());
-    if ( !sqlQuery.exec(del) ) {
+    QSqlQuery sqlQuery;
+    int ret = -1;
+    if (TSqlStatementCache::exec(db, del, values, sqlQuery)) {
+        ret = sqlQuery.numRowsAffected();
+    } else {
+        tSystemError("SQL delete error: %s", qPrintable(sqlQuery.lastError().text()));
+    }
+    TSqlStatementCache::release(db, del, sqlQuery);
+    return ret;
+}
+
+
+/*!
+ * Returns the number of the rows processed by one statement, within the
+ * limit of the placeholders of the driver.
+ */
+template <class T>
+inline int TSqlORMapper<T>::maxBatchRows(int paramsPerRow) const
+{
+    int maxParams = (database().driverName().toUpper() == QLatin1String("QSQLITE")) ? 999 : 32767;
+    return qMax(qMin(bulkBatchSize, maxParams / qMax(paramsPerRow, 1)), 1);
+}
+
+
+/*!
+ * Inserts the \a objects, setting the default values of the revision
+ * and the timestamp properties as TSqlObject::create() does. A multi-row
+ * INSERT statement inserts up to the batch size of the objects on
+ * PostgreSQL, MySQL and SQLite; on the other databases, the statement of
+ * one row is executed in a batch. If \a returnKeys is true, the
+ * generated values of the auto-value field are set to the objects; it's
+ * available only on PostgreSQL. Returns the number of the objects
+ * inserted, or -1 if an error occurred.
+ */
+template <class T>
+inline int TSqlORMapper<T>::insertAll(QList<T> &objects, bool returnKeys)
+{
+    if (objects.isEmpty())
+        return 0;
+
+    QSqlDatabase db = TActionContext::current()->getWritableDatabase(T().databaseId());
+    const QString driver = db.driverName().toUpper();
+    const bool multiRow = (driver == QLatin1String("QPSQL") || driver == QLatin1String("QMYSQL") || driver == QLatin1String("QSQLITE"));
+    const bool returning = returnKeys && driver == QLatin1String("QPSQL") && T().autoValueIndex() >= 0;
+    if (returnKeys && !returning) {
+        tWarn("Generated keys not returned by insertAll()");
+    }
+
+    int inserted = 0;
+    int rows = 1;
+    for (int start = 0; start < objects.count(); start += rows) {
+        QSqlRecord first = objects[start].recordToCreate();
+        rows = (multiRow) ? maxBatchRows(first.count()) : bulkBatchSize;
+        rows = qMin(rows, objects.count() - start);
+
+        QString ins = db.driver()->sqlStatement(QSqlDriver::InsertStatement, T().tableName(), first, true);
+        if (ins.isEmpty()) {
+            tSystemError("SQL statement error, no fields to insert");
+            return -1;
+        }
+
+        QSqlQuery query;
+        bool res;
+        if (multiRow) {
+            QString tuple = ins.mid(ins.lastIndexOf(QLatin1String("VALUES (")) + 7);
+            QList<QVariant> values;
+            for (int i = 0; i < rows; ++i) {
+                QSqlRecord rec = (i == 0) ? first : objects[start + i].recordToCreate();
+                if (i > 0) {
+                    ins.append(QLatin1String(", ")).append(tuple);
+                }
+                for (int j = 0; j < rec.count(); ++j) {
+                    values << rec.value(j);
+                }
+            }
+
+            if (returning) {
+                QString autoValName = objects[start].fieldName(T().autoValueIndex());
+                ins.append(QLatin1String(" RETURNING ")).append(TSqlQuery::escapeIdentifier(autoValName, QSqlDriver::FieldName, db));
+            }
+
+            res = TSqlStatementCache::exec(db, ins, values, query);
+            if (res && returning) {
+                for (int i = 0; i < rows && query.next(); ++i) {
+                    objects[start + i].setAutoValue(query.value(0));
+                }
+            }
+        } else {
+            QVector<QVariantList> columns(first.count());
+            for (int i = 0; i < rows; ++i) {
+                QSqlRecord rec = (i == 0) ? first : objects[start + i].recordToCreate();
+                for (int j = 0; j < rec.count(); ++j) {
+                    columns[j] << rec.value(j);
+                }
+            }
+
+            query = TSqlStatementCache::prepare(db, ins, &res);
+            if (res) {
+                for (int j = 0; j < columns.count(); ++j) {
+                    query.addBindValue(columns[j]);
+                }
+                res = query.execBatch();
+                tQueryLog("%s", qPrintable(ins));
+            }
+        }
+
+        if (!res) {
+            tSystemError("SQL insert error: %s", qPrintable(query.lastError().text()));
+        }
+        TSqlStatementCache::release(db, ins, query);
+        if (!res) {
+            return -1;
+        }
+        inserted += rows;
+    }
+    return inserted;
+}
+
+
+/*!
+ * Updates the fields of the rows matching the criteria \a cri to the
+ * \a values, each of which is associated with the index of the property.
+ * Neither the revision nor the timestamp properties are updated
+ * implicitly. Returns the number of the rows affected, or -1 if an error
+ * occurred.
+ */
+template <class T>
+inline int TSqlORMapper<T>::updateAll(const TCriteria &cri, const QMap<int, QVariant> &values)
+{
+    if (values.isEmpty())
+        return 0;
+
+    QSqlDatabase db = TActionContext::current()->getWritableDatabase(T().databaseId());
+    QString upd;
+    QList<QVariant> params;
+    upd.reserve(256);
+    upd.append(QLatin1String("UPDATE ")).append(T().tableName()).append(QLatin1String(" SET "));
+
+    for (QMapIterator<int, QVariant> it(values); it.hasNext(); ) {
+        it.next();
+        QString name = TCriteriaConverter<T>::propertyName(it.key());
+        if (name.isEmpty()) {
+            tSystemError("No such property: %d", it.key());
+            return -1;
+        }
+        upd.append(TSqlQuery::escapeIdentifier(name, QSqlDriver::FieldName, db));
+        upd.append(QLatin1String("=?, "));
+        params << it.value();
+    }
+    upd.chop(2);
+
+    TCriteriaConverter<T> conv(cri, db);
+    QString where = conv.toString(params);
+    if (!where.isEmpty()) {
+        upd.append(QLatin1String(" WHERE ")).append(where);
+    }
+
+    QSqlQuery query;
+    int ret = -1;
+    if (TSqlStatementCache::exec(db, upd, params, query)) {
+        ret = query.numRowsAffected();
+    } else {
+        tSystemError("SQL update error: %s", qPrintable(query.lastError().text()));
+    }
+    TSqlStatementCache::release(db, upd, query);
+    return ret;
+}
+
+
+/*!
+ * Removes the rows of the \a primaryKeys, up to the batch size of them
+ * in a statement. Returns the number of the rows removed, or -1 if an
+ * error occurred.
+ */
+template <class T>
+inline int TSqlORMapper<T>::removeAll(const QList<QVariant> &primaryKeys)
+{
+    int idx = T().primaryKeyIndex();
+    if (idx < 0) {
+        tSystemError("Primary key not found, table name: %s", qPrintable(T().tableName()));
         return -1;
     }
-    return sqlQuery.numRowsAffected();
+
+    QSqlDatabase db = TActionContext::current()->getWritableDatabase(T().databaseId());
+    QString del = db.driver()->sqlStatement(QSqlDriver::DeleteStatement,
+                                            T().tableName(), QSqlRecord(), false);
+    del.append(QLatin1String(" WHERE "));
+    del.append(TSqlQuery::escapeIdentifier(TCriteriaConverter<T>::propertyName(idx), QSqlDriver::FieldName, db));
+    del.append(QLatin1String(" IN ("));
+
+    int removed = 0;
+    int rows = maxBatchRows(1);
+    for (int start = 0; start < primaryKeys.count(); start += rows) {
+        QList<QVariant> keys = primaryKeys.mid(start, rows);
+        QString stmt = del;
+        for (int i = 0; i < keys.count(); ++i) {
+            stmt.append(QLatin1String("?,"));
+        }
+        stmt[stmt.length() - 1] = QLatin1Char(')');
+
+        QSqlQuery query;
+        bool res = TSqlStatementCache::exec(db, stmt, keys, query);
+        if (res) {
+            removed += query.numRowsAffected();
+        } else {
+            tSystemError("SQL delete error: %s", qPrintable(query.lastError().text()));
+        }
+        TSqlStatementCache::release(db, stmt, query);
+        if (!res) {
+            return -1;
+        }
+    }
+    return removed;
 }
 
 
 template <class T>
 inline void TSqlORMapper<T>::reset()
 {
-    setTable(tableName());
+    releaseStatement();
+    QSqlTableModel::clear();
 }
 
 
 template <class T>
 inline void TSqlORMapper<T>::clear()
 {
+    releaseStatement();
     QSqlTableModel::clear();
     queryFilter.clear();
-    sortColumn = -1;
-    sortOrder = TSql::AscendingOrder;
+    filterValues.clear();
+    sortColumns.clear();
     queryLimit = 0;
     queryOffset = 0;
+    pageLimit = 0;
     
     // Don't call the setTable() here,
     // or it causes a segmentation fault.
@@ -256,15 +720,84 @@ template <class T>
 inline QString TSqlORMapper<T>::orderByPhrase() const
 {
     QString str;
-    if (sortColumn >= 0) {
-        QString f = TCriteriaConverter<T>::propertyName(sortColumn);
+    for (int i = 0; i < sortColumns.count(); ++i) {
+        QString f = TCriteriaConverter<T>::propertyName(sortColumns[i].first);
         if (!f.isEmpty()) {
             QString field = TSqlQuery::escapeIdentifier(f, QSqlDriver::FieldName, database());
-            str.append(QLatin1String(" ORDER BY ")).append(field);
-            str.append((sortOrder == TSql::AscendingOrder) ? QLatin1String(" ASC") : QLatin1String(" DESC"));
+            str.append((str.isEmpty()) ? QLatin1String(" ORDER BY ") : QLatin1String(", ")).append(field);
+            str.append((sortColumns[i].second == TSql::AscendingOrder) ? QLatin1String(" ASC") : QLatin1String(" DESC"));
         }
     }
     return str;
 }
 
+
+/*!
+ * Returns the columns of the keys of findAfter(); the sort columns
+ * followed by the primary key, which makes the order unique.
+ */
+template <class T>
+inline QList<QPair<int, TSql::SortOrder> > TSqlORMapper<T>::keysetColumns() const
+{
+    QList<QPair<int, TSql::SortOrder> > columns = sortColumns;
+    int pk = T().primaryKeyIndex();
+    if (pk < 0) {
+        tWarn("Primary key not found, rows with the same sort keys may be skipped");
+        return columns;
+    }
+
+    for (int i = 0; i < columns.count(); ++i) {
+        if (columns[i].first == pk)
+            return columns;
+    }
+    columns << qMakePair(pk, (columns.isEmpty()) ? TSql::AscendingOrder : columns.last().second);
+    return columns;
+}
+
+
+/*!
+ * Returns the condition of the rows following the row of 'lastKeys',
+ * appending the values to be bound to 'values'. A row value comparison
+ * such as "(a, b) > (?, ?)" is used on PostgreSQL if all the columns
+ * are sorted in the same order; otherwise the comparison is expanded
+ * to "((a>?) OR (a=? AND b>?))".
+ */
+template <class T>
+inline QString TSqlORMapper<T>::keysetPhrase(const QList<QVariant> &lastKeys, QList<QVariant> &values) const
+{
+    QList<QPair<int, TSql::SortOrder> > columns = keysetColumns();
+    QList<QPair<QString, TSql::SortOrder> > names;
+    for (int i = 0; i < columns.count(); ++i) {
+        QString f = TCriteriaConverter<T>::propertyName(columns[i].first);
+        if (f.isEmpty()) {
+            tSystemError("No such property: %d", columns[i].first);
+            return QString();
+        }
+        names << qMakePair(TSqlQuery::escapeIdentifier(f, QSqlDriver::FieldName, database()), columns[i].second);
+    }
+    return TSqlKeyset::phrase(names, database().driverName().toUpper() == QLatin1String("QPSQL"), lastKeys, values);
+}
+
+
+/*!
+ * Returns the opaque token of the keys 'keys' to be handed to clients,
+ * signed with the session secret.
+ */
+template <class T>
+inline QString TSqlORMapper<T>::keysToCursor(const QList<QVariant> &keys)
+{
+    return TSqlKeyset::toCursor(keys, TSqlKeyset::secret());
+}
+
+
+/*!
+ * Decodes the token 'cursor' made by keysToCursor() to the keys of
+ * keysetColumns(). Returns false if the token is invalid or tampered.
+ */
+template <class T>
+inline bool TSqlORMapper<T>::cursorToKeys(const QString &cursor, QList<QVariant> &keys) const
+{
+    return TSqlKeyset::fromCursor(cursor, keysetColumns().count(), TSqlKeyset::secret(), keys);
+}
+
 #endif // TSQLORMAPPER_H
@@ -0,0 +1,36 @@
+/* Copyright (c) 2010-2012, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <TSqlORMapperCursor>
+
+/*!
+  \class TSqlORMapperCursor
+  \brief The TSqlORMapperCursor class provides a forward-only cursor
+         reading the objects of TSqlORMapper one row at a time.
+
+  Unlike TSqlORMapperIterator, the result is not loaded into the mapper,
+  so any number of rows is processed in constant memory. The object
+  returned by value() is reused for each row; copy it to keep it. The
+  filter, sort order, limit and offset set to the mapper are applied;
+  a criteria given to the constructor is applied in place of the filter,
+  without changing the mapper.
+  On PostgreSQL, the rows are fetched through a server-side cursor in
+  batches of the fetch size. The cursor is declared in the transaction
+  of the action if it is in progress on the connection; otherwise the
+  cursor begins its own transaction and commits it in close(). Close
+  the cursor before writing the database in that case, not to commit
+  the writes with it.
+
+  \code
+  TSqlORMapper<BlogObject> mapper;
+  mapper.setSort(BlogObject::Id, TSql::AscendingOrder);
+  TSqlORMapperCursor<BlogObject> cursor(mapper);
+  while (cursor.next()) {
+      write(cursor.value().title);
+  }
+  \endcode
+*/
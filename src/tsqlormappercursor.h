@@ -0,0 +1,171 @@
+#ifndef TSQLORMAPPERCURSOR_H
+#define TSQLORMAPPERCURSOR_H
+
+#include <QAtomicInt>
+#include <TSqlORMapper>
+
+
+template <class T>
+class TSqlORMapperCursor
+{
+public:
+    TSqlORMapperCursor(TSqlORMapper<T> &mapper, const TCriteria &cri = TCriteria(), int fetchSize = 1000);
+    ~TSqlORMapperCursor() { close(); }
+
+    bool isActive() const { return active; }
+    bool next();
+    const T &value() const { return obj; }
+    int position() const { return pos; }
+    void close();
+
+private:
+    bool fetch();
+    static QString inlineValues(const QString &sql, const QList<QVariant> &values, const QSqlDatabase &database);
+
+    QSqlQuery query;
+    QString cursorName;  // server-side cursor of PostgreSQL
+    int fetchSize;
+    int batchCount;
+    int pos;
+    bool active;
+    bool ownTransaction;  // BEGIN issued by the cursor
+    T obj;
+
+    Q_DISABLE_COPY(TSqlORMapperCursor)
+};
+
+
+template <class T>
+inline TSqlORMapperCursor<T>::TSqlORMapperCursor(TSqlORMapper<T> &mapper, const TCriteria &cri, int fetchSize)
+    : query(TActionContext::current()->getReadDatabase(T().databaseId())), fetchSize(qMax(fetchSize, 1)), batchCount(0), pos(-1), active(false), ownTransaction(false)
+{
+    static QAtomicInt cursorCount(0);
+
+    // The filter of the mapper is left as it is
+    QString sql;
+    QList<QVariant> values;
+    if (cri.isEmpty()) {
+        sql = mapper.selectStatement();
+        values = mapper.filterValues;
+    } else {
+        TCriteriaConverter<T> conv(cri, mapper.database());
+        sql = mapper.selectStatement(conv.toString(values));
+    }
+
+    if (sql.isEmpty())
+        return;
+
+    query.setForwardOnly(true);
+    if (mapper.database().driverName().toUpper() == QLatin1String("QPSQL")) {
+        // Fetches the rows in batches, not to receive all at once.
+        // A cursor WITH HOLD would materialize the whole result at the
+        // commit, so the cursor lives in a transaction until close().
+        TActionContext *ctx = TActionContext::current();
+        int id = T().databaseId();
+        QSqlDatabase &db = ctx->getReadDatabase(id);
+        bool inTransaction = ctx->isTransactionActive(id)
+            && db.connectionName() == ctx->getPrimaryDatabase(id).connectionName();
+        if (!inTransaction) {
+            ownTransaction = query.exec(QLatin1String("BEGIN"));
+        }
+
+        // DECLARE can't be prepared, so the values are written in it.
+        cursorName = QLatin1String("tf_cursor_") + QString::number(cursorCount.fetchAndAddRelaxed(1));
+        sql = QLatin1String("DECLARE ") + cursorName + QLatin1String(" NO SCROLL CURSOR FOR ")
+            + inlineValues(sql, values, db);
+        active = (inTransaction || ownTransaction) && query.exec(sql) && fetch();
+    } else if (values.isEmpty()) {
+        active = query.exec(sql);
+    } else {
+        active = query.prepare(sql);
+        if (active) {
+            for (int i = 0; i < values.count(); ++i) {
+                query.bindValue(i, values[i]);
+            }
+            active = query.exec();
+        }
+    }
+
+    if (!active) {
+        tSystemError("SQL cursor error: %s", qPrintable(query.lastError().text()));
+    }
+}
+
+/*!
+ * Returns the statement 'sql' with the placeholders outside the quotes
+ * replaced by the literals of the 'values'.
+ */
+template <class T>
+inline QString TSqlORMapperCursor<T>::inlineValues(const QString &sql, const QList<QVariant> &values, const QSqlDatabase &database)
+{
+    if (values.isEmpty())
+        return sql;
+
+    QString str;
+    str.reserve(sql.length() + values.count() * 8);
+    QChar quote;
+    int n = 0;
+    for (int i = 0; i < sql.length(); ++i) {
+        QChar c = sql[i];
+        if (!quote.isNull()) {
+            if (c == quote)
+                quote = QChar();
+        } else if (c == QLatin1Char('\'') || c == QLatin1Char('"')) {
+            quote = c;
+        } else if (c == QLatin1Char('?') && n < values.count()) {
+            str.append(TSqlQuery::formatValue(values[n++], database));
+            continue;
+        }
+        str.append(c);
+    }
+    return str;
+}
+
+
+template <class T>
+inline bool TSqlORMapperCursor<T>::fetch()
+{
+    QString sql = QLatin1String("FETCH FORWARD ") + QString::number(fetchSize) + QLatin1String(" FROM ") + cursorName;
+    tQueryLog("%s", qPrintable(sql));
+    batchCount = 0;
+    return query.exec(sql);
+}
+
+
+template <class T>
+inline bool TSqlORMapperCursor<T>::next()
+{
+    if (!active)
+        return false;
+
+    if (!query.next()) {
+        // The last batch is shorter than the fetch size
+        if (cursorName.isEmpty() || batchCount < fetchSize || !fetch() || !query.next()) {
+            close();
+            return false;
+        }
+    }
+
+    ++batchCount;
+    ++pos;
+    obj.setRecord(query.record(), QSqlError());
+    return true;
+}
+
+
+template <class T>
+inline void TSqlORMapperCursor<T>::close()
+{
+    if (!cursorName.isEmpty()) {
+        query.exec(QLatin1String("CLOSE ") + cursorName);
+        cursorName.clear();
+    }
+    if (ownTransaction) {
+        query.exec(QLatin1String("COMMIT"));
+        ownTransaction = false;
+    }
+    query.finish();
+    active = false;
+}
+
+#endif // TSQLORMAPPERCURSOR_H
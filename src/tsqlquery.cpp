@@ -9,6 +9,7 @@
 #include <QMutex>
 #include <QMutexLocker>
 #include <TSqlQuery>
+#include <TSqlStatementCache>
 #include <TWebApplication>
 #include <TActionContext>
 #include "tsystemglobal.h"
@@ -20,48 +21,206 @@ static QMutex cacheMutex;
   \class TSqlQuery
   \brief The TSqlQuery class provides a means of executing and manipulating
          SQL statements.
+
+  The statements loaded by load() are prepared through TSqlStatementCache,
+  and given back to the cache when the query is destroyed or prepared
+  with another statement.
+
+  The transaction of the database begins when a statement other than
+  SELECT is executed first. SELECT statements are executed on a read
+  replica of the database if any, unless the current action has
+  written the database. The connection is chosen again when a prepared
+  statement is executed, so a SELECT prepared before a write reads the
+  write.
 */
 
+static bool isReadStatement(const QString &query)
+{
+    QString q = query.trimmed();
+    if (q.isEmpty())
+        return true;
+
+    // Locking reads need a transaction
+    return q.startsWith(QLatin1String("SELECT"), Qt::CaseInsensitive)
+        && !q.contains(QLatin1String("FOR UPDATE"), Qt::CaseInsensitive)
+        && !q.contains(QLatin1String("FOR SHARE"), Qt::CaseInsensitive)
+        && !q.contains(QLatin1String("LOCK IN SHARE MODE"), Qt::CaseInsensitive);
+}
+
+
+static QSqlDatabase &databaseFor(const QString &query, int databaseId)
+{
+    return (isReadStatement(query)) ? TActionContext::current()->getReadDatabase(databaseId)
+        : TActionContext::current()->getWritableDatabase(databaseId);
+}
+
 /*!
   Constructor.
  */
 TSqlQuery::TSqlQuery(const QString &query, int databaseId)
-    : QSqlQuery(query, TActionContext::current()->getDatabase(databaseId))
+    : QSqlQuery(query, databaseFor(query, databaseId)),
+      sqlDatabase(databaseFor(query, databaseId)),
+      dbId(databaseId)
 { }
 
 /*!
   Constructor.
  */
 TSqlQuery::TSqlQuery(int databaseId)
-    : QSqlQuery(QString(), TActionContext::current()->getDatabase(databaseId))
+    : QSqlQuery(QString(), TActionContext::current()->getReadDatabase(databaseId)),
+      sqlDatabase(TActionContext::current()->getReadDatabase(databaseId)),
+      dbId(databaseId)
 { }
 
+/*!
+  Copy constructor. A copy shares the prepared statement with \a other,
+  so neither of them gives it back to TSqlStatementCache.
+ */
+TSqlQuery::TSqlQuery(const TSqlQuery &other)
+    : QSqlQuery(other),
+      sqlDatabase(other.sqlDatabase),
+      dbId(other.dbId)
+{
+    other.cachedStatement.clear();
+}
+
+/*!
+  Destructor.
+ */
+TSqlQuery::~TSqlQuery()
+{
+    if (!cachedStatement.isEmpty()) {
+        TSqlStatementCache::release(sqlDatabase, cachedStatement, *this);
+    }
+}
+
+
+/*!
+  Assigns \a other to this query. The prepared statement shared with
+  \a other isn't given back to TSqlStatementCache.
+ */
+TSqlQuery &TSqlQuery::operator=(const TSqlQuery &other)
+{
+    if (this != &other) {
+        releaseStatement();
+        QSqlQuery::operator=(other);
+        sqlDatabase = other.sqlDatabase;
+        dbId = other.dbId;
+        other.cachedStatement.clear();
+    }
+    return *this;
+}
+
+
+void TSqlQuery::releaseStatement()
+{
+    if (!cachedStatement.isEmpty()) {
+        TSqlStatementCache::release(sqlDatabase, cachedStatement, *this);
+        cachedStatement.clear();
+        QSqlQuery::operator=(QSqlQuery(sqlDatabase));  // not to share the cached one
+    }
+}
+
+
+/*!
+  Binds this query to the connection \a db, if not bound yet.
+*/
+void TSqlQuery::setDatabase(QSqlDatabase &db)
+{
+    if (db.connectionName() != sqlDatabase.connectionName()) {
+        sqlDatabase = db;
+        QSqlQuery::operator=(QSqlQuery(sqlDatabase));
+    }
+}
+
+
+/*!
+  Binds this query to the connection for preparing the statement
+  \a query. The transaction doesn't begin until it's executed.
+*/
+void TSqlQuery::setDatabaseFor(const QString &query)
+{
+    setDatabase((isReadStatement(query)) ? TActionContext::current()->getReadDatabase(dbId)
+                : TActionContext::current()->getPrimaryDatabase(dbId));
+}
+
+
+/*!
+  Prepares the current statement again on the connection \a db with
+  the values bound so far.
+*/
+void TSqlQuery::reprepare(QSqlDatabase &db)
+{
+    QString query = lastQuery();
+    bool forwardOnly = isForwardOnly();
+    QSql::NumericalPrecisionPolicy precision = numericalPrecisionPolicy();
+    QVector<QVariant> values;
+    for (int i = 0; i < boundValues().count(); ++i) {
+        values << boundValue(i);
+    }
+
+    bool cached = !cachedStatement.isEmpty();
+    releaseStatement();
+    setDatabase(db);
+    if (cached) {
+        bool res;
+        QSqlQuery::operator=(TSqlStatementCache::prepare(sqlDatabase, query, &res));
+        if (res) {
+            cachedStatement = query;
+        }
+    } else {
+        QSqlQuery::prepare(query);
+    }
+
+    setForwardOnly(forwardOnly);
+    setNumericalPrecisionPolicy(precision);
+    for (int i = 0; i < values.count(); ++i) {
+        bindValue(i, values[i]);
+    }
+}
+
 
 bool TSqlQuery::load(const QString &filename)
 {
-    QMutexLocker locker(&cacheMutex);
+    QString query;
+    {
+        QMutexLocker locker(&cacheMutex);
+        query = queryCache.value(filename);
+    }
 
-    QString query = queryCache.value(filename);
-    if (!query.isEmpty()) {
-        return QSqlQuery::prepare(query);
+    if (query.isEmpty()) {
+        query = readQueryFile(filename);
+        if (query.isEmpty())
+            return false;
     }
 
+    releaseStatement();
+    setDatabaseFor(query);
+
+    bool res;
+    QSqlQuery::operator=(TSqlStatementCache::prepare(sqlDatabase, query, &res));
+    if (res) {
+        cachedStatement = query;
+
+        // Caches the query-string
+        QMutexLocker locker(&cacheMutex);
+        queryCache.insert(filename, query);
+    }
+    return res;
+}
+
+
+QString TSqlQuery::readQueryFile(const QString &filename) const
+{
     QDir dir(queryDirPath());
     QFile file(dir.filePath(filename));
     tSystemDebug("SQL_QUERY_ROOT: %s", qPrintable(dir.dirName()));
     tSystemDebug("filename: %s", qPrintable(file.fileName()));
     if (!file.open(QIODevice::ReadOnly)) {
         tSystemError("Unable to open file: %s", qPrintable(file.fileName()));
-        return false;
-    }
-
-    query = QObject::tr(file.readAll().constData());
-    bool res = QSqlQuery::prepare(query);
-    if (res) {
-        // Caches the query-string
-        queryCache.insert(filename, query);
+        return QString();
     }
-    return res;
+    return QObject::tr(file.readAll().constData());
 }
 
 
@@ -83,7 +242,7 @@ void TSqlQuery::clearCachedQueries()
 
 QString TSqlQuery::escapeIdentifier(const QString &identifier, QSqlDriver::IdentifierType type, int databaseId)
 {
-    return escapeIdentifier(identifier, type, TActionContext::current()->getDatabase(databaseId));
+    return escapeIdentifier(identifier, type, TActionContext::current()->getPrimaryDatabase(databaseId));
 }
 
 
@@ -100,7 +259,7 @@ QString TSqlQuery::escapeIdentifier(const QString &identifier, QSqlDriver::Ident
 
 QString TSqlQuery::formatValue(const QVariant &val, int databaseId)
 {
-    return formatValue(val, TActionContext::current()->getDatabase(databaseId));
+    return formatValue(val, TActionContext::current()->getPrimaryDatabase(databaseId));
 }
 
 
@@ -114,6 +273,8 @@ QString TSqlQuery::formatValue(const QVariant &val, const QSqlDatabase &database
 
 bool TSqlQuery::exec(const QString &query)
 {
+    releaseStatement();
+    setDatabase(databaseFor(query, dbId));
     bool ret = QSqlQuery::exec(query);
     QString q = (ret) ? query : QLatin1String("(Query failed) ") + query;
     tQueryLog("%s", qPrintable(q));
@@ -123,6 +284,15 @@ bool TSqlQuery::exec(const QString &query)
 
 bool TSqlQuery::exec()
 {
+    QString query = lastQuery();
+    if (!query.isEmpty()) {
+        // Chooses the connection now, not when prepared
+        QSqlDatabase &db = databaseFor(query, dbId);
+        if (db.connectionName() != sqlDatabase.connectionName()) {
+            reprepare(db);
+        }
+    }
+
     bool ret = QSqlQuery::exec();
     QString q = executedQuery();
     QString str = (ret) ? q : (QLatin1String("(Query failed) ") + (q.isEmpty() ? lastQuery() : q));
@@ -10,6 +10,9 @@ class T_CORE_EXPORT TSqlQuery : public QSqlQuery
 public:
     TSqlQuery(const QString &query = QString(), int databaseId = 0);
     TSqlQuery(int databaseId);
+    TSqlQuery(const TSqlQuery &other);
+    ~TSqlQuery();
+    TSqlQuery &operator=(const TSqlQuery &other);
 
     TSqlQuery &prepare(const QString &query);
     bool load(const QString &filename);
@@ -26,11 +29,24 @@ public:
     static QString escapeIdentifier(const QString &identifier, QSqlDriver::IdentifierType type, const QSqlDatabase &database);
     static QString formatValue(const QVariant &val, int databaseId = 0);
     static QString formatValue(const QVariant &val, const QSqlDatabase &database);
+
+private:
+    QString readQueryFile(const QString &filename) const;
+    void releaseStatement();
+    void setDatabase(QSqlDatabase &db);
+    void setDatabaseFor(const QString &query);
+    void reprepare(QSqlDatabase &db);
+
+    QSqlDatabase sqlDatabase;
+    int dbId;
+    mutable QString cachedStatement;  // statement taken from TSqlStatementCache
 };
 
 
 inline TSqlQuery &TSqlQuery::prepare(const QString &query)
 {
+    releaseStatement();
+    setDatabaseFor(query);
     QSqlQuery::prepare(query);
     return *this;
 }
@@ -0,0 +1,182 @@
+/* Copyright (c) 2010-2012, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <QHash>
+#include <QReadWriteLock>
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <QStringList>
+#include <TSqlSchemaCache>
+#include <TSqlDatabasePool>
+#include <TActionContext>
+#include <TWebApplication>
+#include "tsystemglobal.h"
+
+#define WARM_UP  "SqlSchemaCache.WarmUp"
+
+/*!
+  \class TSqlSchemaCache
+  \brief The TSqlSchemaCache class caches the schema of the tables, that
+  is, the fields with their types and the primary key, for each process.
+
+  TSqlORMapper and TSqlObject get the schema from this cache instead of
+  querying the catalog of the database each time. A table is loaded on
+  first use, or all the tables are loaded at startup if the
+  SqlSchemaCache.WarmUp setting is true. After the schema of a table is
+  altered, call invalidate() or invalidateAll() to reload it.
+*/
+
+struct TableSchema
+{
+    QSqlRecord record;
+    QSqlIndex primaryIndex;
+};
+
+static QHash<QString, TableSchema> schemaHash;
+static QReadWriteLock schemaLock;
+
+
+static inline QString cacheKey(int databaseId, const QString &table)
+{
+    return QString::number(databaseId) + QLatin1Char(':') + table;
+}
+
+
+static bool lookup(int databaseId, const QString &table, TableSchema &schema)
+{
+    const QString key = cacheKey(databaseId, table);
+    {
+        QReadLocker locker(&schemaLock);
+        QHash<QString, TableSchema>::const_iterator it = schemaHash.constFind(key);
+        if (it != schemaHash.constEnd()) {
+            schema = it.value();
+            return true;
+        }
+    }
+
+    // Loads on first use
+    TActionContext *context = TActionContext::current();
+    if (!context) {
+        tSystemError("Schema not cached: %s", qPrintable(table));
+        return false;
+    }
+
+    if (!TSqlSchemaCache::load(databaseId, context->getPrimaryDatabase(databaseId), table))
+        return false;
+
+    QReadLocker locker(&schemaLock);
+    schema = schemaHash.value(key);
+    return true;
+}
+
+/*!
+  Returns the record containing the fields of the table \a table in the
+  database \a databaseId, without the values.
+*/
+QSqlRecord TSqlSchemaCache::record(int databaseId, const QString &table)
+{
+    TableSchema schema;
+    lookup(databaseId, table, schema);
+    return schema.record;
+}
+
+/*!
+  Returns the primary index of the table \a table in the database
+  \a databaseId.
+*/
+QSqlIndex TSqlSchemaCache::primaryIndex(int databaseId, const QString &table)
+{
+    TableSchema schema;
+    lookup(databaseId, table, schema);
+    return schema.primaryIndex;
+}
+
+/*!
+  Loads the schema of the table \a table from the \a database into the
+  cache as that of the database \a databaseId. Returns true if the table
+  exists; otherwise returns false.
+*/
+bool TSqlSchemaCache::load(int databaseId, const QSqlDatabase &database, const QString &table)
+{
+    TableSchema schema;
+    schema.record = database.record(table);
+    if (schema.record.isEmpty()) {
+        tSystemError("Table not found: %s", qPrintable(table));
+        return false;  // not cached, so that a table created later is found
+    }
+    schema.primaryIndex = database.primaryIndex(table);
+    schema.record.clearValues();
+
+    QWriteLocker locker(&schemaLock);
+    schemaHash.insert(cacheKey(databaseId, table), schema);
+    return true;
+}
+
+/*!
+  Loads the schema of all the tables in the database \a databaseId over
+  a connection of its own. Returns the number of the tables loaded.
+*/
+int TSqlSchemaCache::warmUp(int databaseId)
+{
+    const QString env = Tf::app()->databaseEnvironment();
+    const QString type = TSqlDatabasePool::driverType(env, databaseId);
+    if (type.isEmpty())
+        return 0;
+
+    int cnt = 0;
+    const QString connectionName = QString().sprintf("%02d_schema", databaseId);
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase(type, connectionName);
+        if (TSqlDatabasePool::openDatabase(db, env, databaseId)) {
+            QStringList tables = db.tables();
+            for (QStringListIterator it(tables); it.hasNext(); ) {
+                if (load(databaseId, db, it.next())) {
+                    ++cnt;
+                }
+            }
+            db.close();
+        }
+    }
+    QSqlDatabase::removeDatabase(connectionName);
+    tSystemDebug("Schema cached: %d tables  databaseId:%d", cnt, databaseId);
+    return cnt;
+}
+
+/*!
+  Removes the schema of the table \a table in the database \a databaseId
+  from the cache.
+*/
+void TSqlSchemaCache::invalidate(int databaseId, const QString &table)
+{
+    QWriteLocker locker(&schemaLock);
+    schemaHash.remove(cacheKey(databaseId, table));
+}
+
+/*!
+  Removes the schema of all the tables from the cache.
+*/
+void TSqlSchemaCache::invalidateAll()
+{
+    QWriteLocker locker(&schemaLock);
+    schemaHash.clear();
+}
+
+/*!
+ * Warms up the cache if the SqlSchemaCache.WarmUp setting is true.
+ * Call this in main thread.
+ */
+void TSqlSchemaCache::instantiate()
+{
+    static bool warmedUp = false;
+
+    if (!warmedUp && Tf::app()->appSettings().value(WARM_UP, false).toBool()) {
+        for (int i = 0; i < Tf::app()->databaseSettingsCount(); ++i) {
+            warmUp(i);
+        }
+    }
+    warmedUp = true;
+}
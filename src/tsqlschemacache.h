@@ -0,0 +1,22 @@
+#ifndef TSQLSCHEMACACHE_H
+#define TSQLSCHEMACACHE_H
+
+#include <QSqlRecord>
+#include <QSqlIndex>
+#include <QSqlDatabase>
+#include <TGlobal>
+
+
+class T_CORE_EXPORT TSqlSchemaCache
+{
+public:
+    static QSqlRecord record(int databaseId, const QString &table);
+    static QSqlIndex primaryIndex(int databaseId, const QString &table);
+    static bool load(int databaseId, const QSqlDatabase &database, const QString &table);
+    static int warmUp(int databaseId);
+    static void invalidate(int databaseId, const QString &table);
+    static void invalidateAll();
+    static void instantiate();
+};
+
+#endif // TSQLSCHEMACACHE_H
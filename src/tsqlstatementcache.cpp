@@ -0,0 +1,144 @@
+/* Copyright (c) 2010-2012, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <QCache>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSqlError>
+#include <TSqlStatementCache>
+#include <TWebApplication>
+#include "tsystemglobal.h"
+
+#define MAX_COUNT  "SqlStatementCache.MaxCount"
+
+/*!
+  \class TSqlStatementCache
+  \brief The TSqlStatementCache class keeps prepared statements for each
+  database connection, so that the database doesn't parse and plan the
+  same statement again.
+
+  prepare() hands over a prepared query for the statement, taking it out
+  of the cache of the connection if it's there; give it back by release()
+  after use, so that it's reused by the next prepare(). Each connection
+  keeps up to SqlStatementCache.MaxCount statements, evicting the least
+  recently used ones. The cache of a connection must be cleared before
+  the connection is closed.
+  \sa TSqlObject, TSqlQuery
+*/
+
+typedef QCache<QString, QSqlQuery> StatementCache;
+
+static QHash<QString, StatementCache *> connectionCaches;
+static QMutex mutex;
+
+/*!
+  Returns the query for the \a statement prepared on the \a database.
+  If \a ok is not 0, it's set to true if the statement is prepared
+  successfully; otherwise false.
+*/
+QSqlQuery TSqlStatementCache::prepare(const QSqlDatabase &database, const QString &statement, bool *ok)
+{
+    QSqlQuery *cached = 0;
+    if (maxCount() > 0) {
+        QMutexLocker locker(&mutex);
+        StatementCache *cache = connectionCaches.value(database.connectionName());
+        if (cache) {
+            cached = cache->take(statement);
+        }
+    }
+
+    if (cached) {
+        QSqlQuery query = *cached;
+        delete cached;
+        if (ok) {
+            *ok = true;
+        }
+        return query;
+    }
+
+    QSqlQuery query(database);
+    bool res = query.prepare(statement);
+    if (!res) {
+        tSystemError("SQL prepare error: %s  [%s]", qPrintable(query.lastError().text()), qPrintable(statement));
+    }
+    if (ok) {
+        *ok = res;
+    }
+    return query;
+}
+
+/*!
+  Prepares the \a statement on the \a database, binds the \a values to
+  its placeholders in order and executes it. The query is set to \a query;
+  give it back by release() after use. Returns true if successful;
+  otherwise returns false.
+*/
+bool TSqlStatementCache::exec(const QSqlDatabase &database, const QString &statement, const QList<QVariant> &values, QSqlQuery &query)
+{
+    bool ret;
+    query = prepare(database, statement, &ret);
+    if (ret) {
+        for (int i = 0; i < values.count(); ++i) {
+            query.bindValue(i, values[i]);
+        }
+        ret = query.exec();
+    }
+    tQueryLog("%s", qPrintable(ret ? statement : QLatin1String("(Query failed) ") + statement));
+    return ret;
+}
+
+/*!
+  Gives the \a query prepared by prepare() for the \a statement back to
+  the cache of the \a database. The \a query is finished; don't use it
+  after this call. A query having failed isn't cached.
+*/
+void TSqlStatementCache::release(const QSqlDatabase &database, const QString &statement, QSqlQuery &query)
+{
+    int max = maxCount();
+    if (max <= 0 || query.lastError().isValid())
+        return;
+
+    query.finish();
+
+    QMutexLocker locker(&mutex);
+    StatementCache *&cache = connectionCaches[database.connectionName()];
+    if (!cache) {
+        cache = new StatementCache(max);
+    }
+    cache->insert(statement, new QSqlQuery(query));
+}
+
+/*!
+  Removes the statements of the connection \a connectionName from the
+  cache.
+*/
+void TSqlStatementCache::clear(const QString &connectionName)
+{
+    QMutexLocker locker(&mutex);
+    delete connectionCaches.take(connectionName);
+}
+
+/*!
+  Removes the statements of all the connections from the cache.
+*/
+void TSqlStatementCache::clearAll()
+{
+    QMutexLocker locker(&mutex);
+    qDeleteAll(connectionCaches);
+    connectionCaches.clear();
+}
+
+/*!
+  Returns the maximum number of the statements cached for a connection.
+  The value 0 disables the cache.
+*/
+int TSqlStatementCache::maxCount()
+{
+    static int max = Tf::app()->appSettings().value(MAX_COUNT, 100).toInt();
+    return max;
+}
@@ -0,0 +1,22 @@
+#ifndef TSQLSTATEMENTCACHE_H
+#define TSQLSTATEMENTCACHE_H
+
+#include <QSqlQuery>
+#include <QSqlDatabase>
+#include <QList>
+#include <QVariant>
+#include <TGlobal>
+
+
+class T_CORE_EXPORT TSqlStatementCache
+{
+public:
+    static QSqlQuery prepare(const QSqlDatabase &database, const QString &statement, bool *ok = 0);
+    static bool exec(const QSqlDatabase &database, const QString &statement, const QList<QVariant> &values, QSqlQuery &query);
+    static void release(const QSqlDatabase &database, const QString &statement, QSqlQuery &query);
+    static void clear(const QString &connectionName);
+    static void clearAll();
+    static int maxCount();
+};
+
+#endif // TSQLSTATEMENTCACHE_H
@@ -12,10 +12,14 @@
 /*!
   \class TSqlTransaction
   \brief The TSqlTransaction class provides a transaction of database.
+
+  If read-only is set by setReadOnly(), the transactions begun are
+  declared READ ONLY on PostgreSQL and MySQL, so that the database
+  rejects writes.
 */
 
 TSqlTransaction::TSqlTransaction()
-    : enabled(true), databases(Tf::app()->databaseSettingsCount())
+    : enabled(true), readOnly(false), databases(Tf::app()->databaseSettingsCount())
 { }
 
 
@@ -48,8 +52,18 @@ bool TSqlTransaction::begin(QSqlDatabase &database)
         return true;
     }
 
+    QString driver = database.driverName().toUpper();
+    if (readOnly && driver.startsWith(QLatin1String("QMYSQL"))) {
+        // Applies to the next transaction
+        database.exec(QLatin1String("SET TRANSACTION READ ONLY"));
+    }
+
     if (database.transaction()) {
         tQueryLog("[BEGIN] [databaseId:%d]", id);
+
+        if (readOnly && driver.startsWith(QLatin1String("QPSQL"))) {
+            database.exec(QLatin1String("SET TRANSACTION READ ONLY"));
+        }
     }
 
     databases[id] = database;
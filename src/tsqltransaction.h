@@ -20,9 +20,12 @@ public:
     void rollback();
     void setEnabled(bool enable);
     void setDisabled(bool disable);
+    void setReadOnly(bool readOnly);
+    bool isActive(int id) const;
 
 private:
     bool enabled;
+    bool readOnly;
     QVector<QSqlDatabase> databases;
 };
 
@@ -38,4 +41,16 @@ inline void TSqlTransaction::setDisabled(bool disable)
     enabled = !disable;
 }
 
+
+inline void TSqlTransaction::setReadOnly(bool readOnly)
+{
+    this->readOnly = readOnly;
+}
+
+
+inline bool TSqlTransaction::isActive(int id) const
+{
+    return id >= 0 && id < databases.count() && databases[id].isValid();
+}
+
 #endif // TSQLTRANSACTION_H
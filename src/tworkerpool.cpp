@@ -0,0 +1,138 @@
+/* Copyright (c) 2010-2012, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <QHash>
+#include <QStringList>
+#include <TWebApplication>
+#include "tsystemglobal.h"
+#include "tworkerpool.h"
+
+#define WORKER_POOL_PREFIX  "WorkerPool."
+
+/*!
+  \class TWorkerPool
+  \brief The TWorkerPool class limits the number of actions running
+  concurrently in a named group, a bulkhead for the action threads.
+
+  A pool is configured by the settings WorkerPool.<name>.MaxThreads,
+  WorkerPool.<name>.MaxQueue and WorkerPool.<name>.QueueTimeout in
+  application.ini, and controllers assign actions to it by
+  TActionController::workerPoolName(). Actions not assigned to any pool
+  and static files are not limited.
+
+  The counters belong to a server process, so the pools take effect
+  only with the thread MPM. In prefork mode each process serves a
+  single request at a time, and the pools don't limit anything.
+  Internal use.
+*/
+
+typedef QHash<QString, TWorkerPool *> WorkerPoolHash;
+static WorkerPoolHash *workerPools = 0;
+
+
+static void cleanup()
+{
+    if (workerPools) {
+        qDeleteAll(*workerPools);
+        delete workerPools;
+        workerPools = 0;
+    }
+}
+
+/*!
+  Constructor. Up to \a maxThreads actions run concurrently, and up to
+  \a maxQueue actions wait for \a queueTimeout milliseconds at most.
+*/
+TWorkerPool::TWorkerPool(const QString &name, int maxThreads, int maxQueue, int queueTimeout)
+    : poolName(name), maxThreadCount(maxThreads), maxQueueCount(maxQueue),
+      timeout(queueTimeout), semaphore(maxThreads), waiting(0)
+{ }
+
+/*!
+  Acquires a slot of the pool, waiting for the slot to be released if
+  the maximum number of threads are running. Returns false if the queue
+  of waiting threads is full or the waiting timed out.
+*/
+bool TWorkerPool::acquire()
+{
+    if (semaphore.tryAcquire())
+        return true;
+
+    if (waiting.fetchAndAddOrdered(1) >= maxQueueCount) {
+        waiting.deref();
+        tSystemWarn("Worker pool queue full: %s", qPrintable(poolName));
+        return false;
+    }
+
+    bool ret = semaphore.tryAcquire(1, timeout);
+    waiting.deref();
+
+    if (!ret) {
+        tSystemWarn("Worker pool queue timed out: %s", qPrintable(poolName));
+    }
+    return ret;
+}
+
+/*!
+  Releases the slot acquired by acquire().
+*/
+void TWorkerPool::release()
+{
+    semaphore.release();
+}
+
+/*!
+ * Initializes the pools from the application settings.
+ * Call this in main thread.
+ */
+void TWorkerPool::instantiate()
+{
+    if (workerPools)
+        return;
+
+    workerPools = new WorkerPoolHash();
+    qAddPostRoutine(cleanup);
+
+    QSettings &settings = Tf::app()->appSettings();
+    const QStringList keys = settings.allKeys();
+    for (QStringListIterator it(keys); it.hasNext(); ) {
+        const QString &key = it.next();
+        if (!key.startsWith(QLatin1String(WORKER_POOL_PREFIX)) || !key.endsWith(QLatin1String(".MaxThreads")))
+            continue;
+
+        QString name = key.mid(qstrlen(WORKER_POOL_PREFIX)).section(QLatin1Char('.'), 0, 0);
+        QString prefix = QLatin1String(WORKER_POOL_PREFIX) + name + QLatin1Char('.');
+        int maxThreads = settings.value(prefix + "MaxThreads").toInt();
+        int maxQueue = settings.value(prefix + "MaxQueue", 0).toInt();
+        int queueTimeout = settings.value(prefix + "QueueTimeout", 10000).toInt();
+
+        if (maxThreads <= 0) {
+            tSystemWarn("Invalid MaxThreads of worker pool: %s", qPrintable(name));
+            continue;
+        }
+
+        workerPools->insert(name, new TWorkerPool(name, maxThreads, qMax(maxQueue, 0), queueTimeout));
+        tSystemDebug("Worker pool: %s  maxThreads:%d  maxQueue:%d", qPrintable(name), maxThreads, maxQueue);
+    }
+}
+
+/*!
+  Returns the pool named \a name, or 0 if no such pool is configured.
+  The lookup takes no lock since the pools are never modified after
+  initialization.
+*/
+TWorkerPool *TWorkerPool::pool(const QString &name)
+{
+    if (!workerPools || name.isEmpty())
+        return 0;
+
+    TWorkerPool *p = workerPools->value(name);
+    if (!p) {
+        tSystemWarn("No such worker pool: %s", qPrintable(name));
+    }
+    return p;
+}
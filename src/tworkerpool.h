@@ -0,0 +1,34 @@
+#ifndef TWORKERPOOL_H
+#define TWORKERPOOL_H
+
+#include <QString>
+#include <QSemaphore>
+#include <QAtomicInt>
+#include <TGlobal>
+
+
+class T_CORE_EXPORT TWorkerPool
+{
+public:
+    TWorkerPool(const QString &name, int maxThreads, int maxQueue, int queueTimeout);
+    bool acquire();
+    void release();
+    const QString &name() const { return poolName; }
+    int maxThreads() const { return maxThreadCount; }
+    int maxQueue() const { return maxQueueCount; }
+
+    static void instantiate();
+    static TWorkerPool *pool(const QString &name);
+
+private:
+    QString poolName;
+    int maxThreadCount;
+    int maxQueueCount;
+    int timeout;
+    QSemaphore semaphore;
+    QAtomicInt waiting;
+
+    Q_DISABLE_COPY(TWorkerPool)
+};
+
+#endif // TWORKERPOOL_H
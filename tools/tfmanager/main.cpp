@@ -9,6 +9,7 @@
 #include <QSysInfo>
 #include <TWebApplication>
 #include <TSystemGlobal>
+#include <TSessionSharedMemoryStore>
 #include "servermanager.h"
 #include "processinfo.h"
 
@@ -323,6 +324,9 @@ int main(int argc, char *argv[])
         return 0;
     }
 
+    // Shared memory for sessions, kept while running
+    QSharedMemory *sessionMemory = TSessionSharedMemoryStore::createSharedMemory();
+
     int ret = 0;
     QFile pidfile;
     
@@ -342,6 +346,7 @@ int main(int argc, char *argv[])
             
         default:
             tSystemError("Invalid MPM specified");
+            delete sessionMemory;
             return 1;
         }
         
@@ -359,6 +364,7 @@ int main(int argc, char *argv[])
         if (!started) {
             tSystemError("TreeFrog application server startup failed");
             fprintf(stderr, "TreeFrog application server startup failed\n\n");
+            delete sessionMemory;
             return 1;
         }
         
@@ -394,5 +400,6 @@ int main(int argc, char *argv[])
         QFile(svrname).remove();
     }
     pidfile.remove();  // Removes the PID file
+    delete sessionMemory;
     return 0;
 }